@@ -1,6 +1,12 @@
 #pragma once
 
+#include "grad_mode.hpp"
+#include "graph.hpp"
+#include "nn.hpp"
+#include "optim.hpp"
 #include "tensor.hpp"
+#include "utils/math.hpp"
+#include "utils/parallel.hpp"
 
 namespace INNC {
 const auto zeros = Tensor::zeros;
@@ -11,12 +17,74 @@ const auto from_blob = Tensor::from_blob;
 Tensor (*const transpose)(const Tensor &, std::size_t,
                           std::size_t) = Tensor::transpose;
 Tensor (*const reshape)(const Tensor &, const SignedVec &) = Tensor::reshape;
+Tensor (*const expand)(const Tensor &, const SignedVec &) = Tensor::expand;
 inline Tensor full(const SizeVec &size, std::int64_t num, types dtype) {
   return Tensor::full(size, num, dtype);
 }
 inline Tensor full(const SizeVec &size, double num, types dtype) {
   return Tensor::full(size, num, dtype);
 }
+inline Tensor rand(const SizeVec &sizes, types dtype,
+                   Generator &gen = default_generator()) {
+  return Tensor::rand(sizes, dtype, gen);
+}
+inline Tensor randint(std::int64_t low, std::int64_t high, const SizeVec &sizes,
+                      types dtype = i64, Generator &gen = default_generator()) {
+  return Tensor::randint(low, high, sizes, dtype, gen);
+}
+inline Tensor randn(const SizeVec &sizes, types dtype,
+                    Generator &gen = default_generator()) {
+  return Tensor::randn(sizes, dtype, gen);
+}
+inline Tensor bernoulli(const Tensor &p,
+                        Generator &gen = default_generator()) {
+  return Tensor::bernoulli(p, gen);
+}
+inline Tensor qmatmul(const Tensor &a, const Tensor &b) {
+  return Tensor::qmatmul(a, b);
+}
+inline Tensor qmatmul(const Tensor &a, const Tensor &b, float out_scale,
+                      std::int32_t out_zero_point) {
+  return Tensor::qmatmul(a, b, out_scale, out_zero_point);
+}
+inline Tensor linear(const Tensor &input, const Tensor &weight,
+                     const Tensor &bias, activation act = activation::none) {
+  return Tensor::linear(input, weight, bias, act);
+}
+inline Tensor cross_entropy(const Tensor &input, const Tensor &target) {
+  return Tensor::cross_entropy(input, target);
+}
+inline Tensor layer_norm(const Tensor &input, const SizeVec &normalized_shape,
+                         const Tensor &weight, const Tensor &bias,
+                         double eps = 1e-5) {
+  return Tensor::layer_norm(input, normalized_shape, weight, bias, eps);
+}
+inline Tensor batch_norm(const Tensor &input, const Tensor &running_mean,
+                         const Tensor &running_var, const Tensor &weight,
+                         const Tensor &bias, bool training,
+                         double momentum = .1, double eps = 1e-5) {
+  return Tensor::batch_norm(input, running_mean, running_var, weight, bias,
+                            training, momentum, eps);
+}
+inline Tensor dropout(const Tensor &input, double p, bool training = true,
+                      Generator &gen = default_generator()) {
+  return Tensor::dropout(input, p, training, gen);
+}
+inline Tensor
+checkpoint(const std::function<Tensor(const std::vector<Tensor> &)> &fn,
+           const std::vector<Tensor> &inputs) {
+  return Tensor::checkpoint(fn, inputs);
+}
+inline Tensor
+vmap(const std::function<Tensor(const std::vector<Tensor> &)> &fn,
+     const std::vector<Tensor> &inputs) {
+  return Tensor::vmap(fn, inputs);
+}
+inline std::vector<Tensor> per_sample_grad(
+    const std::function<Tensor(const std::vector<Tensor> &)> &fn,
+    const std::vector<Tensor> &params, const std::vector<Tensor> &inputs) {
+  return Tensor::per_sample_grad(fn, params, inputs);
+}
 inline Tensor cat(const std::vector<Tensor> &input_tensors,
                   const size_t dim = 0) {
   return Tensor::cat(input_tensors, dim);
@@ -1,165 +1,140 @@
+#pragma once
+#include "INNC/exceptions.hpp"
+#include "INNC/graph.hpp"
+#include "INNC/types.hpp"
+#include "INNC/utils/compile_opt.hpp"
+#include "INNC/utils/traits.hpp"
+#include <array>
+#include <utility>
+
 namespace INNC {
-#define generate_unary_grad_op_helper(op)                                      \
-  class op##_helper {                                                          \
-    constexpr static void (*spec_list[types::Count][types::Count])(            \
-        TensorImpl * to, const TensorImpl *from, const TensorImpl *grad) = {   \
-        {op<std::int8_t, std::int8_t>, op<std::int8_t, std::int16_t>,          \
-         op<std::int8_t, std::int32_t>, op<std::int8_t, std::int64_t>,         \
-         op<std::int8_t, float>, op<std::int8_t, double>},                     \
-        {op<std::int16_t, std::int8_t>, op<std::int16_t, std::int16_t>,        \
-         op<std::int16_t, std::int32_t>, op<std::int16_t, std::int64_t>,       \
-         op<std::int16_t, float>, op<std::int16_t, double>},                   \
-        {op<std::int32_t, std::int8_t>, op<std::int32_t, std::int16_t>,        \
-         op<std::int32_t, std::int32_t>, op<std::int32_t, std::int64_t>,       \
-         op<std::int32_t, float>, op<std::int32_t, double>},                   \
-        {op<std::int64_t, std::int8_t>, op<std::int64_t, std::int16_t>,        \
-         op<std::int64_t, std::int32_t>, op<std::int64_t, std::int64_t>,       \
-         op<std::int64_t, float>, op<std::int64_t, double>},                   \
-        {op<float, std::int8_t>, op<float, std::int16_t>,                      \
-         op<float, std::int32_t>, op<float, std::int64_t>, op<float, float>,   \
-         op<float, double>},                                                   \
-        {op<double, std::int8_t>, op<double, std::int16_t>,                    \
-         op<double, std::int32_t>, op<double, std::int64_t>,                   \
-         op<double, float>, op<double, double>}};                              \
-                                                                               \
-  public:                                                                      \
-    static auto dispatch(types l_t, types r_t) { return spec_list[l_t][r_t]; } \
+class TensorImpl;
+
+// A set of `types` one argument of a kernel is specialized over.
+template <types... ts> struct type_domain {
+  static constexpr size_t size = sizeof...(ts);
+  static constexpr std::array<types, size> value{ts...};
+  static size_t index_of(types t) {
+    constexpr auto pos = []() {
+      std::array<size_t, types::Count> ret{};
+      ret.fill(size);
+      for (size_t i = 0; i < size; ++i)
+        ret[value[i]] = i;
+      return ret;
+    }();
+    run_expect(pos[t] != size, "The type ", to_string(t),
+               " is not supported by this operator.");
+    return pos[t];
   }
+};
 
-#define generate_unary_op_helper(op)                                           \
-  class op##_helper {                                                          \
-    constexpr static void (*spec_list[types::Count][types::Count])(            \
-        TensorImpl * to, const TensorImpl *from) = {                           \
-        {op<std::int8_t, std::int8_t>, op<std::int8_t, std::int16_t>,          \
-         op<std::int8_t, std::int32_t>, op<std::int8_t, std::int64_t>,         \
-         op<std::int8_t, float>, op<std::int8_t, double>},                     \
-        {op<std::int16_t, std::int8_t>, op<std::int16_t, std::int16_t>,        \
-         op<std::int16_t, std::int32_t>, op<std::int16_t, std::int64_t>,       \
-         op<std::int16_t, float>, op<std::int16_t, double>},                   \
-        {op<std::int32_t, std::int8_t>, op<std::int32_t, std::int16_t>,        \
-         op<std::int32_t, std::int32_t>, op<std::int32_t, std::int64_t>,       \
-         op<std::int32_t, float>, op<std::int32_t, double>},                   \
-        {op<std::int64_t, std::int8_t>, op<std::int64_t, std::int16_t>,        \
-         op<std::int64_t, std::int32_t>, op<std::int64_t, std::int64_t>,       \
-         op<std::int64_t, float>, op<std::int64_t, double>},                   \
-        {op<float, std::int8_t>, op<float, std::int16_t>,                      \
-         op<float, std::int32_t>, op<float, std::int64_t>, op<float, float>,   \
-         op<float, double>},                                                   \
-        {op<double, std::int8_t>, op<double, std::int16_t>,                    \
-         op<double, std::int32_t>, op<double, std::int64_t>,                   \
-         op<double, float>, op<double, double>}};                              \
-                                                                               \
-  public:                                                                      \
-    static auto dispatch(types l_t, types r_t) { return spec_list[l_t][r_t]; } \
+template <size_t start, size_t... idx>
+auto make_type_domain_(std::index_sequence<idx...>)
+    -> type_domain<static_cast<types>(start + idx)...>;
+
+using all_types_ = decltype(make_type_domain_<0>(
+    std::make_index_sequence<types::Count>()));
+using float_types_ = decltype(make_type_domain_<float_type_idx_start_>(
+    std::make_index_sequence<float_type_n_>()));
+
+template <size_t k, typename... Ds> consteval size_t grid_stride_() {
+  constexpr std::array<size_t, sizeof...(Ds)> sizes{Ds::size...};
+  size_t s = 1;
+  for (size_t j = k + 1; j < sizes.size(); ++j)
+    s *= sizes[j];
+  return s;
+}
+
+template <typename H, size_t i, typename... Ds, size_t... k>
+consteval auto spec_at_(std::index_sequence<k...>) {
+  return H::template spec<
+      to_native<Ds::value[i / grid_stride_<k, Ds...>() % Ds::size]>...>;
+}
+
+// The flattened table of `H::spec` over the cartesian product of `Ds`.
+template <typename H, typename... Ds>
+constexpr auto spec_table_ = []<size_t... i>(std::index_sequence<i...>) {
+  return std::array{spec_at_<H, i, Ds...>(
+      std::make_index_sequence<sizeof...(Ds)>())...};
+}(std::make_index_sequence<(Ds::size * ...)>());
+
+// The kernel picked by `dispatch`. Calling it runs the kernel and, while a
+// `Graph` is captured on this thread, also records the launch.
+template <typename F> struct kernel_launch_;
+
+template <typename... Args> struct kernel_launch_<void (*)(Args...)> {
+  void (*kernel)(Args...);
+  void operator()(Args... args) const {
+    kernel(args...);
+    if (__UNLIKELY(Graph::capturing() != nullptr))
+      Graph::capturing()->record(kernel, args...);
+  }
+};
+
+template <typename F> struct to_func_ptr<kernel_launch_<F>> {
+  using type = F;
+};
+
+template <typename F> kernel_launch_<F> make_launch_(F kernel) {
+  return {kernel};
+}
+
+template <typename H, typename... Ds> struct dispatcher_;
+
+template <typename H, typename D0> struct dispatcher_<H, D0> {
+  static auto dispatch(types t0) {
+    return make_launch_(spec_table_<H, D0>[D0::index_of(t0)]);
   }
+};
+
+template <typename H, typename D0, typename D1> struct dispatcher_<H, D0, D1> {
+  static auto dispatch(types t0, types t1) {
+    return make_launch_(spec_table_<H, D0, D1>[D0::index_of(t0) * D1::size +
+                                               D1::index_of(t1)]);
+  }
+};
+
+template <typename H, typename D0, typename D1, typename D2>
+struct dispatcher_<H, D0, D1, D2> {
+  static auto dispatch(types t0, types t1, types t2) {
+    return make_launch_(
+        spec_table_<H, D0, D1, D2>[(D0::index_of(t0) * D1::size +
+                                    D1::index_of(t1)) *
+                                       D2::size +
+                                   D2::index_of(t2)]);
+  }
+};
+
+#define generate_op_helper_(op, ...)                                           \
+  struct op##_helper : dispatcher_<op##_helper, __VA_ARGS__> {                 \
+    template <typename... Ts> static constexpr auto spec = op<Ts...>;          \
+  }
+
+#define generate_unary_grad_op_helper(op)                                      \
+  generate_op_helper_(op, all_types_, all_types_)
+
+#define generate_unary_op_helper(op)                                           \
+  generate_op_helper_(op, all_types_, all_types_)
 
 // the type on the left would be the type of the return value
 #define generate_binary_op_helper(op)                                          \
-  class op##_helper {                                                          \
-    constexpr static void (*spec_list[types::Count][types::Count])(            \
-        TensorImpl * dst, const TensorImpl *l, const TensorImpl *r) = {        \
-        {op<std::int8_t, std::int8_t>, op<std::int8_t, std::int16_t>,          \
-         op<std::int8_t, std::int32_t>, op<std::int8_t, std::int64_t>,         \
-         op<std::int8_t, float>, op<std::int8_t, double>},                     \
-        {op<std::int16_t, std::int8_t>, op<std::int16_t, std::int16_t>,        \
-         op<std::int16_t, std::int32_t>, op<std::int16_t, std::int64_t>,       \
-         op<std::int16_t, float>, op<std::int16_t, double>},                   \
-        {op<std::int32_t, std::int8_t>, op<std::int32_t, std::int16_t>,        \
-         op<std::int32_t, std::int32_t>, op<std::int32_t, std::int64_t>,       \
-         op<std::int32_t, float>, op<std::int32_t, double>},                   \
-        {op<std::int64_t, std::int8_t>, op<std::int64_t, std::int16_t>,        \
-         op<std::int64_t, std::int32_t>, op<std::int64_t, std::int64_t>,       \
-         op<std::int64_t, float>, op<std::int64_t, double>},                   \
-        {op<float, std::int8_t>, op<float, std::int16_t>,                      \
-         op<float, std::int32_t>, op<float, std::int64_t>, op<float, float>,   \
-         op<float, double>},                                                   \
-        {op<double, std::int8_t>, op<double, std::int16_t>,                    \
-         op<double, std::int32_t>, op<double, std::int64_t>,                   \
-         op<double, float>, op<double, double>}};                              \
-                                                                               \
-  public:                                                                      \
-    static auto dispatch(types l_t, types r_t) { return spec_list[l_t][r_t]; } \
-  }
+  generate_op_helper_(op, all_types_, all_types_)
 
 // float, float, int/float
 #define generate_ffi_op_helper(op)                                             \
-  class op##_helper {                                                          \
-    constexpr static void (                                                    \
-        *spec_list[float_type_n_][float_type_n_][types::Count])(               \
-        TensorImpl * dst, const TensorImpl *l, const TensorImpl *r) = {        \
-        {{op<float, float, std::int8_t>, op<float, float, std::int16_t>,       \
-          op<float, float, std::int32_t>, op<float, float, std::int64_t>,      \
-          op<float, float, float>, op<float, float, double>},                  \
-         {op<float, double, std::int8_t>, op<float, double, std::int16_t>,     \
-          op<float, double, std::int32_t>, op<float, double, std::int64_t>,    \
-          op<float, double, float>, op<float, double, double>}},               \
-        {{op<double, float, std::int8_t>, op<double, float, std::int16_t>,     \
-          op<double, float, std::int32_t>, op<double, float, std::int64_t>,    \
-          op<double, float, float>, op<double, float, double>},                \
-         {op<double, double, std::int8_t>, op<double, double, std::int16_t>,   \
-          op<double, double, std::int32_t>, op<double, double, std::int64_t>,  \
-          op<double, double, float>, op<double, double, double>}}};            \
-                                                                               \
-  public:                                                                      \
-    static auto dispatch(types dst_t, types l_t, types r_t) {                  \
-      return spec_list[dst_t - float_type_idx_start_]                          \
-                      [l_t - float_type_idx_start_][r_t];                      \
-    }                                                                          \
-  };
+  generate_op_helper_(op, float_types_, float_types_, all_types_)
 
 // cat
 #define generate_unary_offset_op_helper(op)                                    \
-  class op##_helper {                                                          \
-    constexpr static void (*spec_list[types::Count][types::Count])(            \
-        TensorImpl * to, const TensorImpl *from, const size_t offset) = {      \
-        {op<std::int8_t, std::int8_t>, op<std::int8_t, std::int16_t>,          \
-         op<std::int8_t, std::int32_t>, op<std::int8_t, std::int64_t>,         \
-         op<std::int8_t, float>, op<std::int8_t, double>},                     \
-        {op<std::int16_t, std::int8_t>, op<std::int16_t, std::int16_t>,        \
-         op<std::int16_t, std::int32_t>, op<std::int16_t, std::int64_t>,       \
-         op<std::int16_t, float>, op<std::int16_t, double>},                   \
-        {op<std::int32_t, std::int8_t>, op<std::int32_t, std::int16_t>,        \
-         op<std::int32_t, std::int32_t>, op<std::int32_t, std::int64_t>,       \
-         op<std::int32_t, float>, op<std::int32_t, double>},                   \
-        {op<std::int64_t, std::int8_t>, op<std::int64_t, std::int16_t>,        \
-         op<std::int64_t, std::int32_t>, op<std::int64_t, std::int64_t>,       \
-         op<std::int64_t, float>, op<std::int64_t, double>},                   \
-        {op<float, std::int8_t>, op<float, std::int16_t>,                      \
-         op<float, std::int32_t>, op<float, std::int64_t>, op<float, float>,   \
-         op<float, double>},                                                   \
-        {op<double, std::int8_t>, op<double, std::int16_t>,                    \
-         op<double, std::int32_t>, op<double, std::int64_t>,                   \
-         op<double, float>, op<double, double>}};                              \
-                                                                               \
-  public:                                                                      \
-    static auto dispatch(types l_t, types r_t) { return spec_list[l_t][r_t]; } \
-  }
+  generate_op_helper_(op, all_types_, all_types_)
 
 // float, float
 #define generate_ff_op4_helper(op)                                             \
-  class op##_helper {                                                          \
-    constexpr static void (*spec_list[float_type_n_][float_type_n_])(          \
-        TensorImpl * dst, const TensorImpl *i1, const TensorImpl *i2,          \
-        const TensorImpl *i3) = {{op<float, float>, op<float, double>},        \
-                                 {op<double, float>, op<double, double>}};     \
-                                                                               \
-  public:                                                                      \
-    static auto dispatch(types l_t, types r_t) {                               \
-      return spec_list[l_t - float_type_idx_start_]                            \
-                      [r_t - float_type_idx_start_];                           \
-    }                                                                          \
-  }
+  generate_op_helper_(op, float_types_, float_types_)
 
-#define generate_i_op2_helper(op)                                              \
-  class op##_helper {                                                          \
-    constexpr static void (*spec_list[types::Count])(TensorImpl * dst,         \
-                                                     const TensorImpl *i1,     \
-                                                     const TensorImpl *i2) = { \
-        op<std::int8_t>,  op<std::int16_t>, op<std::int32_t>,                  \
-        op<std::int64_t>, op<float>,        op<double>};                       \
-                                                                               \
-  public:                                                                      \
-    static auto dispatch(types t) { return spec_list[t]; }                     \
-  }
+#define generate_i_op2_helper(op) generate_op_helper_(op, all_types_)
+
+// float
+#define generate_f_op_helper(op) generate_op_helper_(op, float_types_)
 
 } // namespace INNC
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "tensor.hpp"
+#include "utils/math.hpp"
+#include <functional>
 #include <memory>
 
 namespace INNC {
@@ -10,20 +12,31 @@ public:
   std::vector<std::shared_ptr<INNC::TensorImpl>>
       input_tfs; // TODO stricter encapsulation
   TensorImpl *this_tf;
-  size_t n_outway;
-  size_t accumulated_n_outway; // TODO partial graph
+  // Incremented by every backward pass. A node takes part in a pass only if
+  // some gradient reached it, i.e. `back_version == global_back_version`.
   static size_t global_back_version;
   size_t back_version;
+  // Topological order of the graph rooted at this node, built by the first
+  // backward from here and reused while `schedule_epoch == graph_epoch`.
+  std::vector<TensorImpl *> schedule;
+  size_t schedule_epoch;
+  // Must be bumped whenever a node leaves an existing graph so that every
+  // cached schedule is rebuilt.
+  static size_t graph_epoch;
 
   Backward(TensorImpl *this_tf,
            const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs);
   TensorImpl &get_out_grad();
-  inline bool is_ready() { return accumulated_n_outway == n_outway; }
+  const std::vector<TensorImpl *> &get_schedule();
   virtual void step_back() = 0;
   virtual ~Backward();
   void try_accumulate_grad(TensorImpl *tf_grad, TensorImpl *tf_w,
                            TensorImpl *tf_o = nullptr);
   void try_accumulate_update(TensorImpl *tf_grad, bool zero_init = true);
+  // tf_grad.grad += tf_o * scale, with `tf_o` broadcast or reduced to the
+  // size of tf_grad.
+  void try_accumulate_scaled(TensorImpl *tf_grad, TensorImpl *tf_o,
+                             double scale);
 };
 
 class AddBack : public Backward {
@@ -68,12 +81,36 @@ public:
   void step_back() override;
 };
 
+// Left in place of a node released by a backward pass without
+// `retain_graph`. Reaching it again throws instead of treating the tensor as
+// a leaf, which would silently cut the gradient.
+class ReleasedBack : public Backward {
+public:
+  using Backward::Backward;
+  void step_back() override;
+};
+
 class CloneBack : public Backward {
 public:
   using Backward::Backward;
   void step_back() override;
 };
 
+// Broadcast dimensions are summed up by the broadcasting accumulation.
+class ExpandBack : public Backward {
+public:
+  using Backward::Backward;
+  void step_back() override;
+};
+
+// For a view laid over the storage of an input whose grad is laid out
+// differently. The grad of the view is kept per element of the storage.
+class AsStridedBack : public Backward {
+public:
+  using Backward::Backward;
+  void step_back() override;
+};
+
 class CatBack : public Backward {
   size_t dim;
 
@@ -83,6 +120,86 @@ public:
           const size_t dim = 0);
   void step_back() override;
 };
+class MaskedFillBack : public Backward {
+  BitMask mask;
+
+public:
+  MaskedFillBack(
+      TensorImpl *this_tf,
+      const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+      const BitMask &mask);
+  void step_back() override;
+};
+
+// Base of the nodes of index-based ops along dimension `dim`. `input_tfs`
+// holds the indexed tensor first and, when present, the index and the source.
+class IndexedBack : public Backward {
+protected:
+  size_t dim;
+
+public:
+  IndexedBack(TensorImpl *this_tf,
+              const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+              size_t dim);
+};
+
+class GatherBack : public IndexedBack {
+public:
+  using IndexedBack::IndexedBack;
+  void step_back() override;
+};
+
+class ScatterBack : public IndexedBack {
+public:
+  using IndexedBack::IndexedBack;
+  void step_back() override;
+};
+
+class ScatterAddBack : public IndexedBack {
+public:
+  using IndexedBack::IndexedBack;
+  void step_back() override;
+};
+
+class IndexSelectBack : public IndexedBack {
+public:
+  using IndexedBack::IndexedBack;
+  void step_back() override;
+};
+
+class IndexAddBack : public IndexedBack {
+public:
+  using IndexedBack::IndexedBack;
+  void step_back() override;
+};
+
+class MaskedSelectBack : public Backward {
+  BitMask mask;
+
+public:
+  MaskedSelectBack(
+      TensorImpl *this_tf,
+      const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+      const BitMask &mask);
+  void step_back() override;
+};
+
+// `seed` and `offset` are the state of the default generator when `fn` first
+// ran, so that random ops in `fn` draw the same numbers when it runs again.
+class CheckpointBack : public Backward {
+  using Fn = std::function<std::shared_ptr<TensorImpl>(
+      const std::vector<std::shared_ptr<TensorImpl>> &)>;
+  Fn fn;
+  std::uint64_t seed, offset;
+
+public:
+  CheckpointBack(
+      TensorImpl *this_tf,
+      const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs, Fn fn,
+      std::uint64_t seed, std::uint64_t offset);
+  void step_back() override;
+};
+
 class KnownGradBack : public Backward {
   std::shared_ptr<INNC::TensorImpl> grad;
 
@@ -93,6 +210,100 @@ public:
   void step_back() override;
 };
 
+// The grads of exp, sqrt, tanh, sigmoid and relu are computed from their
+// outputs, those of log and gelu from their inputs, so nothing is saved.
+class UnaryMathBack : public Backward {
+  unary_fn fn;
+  bool fast;
+
+public:
+  UnaryMathBack(TensorImpl *this_tf,
+                const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+                unary_fn fn, bool fast);
+  void step_back() override;
+};
+
+// `input_tfs` holds the input, the weight and, when present, the bias.
+// `pre_act` keeps the values before the activation if its grad needs them.
+class LinearBack : public Backward {
+  activation act;
+  std::shared_ptr<INNC::TensorImpl> pre_act;
+
+public:
+  LinearBack(TensorImpl *this_tf,
+             const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+             activation act, std::shared_ptr<INNC::TensorImpl> pre_act);
+  void step_back() override;
+};
+
+// The grads of softmax and log-softmax along `dim` are computed from their
+// outputs.
+class SoftmaxBack : public Backward {
+  size_t dim;
+  bool log;
+
+public:
+  SoftmaxBack(TensorImpl *this_tf,
+              const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+              size_t dim, bool log);
+  void step_back() override;
+};
+
+// `input_tfs` holds the logits and the target, `lse` the log-sum-exp of
+// every row of logits.
+class CrossEntropyBack : public Backward {
+  std::shared_ptr<INNC::TensorImpl> lse;
+
+public:
+  CrossEntropyBack(
+      TensorImpl *this_tf,
+      const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+      std::shared_ptr<INNC::TensorImpl> lse);
+  void step_back() override;
+};
+
+// `input_tfs` holds the input and, when present, the weight and the bias.
+// `mean` and `rstd` are those of every normalized slice.
+class LayerNormBack : public Backward {
+  std::shared_ptr<INNC::TensorImpl> mean, rstd;
+
+public:
+  LayerNormBack(TensorImpl *this_tf,
+                const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+                std::shared_ptr<INNC::TensorImpl> mean,
+                std::shared_ptr<INNC::TensorImpl> rstd);
+  void step_back() override;
+};
+
+// `input_tfs` holds the input and, when present, the weight and the bias.
+// `mean` and `var` are the statistics used, which came from the input when
+// `training`.
+class BatchNormBack : public Backward {
+  std::shared_ptr<INNC::TensorImpl> mean, var;
+  double eps;
+  bool training;
+
+public:
+  BatchNormBack(TensorImpl *this_tf,
+                const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+                std::shared_ptr<INNC::TensorImpl> mean,
+                std::shared_ptr<INNC::TensorImpl> var, double eps,
+                bool training);
+  void step_back() override;
+};
+
+// The mask of dropout is drawn again from the `offset`-th counters of `seed`.
+class DropoutBack : public Backward {
+  double p;
+  std::uint64_t seed, offset;
+
+public:
+  DropoutBack(TensorImpl *this_tf,
+              const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+              double p, std::uint64_t seed, std::uint64_t offset);
+  void step_back() override;
+};
+
 class SingletonBack : public Backward {
   const SizeVec &sv;
 
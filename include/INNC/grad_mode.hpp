@@ -0,0 +1,52 @@
+#pragma once
+
+namespace INNC {
+inline thread_local bool grad_enabled_ = true;
+inline thread_local bool inference_mode_ = false;
+
+// Whether ops on the calling thread record autograd graphs.
+inline bool is_grad_enabled() noexcept { return grad_enabled_; }
+inline bool is_inference_mode() noexcept { return inference_mode_; }
+
+// Sets whether ops on the calling thread record autograd graphs for the
+// lifetime of the guard.
+class AutoGradMode {
+  bool prev;
+
+public:
+  explicit AutoGradMode(bool enabled) noexcept : prev(grad_enabled_) {
+    grad_enabled_ = enabled && !inference_mode_;
+  }
+  AutoGradMode(const AutoGradMode &) = delete;
+  AutoGradMode &operator=(const AutoGradMode &) = delete;
+  ~AutoGradMode() { grad_enabled_ = prev; }
+};
+
+// Results of ops do not require grad and no `Backward` node is built, so
+// in-place ops are allowed on tensors that require grad.
+//
+// Example:
+// \code{.cpp}
+// {
+//   INNC::NoGrad guard;
+//   w += step; // does not enter the graph of w
+// }
+// \endcode
+class NoGrad : public AutoGradMode {
+public:
+  NoGrad() noexcept : AutoGradMode(false) {}
+};
+
+// A stricter `NoGrad` for pure inference. Grad mode cannot be turned back on
+// and `backward` is refused inside it.
+class InferenceMode : public AutoGradMode {
+  bool prev_inference;
+
+public:
+  InferenceMode() noexcept
+      : AutoGradMode(false), prev_inference(inference_mode_) {
+    inference_mode_ = true;
+  }
+  ~InferenceMode() { inference_mode_ = prev_inference; }
+};
+} // namespace INNC
@@ -0,0 +1,135 @@
+#pragma once
+#include "INNC/exceptions.hpp"
+#include <concepts>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class UntypedStorage;
+
+namespace INNC {
+class TensorImpl;
+class BitMask;
+
+// A recorded sequence of kernel launches over fixed buffers.
+//
+// While a graph is captured on the calling thread, every kernel launched
+// through a dispatcher still runs eagerly and is also appended to the graph,
+// together with the storage zeroing done by factories and autograd. `replay`
+// re-runs exactly those launches on the same tensors, skipping type dispatch,
+// allocation and the construction of `Backward` nodes. New data is fed by
+// writing into the tensors used during capture (e.g. with `Tensor::copy_`),
+// and results are read from the captured outputs and grads. The graph keeps
+// every tensor it touches alive.
+//
+// Ops which hand data back to the host (e.g. `all`, `to_mask`) or do not go
+// through a dispatched kernel (e.g. `randn`, `quantize`) refuse to run while
+// capturing.
+//
+// Example:
+// \code{.cpp}
+// INNC::Graph g;
+// g.capture_begin();
+// auto loss = (x * w).sum();
+// loss.backward();
+// g.capture_end();
+// x.copy_(next_batch);
+// g.replay(); // loss and w.grad() now hold the results for next_batch
+// \endcode
+class Graph {
+public:
+  // The outcome of `plan_memory`.
+  struct MemoryPlan {
+    size_t storages = 0;    // number of storages moved into the arena
+    size_t bytes = 0;       // their total size
+    size_t arena_bytes = 0; // size of the arena holding all of them
+  };
+
+  Graph() = default;
+  Graph(const Graph &) = delete;
+  Graph &operator=(const Graph &) = delete;
+
+  void capture_begin();
+  void capture_end();
+  void replay() const;
+  // Drops all recorded launches and the tensors they keep alive.
+  void reset() noexcept;
+  size_t size() const noexcept { return launches.size(); }
+
+  // Moves the storages which only live inside the graph into one arena,
+  // letting storages with disjoint live ranges share bytes. A storage only
+  // lives inside the graph if no tensor outside of it can reach the storage
+  // and its first use in the recorded launches writes it. Everything else,
+  // e.g. inputs, leaf grads and outputs held by the caller, is left alone.
+  MemoryPlan plan_memory();
+
+  // The graph being captured on the calling thread, if any.
+  static Graph *capturing() noexcept { return current_; }
+
+  // Kernels read from `const TensorImpl *` arguments and write to the
+  // others.
+  template <typename... Args>
+  void record(void (*kernel)(Args...), Args... args) {
+    Launch launch;
+    launch.run = [kernel, ... held = hold_(args, launch.accesses)]() {
+      kernel(held...);
+    };
+    launches.push_back(std::move(launch));
+  }
+  void record_zero(const std::shared_ptr<UntypedStorage> &storage);
+
+private:
+  struct Access {
+    UntypedStorage *storage;
+    bool write;
+  };
+  struct Launch {
+    std::function<void()> run;
+    std::vector<Access> accesses;
+  };
+
+  inline static thread_local Graph *current_ = nullptr;
+  std::vector<Launch> launches;
+  std::unordered_map<const TensorImpl *, std::shared_ptr<const TensorImpl>>
+      tensors;
+  std::unordered_map<const UntypedStorage *, std::shared_ptr<UntypedStorage>>
+      storages;
+  std::vector<std::shared_ptr<const void>> keep_alive;
+
+  TensorImpl *hold_(TensorImpl *t, std::vector<Access> &accesses);
+  const TensorImpl *hold_(const TensorImpl *t, std::vector<Access> &accesses);
+  const BitMask *hold_(const BitMask *m, std::vector<Access> &);
+  BitMask *hold_(BitMask *m, std::vector<Access> &);
+  template <typename T>
+    requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+  T hold_(T v, std::vector<Access> &) noexcept {
+    return v;
+  }
+  std::unordered_set<const UntypedStorage *> internal_storages() const;
+};
+
+// Captures into `g` for the lifetime of the guard.
+class GraphCapture {
+  Graph &g;
+
+public:
+  explicit GraphCapture(Graph &g) : g(g) { g.capture_begin(); }
+  GraphCapture(const GraphCapture &) = delete;
+  GraphCapture &operator=(const GraphCapture &) = delete;
+  ~GraphCapture() {
+    if (Graph::capturing() == &g)
+      g.capture_end();
+  }
+};
+
+// Zeroes `storage` and records it into the graph being captured.
+void zero_storage(const std::shared_ptr<UntypedStorage> &storage);
+
+inline void expect_not_capturing(const char *op) {
+  run_expect(Graph::capturing() == nullptr, op,
+             " cannot be captured into a Graph.");
+}
+} // namespace INNC
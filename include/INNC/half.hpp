@@ -0,0 +1,107 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+namespace INNC {
+
+// Half precision types are storage-only. Every arithmetic expression involving
+// them is evaluated in float through the implicit conversion below, and the
+// result is rounded back (to nearest, ties to even) when it is stored.
+
+constexpr std::uint16_t float_to_half_bits(float f) noexcept {
+  std::uint32_t x = std::bit_cast<std::uint32_t>(f);
+  std::uint16_t sign = (x >> 16) & 0x8000;
+  std::uint32_t abs = x & 0x7fffffff;
+  if (abs >= 0x7f800000) // inf or nan
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  if (abs >= 0x477ff000) // rounds to a value beyond 65504
+    return sign | 0x7c00;
+  if (abs < 0x38800000) { // subnormal in half precision
+    if (abs < 0x33000000)
+      return sign;
+    std::uint32_t mant = (abs & 0x7fffff) | 0x800000;
+    std::uint32_t shift = 126 - (abs >> 23);
+    std::uint32_t r = mant >> shift;
+    std::uint32_t rem = mant & ((1u << shift) - 1);
+    std::uint32_t mid = 1u << (shift - 1);
+    if (rem > mid || (rem == mid && (r & 1)))
+      ++r;
+    return sign | r;
+  }
+  std::uint32_t r = abs - 0x38000000; // rebias the exponent from 127 to 15
+  std::uint32_t rem = r & 0x1fff;
+  r >>= 13;
+  if (rem > 0x1000 || (rem == 0x1000 && (r & 1)))
+    ++r;
+  return sign | r;
+}
+
+constexpr float half_bits_to_float(std::uint16_t h) noexcept {
+  std::uint32_t sign = std::uint32_t(h & 0x8000) << 16;
+  std::uint32_t exp = (h >> 10) & 0x1f;
+  std::uint32_t mant = h & 0x3ff;
+  if (exp == 0) {
+    float v = mant * 5.9604644775390625e-8f; // mant * 2^-24
+    return sign ? -v : v;
+  }
+  if (exp == 0x1f)
+    return std::bit_cast<float>(sign | 0x7f800000 | (mant << 13));
+  return std::bit_cast<float>(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+constexpr std::uint16_t float_to_bfloat16_bits(float f) noexcept {
+  std::uint32_t x = std::bit_cast<std::uint32_t>(f);
+  if ((x & 0x7fffffff) > 0x7f800000) // keep nan quiet after truncation
+    return (x >> 16) | 0x40;
+  x += 0x7fff + ((x >> 16) & 1);
+  return x >> 16;
+}
+
+constexpr float bfloat16_bits_to_float(std::uint16_t b) noexcept {
+  return std::bit_cast<float>(std::uint32_t(b) << 16);
+}
+
+#define DEFINE_REDUCED_FLOAT(name, to_bits, from_bits)                         \
+  class name {                                                                 \
+    std::uint16_t bits_;                                                       \
+                                                                               \
+  public:                                                                      \
+    constexpr name() noexcept : bits_(0) {}                                    \
+    template <typename T>                                                      \
+      requires(!std::is_same_v<T, name> && std::is_convertible_v<T, float>)    \
+    constexpr name(T v) noexcept : bits_(to_bits(static_cast<float>(v))) {}    \
+    constexpr operator float() const noexcept { return from_bits(bits_); }     \
+    constexpr std::uint16_t bits() const noexcept { return bits_; }            \
+    static constexpr name from_raw(std::uint16_t b) noexcept {                 \
+      name ret;                                                                \
+      ret.bits_ = b;                                                           \
+      return ret;                                                              \
+    }                                                                          \
+    constexpr name &operator+=(float v) noexcept {                             \
+      return *this = float(*this) + v;                                         \
+    }                                                                          \
+    constexpr name &operator-=(float v) noexcept {                             \
+      return *this = float(*this) - v;                                         \
+    }                                                                          \
+    constexpr name &operator*=(float v) noexcept {                             \
+      return *this = float(*this) * v;                                         \
+    }                                                                          \
+    constexpr name &operator/=(float v) noexcept {                             \
+      return *this = float(*this) / v;                                         \
+    }                                                                          \
+  };                                                                           \
+  static_assert(sizeof(name) == 2)
+
+// IEEE 754 binary16
+DEFINE_REDUCED_FLOAT(half, float_to_half_bits, half_bits_to_float);
+// the upper 16 bits of an IEEE 754 binary32
+DEFINE_REDUCED_FLOAT(bfloat16, float_to_bfloat16_bits, bfloat16_bits_to_float);
+
+#undef DEFINE_REDUCED_FLOAT
+
+template <typename T>
+concept ReducedFloat = std::is_same_v<T, half> || std::is_same_v<T, bfloat16>;
+
+} // namespace INNC
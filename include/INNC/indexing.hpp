@@ -0,0 +1,49 @@
+#pragma once
+#include <concepts>
+#include <limits>
+
+namespace INNC {
+namespace indexing {
+// Marks an omitted bound of `Slice`, like Python's `None`.
+inline constexpr long long none = std::numeric_limits<long long>::min();
+
+// start:stop:step of a single dimension. Omitted bounds follow Python.
+struct Slice {
+  long long start = none;
+  long long stop = none;
+  long long step = none;
+};
+
+// Stands for as many full slices as needed to cover the remaining dimensions.
+struct Ellipsis {};
+
+// Inserts a new dimension of size 1.
+struct NewAxis {};
+} // namespace indexing
+
+// One entry of a typed index, e.g. `t.index({1, Slice{0, none, 2},
+// Ellipsis{}, NewAxis{}})`. All entries are literal types, so whole indices
+// can be built at compile time and reused.
+class TensorIndex {
+public:
+  enum class kinds { integer, slice, ellipsis, new_axis };
+
+  constexpr TensorIndex(std::integral auto i) noexcept
+      : kind_(kinds::integer), integer_(i) {}
+  constexpr TensorIndex(indexing::Slice s) noexcept
+      : kind_(kinds::slice), slice_(s) {}
+  constexpr TensorIndex(indexing::Ellipsis) noexcept
+      : kind_(kinds::ellipsis) {}
+  constexpr TensorIndex(indexing::NewAxis) noexcept
+      : kind_(kinds::new_axis) {}
+
+  constexpr kinds kind() const noexcept { return kind_; }
+  constexpr long long integer() const noexcept { return integer_; }
+  constexpr const indexing::Slice &slice() const noexcept { return slice_; }
+
+private:
+  kinds kind_;
+  long long integer_ = 0;
+  indexing::Slice slice_{};
+};
+} // namespace INNC
@@ -43,9 +43,16 @@ public:
   StridedLayout(const StridedLayout &sv);
   StridedLayout(StridedLayout &&sv);
   size_t cnt_from_index(const SizeVec &index) const;
+  // `index` lives in a broadcast range: extra leading dimensions are ignored
+  // and dimensions of size 1 are read at 0, like a stride of 0.
+  size_t cnt_from_aug_index(const SizeVec &index) const;
   std::string to_string_from(const UntypedStorage &data_,
                              types dtype) const override;
   bool is_contiguous() override;
+  // Whether distinct indices always reach distinct elements. Dimensions are
+  // checked by increasing stride, each having to step over the span of the
+  // previous ones, so a few interleaved views are reported as overlapping.
+  bool is_non_overlapping() const;
   std::shared_ptr<TensorImpl> contiguous_from(TensorImpl &t) override;
 };
 } // namespace INNC
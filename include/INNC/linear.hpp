@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+namespace INNC {
+
+// Activations fused into the epilogue of `TensorImpl::linear`.
+enum class activation { none, relu, gelu };
+
+namespace native {
+// c[m, n] = act(a[m, k] * b[k, n] + bias) where a(i, p) = a[i * a_rs + p *
+// a_cs], b(p, j) = b[p * b_rs + j * b_cs] and c is row-major and contiguous.
+// `bias` holds n entries or is null. Unless null, `pre_act` receives the
+// values before the activation and `a_sums` the m row sums of a. Blocks of
+// rows run in parallel.
+void gemm_epilogue(const float *a, size_t a_rs, size_t a_cs, const float *b,
+                   size_t b_rs, size_t b_cs, float *c, size_t m, size_t n,
+                   size_t k, const float *bias, activation act,
+                   float *pre_act, float *a_sums);
+void gemm_epilogue(const double *a, size_t a_rs, size_t a_cs, const double *b,
+                   size_t b_rs, size_t b_cs, double *c, size_t m, size_t n,
+                   size_t k, const double *bias, activation act,
+                   double *pre_act, double *a_sums);
+
+// dz = dy * act'(x) over n elements, where x holds the inputs of gelu but the
+// outputs of relu.
+void activation_backward(const float *dy, const float *x, float *dz, size_t n,
+                         activation act);
+void activation_backward(const double *dy, const double *x, double *dz,
+                         size_t n, activation act);
+} // namespace native
+} // namespace INNC
@@ -0,0 +1,26 @@
+#pragma once
+#include "INNC/types.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace INNC {
+
+enum class cmp { lt, gt, le, ge, eq, ne };
+
+// A bit-packed boolean tensor. The i-th element in row-major order is bit
+// `i % 64` of `words[i / 64]`. Bits beyond `numel()` are always zero.
+class BitMask {
+public:
+  SizeVec sizes;
+  std::vector<std::uint64_t> words;
+  BitMask();
+  BitMask(const SizeVec &sizes);
+  size_t numel() const noexcept;
+  bool test(size_t i) const noexcept { return (words[i >> 6] >> (i & 63)) & 1; }
+  void set(size_t i) noexcept { words[i >> 6] |= std::uint64_t(1) << (i & 63); }
+  bool all() const noexcept;
+  bool any() const noexcept;
+  size_t count() const noexcept;
+};
+
+} // namespace INNC
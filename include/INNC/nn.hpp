@@ -0,0 +1,78 @@
+#pragma once
+#include "INNC/linear.hpp"
+#include "INNC/tensor.hpp"
+#include <cstddef>
+#include <vector>
+
+namespace INNC {
+namespace nn {
+// act(input * weight^T + bias) over the last dimension of the input, see
+// `Tensor::linear`. The [out, in] weight starts from a normal distribution
+// scaled by 1 / sqrt(in), and the bias from zero.
+class Linear {
+public:
+  Linear(size_t in_features, size_t out_features, bool bias = true,
+         activation act = activation::none, types dtype = f32);
+  Tensor forward(const Tensor &input) const;
+  Tensor operator()(const Tensor &input) const { return forward(input); }
+  // The weight followed by the bias, e.g. for an optimizer.
+  std::vector<Tensor> parameters() const;
+  Tensor weight, bias; // `bias` stays empty without a bias
+  activation act;
+
+private:
+  bool with_bias;
+};
+
+// Normalizes the trailing dimensions `normalized_shape` of the input, see
+// `Tensor::layer_norm`. The weight starts from one and the bias from zero.
+class LayerNorm {
+public:
+  LayerNorm(const SizeVec &normalized_shape, double eps = 1e-5,
+            bool affine = true, types dtype = f32);
+  Tensor forward(const Tensor &input) const;
+  Tensor operator()(const Tensor &input) const { return forward(input); }
+  // The weight followed by the bias, none without an affine transform.
+  std::vector<Tensor> parameters() const;
+  Tensor weight, bias; // both stay empty without an affine transform
+  SizeVec normalized_shape;
+  double eps;
+
+private:
+  bool affine;
+};
+
+// Normalizes the channels of an input of [N, C, ...], see
+// `Tensor::batch_norm`. The running statistics, from zero and one, are
+// updated by every forward pass in training mode and used otherwise.
+class BatchNorm {
+public:
+  BatchNorm(size_t num_features, double eps = 1e-5, double momentum = .1,
+            bool affine = true, types dtype = f32);
+  Tensor forward(const Tensor &input) const;
+  Tensor operator()(const Tensor &input) const { return forward(input); }
+  // The weight followed by the bias, none without an affine transform.
+  std::vector<Tensor> parameters() const;
+  void train(bool mode = true) noexcept { training = mode; }
+  Tensor weight, bias; // both stay empty without an affine transform
+  Tensor running_mean, running_var;
+  double eps, momentum;
+  bool training = true;
+
+private:
+  bool affine;
+};
+
+// Zeroes elements with probability `p` in training mode, see
+// `Tensor::dropout`.
+class Dropout {
+public:
+  explicit Dropout(double p = .5) noexcept : p(p) {}
+  Tensor forward(const Tensor &input) const;
+  Tensor operator()(const Tensor &input) const { return forward(input); }
+  void train(bool mode = true) noexcept { training = mode; }
+  double p;
+  bool training = true;
+};
+} // namespace nn
+} // namespace INNC
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+
+namespace INNC {
+namespace native {
+// Layer normalization of m rows of n contiguous elements. One Welford pass
+// gives mean[i] and rstd[i] = 1 / sqrt(var + eps) of the i-th row, and a
+// second writes y = (x - mean) * rstd * w + b, where w and b hold n
+// elements or are both null. Rows run in parallel.
+void layer_norm(const float *x, const float *w, const float *b, float *y,
+                float *mean, float *rstd, size_t m, size_t n, double eps);
+void layer_norm(const double *x, const double *w, const double *b, double *y,
+                double *mean, double *rstd, size_t m, size_t n, double eps);
+
+// The grads of `layer_norm` from its saved `mean` and `rstd`: dx unless null,
+// and dw and db summed over the rows unless both null.
+void layer_norm_backward(const float *dy, const float *x, const float *mean,
+                         const float *rstd, const float *w, float *dx,
+                         float *dw, float *db, size_t m, size_t n);
+void layer_norm_backward(const double *dy, const double *x,
+                         const double *mean, const double *rstd,
+                         const double *w, double *dx, double *dw, double *db,
+                         size_t m, size_t n);
+
+// Batch normalization of the contiguous x[outer, c, inner] per channel. When
+// `stats`, one Welford pass over every channel writes mean[c] and the biased
+// var[c], which are read otherwise. Then y = (x - mean) / sqrt(var + eps) *
+// w + b, where w and b hold c elements or are both null. Channels run in
+// parallel.
+void batch_norm(const float *x, const float *w, const float *b, float *y,
+                float *mean, float *var, size_t outer, size_t c, size_t inner,
+                double eps, bool stats);
+void batch_norm(const double *x, const double *w, const double *b, double *y,
+                double *mean, double *var, size_t outer, size_t c,
+                size_t inner, double eps, bool stats);
+
+// The grads of `batch_norm`: dx unless null, and dw and db unless both null.
+// `stats` tells whether mean and var were computed from x, which then depend
+// on it.
+void batch_norm_backward(const float *dy, const float *x, const float *mean,
+                         const float *var, const float *w, float *dx,
+                         float *dw, float *db, size_t outer, size_t c,
+                         size_t inner, double eps, bool stats);
+void batch_norm_backward(const double *dy, const double *x,
+                         const double *mean, const double *var,
+                         const double *w, double *dx, double *dw, double *db,
+                         size_t outer, size_t c, size_t inner, double eps,
+                         bool stats);
+} // namespace native
+} // namespace INNC
@@ -2,15 +2,26 @@
 #include "INNC/dispatcher.hpp"
 #include "INNC/tensorImpl.hpp"
 #include "INNC/types.hpp"
+#include "INNC/mask.hpp"
+#include "INNC/utils/math.hpp"
+#include "INNC/utils/parallel.hpp"
 #include "INNC/utils/utils.hpp"
+#include <atomic>
+#include <functional>
 #include <iostream>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 namespace INNC {
 namespace native {
 
 template <typename L, typename R>
 void tensor_add(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
-  auto dst_ptr = reinterpret_cast<L *>(dst->data_->get_blob());
+  auto dst_ptr =
+      reinterpret_cast<innc_common_t<L, R> *>(dst->data_->get_blob());
   auto l_ptr = reinterpret_cast<L *>(l->data_->get_blob());
   auto r_ptr = reinterpret_cast<R *>(r->data_->get_blob());
   for_each_sizevec(broadcast_range(l->size(), r->size()),
@@ -37,13 +48,14 @@ void tensor_sub(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
 
 template <typename L, typename R>
 void tensor_mul(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
-  auto dst_ptr = reinterpret_cast<L *>(dst->data_->get_blob());
+  using T = innc_common_t<L, R>;
+  auto dst_ptr = reinterpret_cast<T *>(dst->data_->get_blob());
   auto l_ptr = reinterpret_cast<L *>(l->data_->get_blob());
   auto r_ptr = reinterpret_cast<R *>(r->data_->get_blob());
   for_each_sizevec(dst->view->sizes, [=](const SizeVec &sv) {
     *(dst_ptr + dst->cnt_from_aug_index(sv)) =
-        *(l_ptr + l->cnt_from_aug_index(sv)) *
-        *(r_ptr + r->cnt_from_aug_index(sv));
+        static_cast<T>(*(l_ptr + l->cnt_from_aug_index(sv)) *
+                       *(r_ptr + r->cnt_from_aug_index(sv)));
   });
 }
 
@@ -182,6 +194,152 @@ void tensor_mul_acc_f(TensorImpl *dst, const TensorImpl *l,
   });
 }
 
+// Elements summed by one thread at least in grad reductions.
+constexpr size_t reduce_grain_ = 1 << 15;
+
+// The grain of a loop accumulating into `to`. An overlapping `to` repeats
+// elements, which threads would race on, so it is walked by one thread.
+inline size_t acc_grain_(const TensorImpl *to, size_t grain) {
+  auto to_s = static_cast<StridedLayout *>(to->view.get());
+  return to_s->is_non_overlapping() ? grain
+                                    : std::numeric_limits<size_t>::max();
+}
+
+// to += from * scale, summed over the dimensions along which `to` is
+// broadcast to the size of `from`. `from` is walked row by row along its
+// last dimension. Rows landing on distinct rows of `to` are split among
+// threads directly; otherwise each thread sums into a dense buffer of `to`'s
+// elements, and the buffers are added up in a fixed order.
+template <typename ToType, typename FromType>
+void tensor_sum_to(TensorImpl *to, const TensorImpl *from, double scale) {
+  auto to_s = static_cast<StridedLayout *>(to->view.get());
+  auto from_s = static_cast<StridedLayout *>(from->view.get());
+  const auto &range = from_s->sizes;
+  size_t n = from_s->numel();
+  if (n == 0)
+    return;
+  ToType *to_ptr = reinterpret_cast<ToType *>(to->data_->get_blob());
+  FromType *from_ptr = reinterpret_cast<FromType *>(from->data_->get_blob());
+  size_t k = range.size();
+  if (k == 0) {
+    to_ptr[to_s->offset] += from_ptr[from_s->offset] * scale;
+    return;
+  }
+  // Strides of `to` aligned to `range`, into its storage and into a dense
+  // row-major buffer of its elements. Both are 0 along reduced dimensions.
+  SignedVec at, dense;
+  at.resize(k, 0);
+  dense.resize(k, 0);
+  size_t lead = k - to_s->dim(), m = 1;
+  bool disjoint = true;
+  for (size_t d = k; d-- > 0;) {
+    if (range[d] == 1)
+      continue;
+    if (d >= lead && to_s->sizes[d - lead] == range[d]) {
+      at[d] = to_s->strides[d - lead];
+      dense[d] = m;
+      m *= range[d];
+    } else if (d + 1 < k)
+      disjoint = false;
+  }
+  size_t inner = range[k - 1], rows = n / inner;
+  long long from_inner = from_s->strides[k - 1];
+  SizeVec outer = range;
+  outer.pop_back();
+  auto reduce_rows = [&](size_t begin, size_t end, ToType *dst,
+                         const SignedVec &strides) {
+    long long dst_inner = strides[k - 1];
+    auto sv = unravel_index(begin, outer);
+    for (size_t r = begin; r < end; ++r, next_index(sv, outer)) {
+      long long src = from_s->offset, pos = 0;
+      for (size_t d = 0; d + 1 < k; ++d) {
+        src += from_s->strides[d] * (long long)sv[d];
+        pos += strides[d] * (long long)sv[d];
+      }
+      const FromType *src_row = from_ptr + src;
+      ToType *dst_row = dst + pos;
+      if (dst_inner == 0) {
+        ToType acc = 0;
+        for (size_t j = 0; j < inner; ++j)
+          acc += src_row[j * from_inner];
+        *dst_row += acc * scale;
+      } else {
+        for (size_t j = 0; j < inner; ++j)
+          dst_row[j * dst_inner] += src_row[j * from_inner] * scale;
+      }
+    }
+  };
+  ToType *to_base = to_ptr + to_s->offset;
+  // Rows of an overlapping `to` share elements even along dimensions that
+  // are not reduced, which threads would race on.
+  if (!to_s->is_non_overlapping()) {
+    reduce_rows(0, rows, to_base, at);
+    return;
+  }
+  if (disjoint) {
+    parallel_for(rows, std::max<size_t>(1, reduce_grain_ / inner),
+                 [&](size_t begin, size_t end, size_t) {
+                   reduce_rows(begin, end, to_base, at);
+                 });
+    return;
+  }
+  // Each buffer takes as many elements as it reduces at least.
+  size_t grain = std::max<size_t>(1, std::max(reduce_grain_, m) / inner);
+  size_t chunks = parallel_chunks(rows, grain);
+  if (chunks == 1) {
+    reduce_rows(0, rows, to_base, at);
+    return;
+  }
+  std::vector<std::unique_ptr<ToType[]>> partial(chunks);
+  for (auto &p : partial)
+    p.reset(new ToType[m]());
+  parallel_for(rows, grain, [&](size_t begin, size_t end, size_t c) {
+    reduce_rows(begin, end, partial[c].get(), dense);
+  });
+  parallel_for_each_sizevec(
+      to_s->sizes, reduce_grain_, [&](const SizeVec &sv, size_t i, size_t) {
+        ToType acc = 0;
+        for (const auto &part : partial)
+          acc += part[i];
+        to_ptr[to->cnt_from_index(sv)] += acc;
+      });
+}
+
+// to += from * scale, with `from` broadcast to the size of `to`. Fuses the
+// grads of reductions without materializing the constant tensor they
+// multiply by.
+template <typename ToType, typename FromType>
+void tensor_scale_acc(TensorImpl *to, const TensorImpl *from, double scale) {
+  auto to_s = static_cast<StridedLayout *>(to->view.get());
+  auto from_s = static_cast<StridedLayout *>(from->view.get());
+  ToType *to_ptr = reinterpret_cast<ToType *>(to->data_->get_blob());
+  FromType *from_ptr = reinterpret_cast<FromType *>(from->data_->get_blob());
+  size_t grain = acc_grain_(to, reduce_grain_);
+  if (from_s->numel() != 1) {
+    parallel_for_each_sizevec(to_s->sizes, grain,
+                              [=](const SizeVec &sv, size_t, size_t) {
+                                to_ptr[to->cnt_from_index(sv)] +=
+                                    from_ptr[from->cnt_from_aug_index(sv)] *
+                                    scale;
+                              });
+    return;
+  }
+  ToType v = from_ptr[from_s->offset] * scale;
+  if (!to->is_contiguous()) {
+    parallel_for_each_sizevec(to_s->sizes, grain,
+                              [=](const SizeVec &sv, size_t, size_t) {
+                                to_ptr[to->cnt_from_index(sv)] += v;
+                              });
+    return;
+  }
+  ToType *p = to_ptr + to_s->offset;
+  parallel_for(to_s->numel(), reduce_grain_,
+               [=](size_t begin, size_t end, size_t) {
+                 for (size_t i = begin; i < end; ++i)
+                   p[i] += v;
+               });
+}
+
 template <typename ToType, typename FromType>
 void tensor_clone(TensorImpl *to, const TensorImpl *from) {
   if (to->dlayout != layouts::strided)
@@ -199,6 +357,149 @@ void tensor_clone(TensorImpl *to, const TensorImpl *from) {
   });
 }
 
+// Elements of elementwise math done by one thread at least, and by one
+// vectorized block.
+constexpr size_t math_grain_ = 1 << 14, math_block_ = 64;
+
+// Calls `k(f)` with a functor `f(x)` computing `fn` in `A`, using the
+// approximations of `math` if `fast` and `A` is float.
+template <typename A, typename K>
+void visit_unary_fn_(unary_fn fn, bool fast, K &&k) {
+  fast = fast && std::is_same_v<A, float>;
+  switch (fn) {
+  case unary_fn::exp:
+    if (fast)
+      return k([](A x) { return A(math::fast_exp(x)); });
+    return k([](A x) { return std::exp(x); });
+  case unary_fn::log:
+    if (fast)
+      return k([](A x) { return A(math::fast_log(x)); });
+    return k([](A x) { return std::log(x); });
+  case unary_fn::sqrt:
+    return k([](A x) { return std::sqrt(x); });
+  case unary_fn::tanh:
+    if (fast)
+      return k([](A x) { return A(math::fast_tanh(x)); });
+    return k([](A x) { return std::tanh(x); });
+  case unary_fn::sigmoid:
+    if (fast)
+      return k([](A x) { return A(math::fast_sigmoid(x)); });
+    return k([](A x) { return 1 / (1 + std::exp(-x)); });
+  case unary_fn::gelu:
+    if (fast)
+      return k([](A x) { return A(x * math::fast_normal_cdf(x)); });
+    return k([](A x) { return x * math::normal_cdf(x); });
+  default:
+    return k([](A x) { return x > 0 ? x : A(0); });
+  }
+}
+
+// Like `visit_unary_fn_` for `f(g, s)`, the grad `g` of the output times the
+// derivative of `fn`. `s` is the input of log and gelu, and the output of the
+// others.
+template <typename A, typename K>
+void visit_unary_fn_grad_(unary_fn fn, bool fast, K &&k) {
+  fast = fast && std::is_same_v<A, float>;
+  switch (fn) {
+  case unary_fn::exp:
+    return k([](A g, A y) { return g * y; });
+  case unary_fn::log:
+    return k([](A g, A x) { return g / x; });
+  case unary_fn::sqrt:
+    return k([](A g, A y) { return g / (2 * y); });
+  case unary_fn::tanh:
+    return k([](A g, A y) { return g * (1 - y * y); });
+  case unary_fn::sigmoid:
+    return k([](A g, A y) { return g * y * (1 - y); });
+  case unary_fn::gelu:
+    if (fast)
+      return k([](A g, A x) {
+        return g * A(math::fast_normal_cdf(x) + x * math::fast_normal_pdf(x));
+      });
+    return k([](A g, A x) {
+      return g * (math::normal_cdf(x) + x * math::normal_pdf(x));
+    });
+  default:
+    return k([](A g, A y) { return y > 0 ? g : A(0); });
+  }
+}
+
+// to = fn(from) for a contiguous `to`. Contiguous inputs are converted in
+// blocks of `math_block_` elements, so that the functor runs over a loop of
+// fixed length which vectorizes.
+template <typename T>
+void tensor_unary_math(TensorImpl *to, const TensorImpl *from, unary_fn fn,
+                       bool fast) {
+  using A = linear_compute_t<T>;
+  T *to_ptr = data_of<T>(*to);
+  visit_unary_fn_<A>(fn, fast, [&](auto f) {
+    if (!from->is_contiguous()) {
+      const T *from_ptr = reinterpret_cast<T *>(from->data_->get_blob());
+      parallel_for_each_sizevec(to->view->sizes, math_grain_,
+                                [&](const SizeVec &sv, size_t i, size_t) {
+                                  to_ptr[i] =
+                                      f(A(from_ptr[from->cnt_from_index(sv)]));
+                                });
+      return;
+    }
+    const T *from_ptr = data_of<T>(*from);
+    parallel_for(to->numel(), math_grain_,
+                 [&](size_t begin, size_t end, size_t) {
+                   A buf[math_block_];
+                   for (size_t i = begin; i < end; i += math_block_) {
+                     size_t len = std::min(math_block_, end - i);
+                     for (size_t j = 0; j < math_block_; ++j)
+                       buf[j] = j < len ? A(from_ptr[i + j]) : A(1);
+                     for (size_t j = 0; j < math_block_; ++j)
+                       buf[j] = f(buf[j]);
+                     for (size_t j = 0; j < len; ++j)
+                       to_ptr[i + j] = buf[j];
+                   }
+                 });
+  });
+}
+
+// grad += out_grad * fn'(saved), see `visit_unary_fn_grad_`.
+template <typename T>
+void tensor_unary_math_back(TensorImpl *grad, const TensorImpl *out_grad,
+                            const TensorImpl *saved, unary_fn fn, bool fast) {
+  using A = linear_compute_t<T>;
+  T *grad_ptr = reinterpret_cast<T *>(grad->data_->get_blob());
+  const T *g_ptr = reinterpret_cast<T *>(out_grad->data_->get_blob());
+  const T *s_ptr = reinterpret_cast<T *>(saved->data_->get_blob());
+  visit_unary_fn_grad_<A>(fn, fast, [&](auto f) {
+    if (!grad->is_contiguous() || !out_grad->is_contiguous() ||
+        !saved->is_contiguous()) {
+      parallel_for_each_sizevec(
+          grad->view->sizes, acc_grain_(grad, math_grain_),
+          [&](const SizeVec &sv, size_t, size_t) {
+            T &dst = grad_ptr[grad->cnt_from_index(sv)];
+            dst = A(dst) + f(A(g_ptr[out_grad->cnt_from_index(sv)]),
+                             A(s_ptr[saved->cnt_from_index(sv)]));
+          });
+      return;
+    }
+    grad_ptr = data_of<T>(*grad);
+    g_ptr = data_of<T>(*out_grad);
+    s_ptr = data_of<T>(*saved);
+    parallel_for(grad->numel(), math_grain_,
+                 [&](size_t begin, size_t end, size_t) {
+                   A g[math_block_], s[math_block_];
+                   for (size_t i = begin; i < end; i += math_block_) {
+                     size_t len = std::min(math_block_, end - i);
+                     for (size_t j = 0; j < math_block_; ++j) {
+                       g[j] = j < len ? A(g_ptr[i + j]) : A(0);
+                       s[j] = j < len ? A(s_ptr[i + j]) : A(1);
+                     }
+                     for (size_t j = 0; j < math_block_; ++j)
+                       g[j] = f(g[j], s[j]);
+                     for (size_t j = 0; j < len; ++j)
+                       grad_ptr[i + j] = A(grad_ptr[i + j]) + g[j];
+                   }
+                 });
+  });
+}
+
 template <typename ToType, typename FromType>
 void tensor_abs(TensorImpl *to, const TensorImpl *from,
                 const TensorImpl *grad = nullptr) {
@@ -215,13 +516,14 @@ void tensor_abs(TensorImpl *to, const TensorImpl *from,
   if (grad == nullptr)
     for_each_sizevec(to->view->sizes, [=](const SizeVec &sv) {
       FromType tmp = *(from_ptr + from->cnt_from_index(sv));
-      *(to_ptr + to->cnt_from_index(sv)) = tmp >= 0 ? tmp : -tmp;
+      *(to_ptr + to->cnt_from_index(sv)) =
+          tmp >= FromType{} ? tmp : static_cast<FromType>(-tmp);
     });
   else {
     FromType *grad_ptr = reinterpret_cast<FromType *>(grad->data_->get_blob());
     for_each_sizevec(to->view->sizes, [=](const SizeVec &sv) {
       FromType tmp = *(from_ptr + from->cnt_from_index(sv));
-      if (tmp >= 0) {
+      if (tmp >= FromType{}) {
         *(grad_ptr + grad->cnt_from_index(sv)) = 1;
         *(to_ptr + to->cnt_from_index(sv)) = tmp;
       } else {
@@ -288,7 +590,7 @@ void tensor_min(TensorImpl *to, const TensorImpl *from,
 
 template <typename L, typename R>
 void tensor_lt(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
-  auto dst_ptr = reinterpret_cast<char *>(dst->data_->get_blob());
+  auto dst_ptr = reinterpret_cast<bool *>(dst->data_->get_blob());
   auto l_ptr = reinterpret_cast<L *>(l->data_->get_blob());
   auto r_ptr = reinterpret_cast<R *>(r->data_->get_blob());
   for_each_sizevec(dst->view->sizes, [=](const SizeVec &sv) {
@@ -300,7 +602,7 @@ void tensor_lt(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
 
 template <typename L, typename R>
 void tensor_gt(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
-  auto dst_ptr = reinterpret_cast<char *>(dst->data_->get_blob());
+  auto dst_ptr = reinterpret_cast<bool *>(dst->data_->get_blob());
   auto l_ptr = reinterpret_cast<L *>(l->data_->get_blob());
   auto r_ptr = reinterpret_cast<R *>(r->data_->get_blob());
   for_each_sizevec(dst->view->sizes, [=](const SizeVec &sv) {
@@ -312,7 +614,7 @@ void tensor_gt(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
 
 template <typename L, typename R>
 void tensor_le(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
-  auto dst_ptr = reinterpret_cast<char *>(dst->data_->get_blob());
+  auto dst_ptr = reinterpret_cast<bool *>(dst->data_->get_blob());
   auto l_ptr = reinterpret_cast<L *>(l->data_->get_blob());
   auto r_ptr = reinterpret_cast<R *>(r->data_->get_blob());
   for_each_sizevec(dst->view->sizes, [=](const SizeVec &sv) {
@@ -324,7 +626,7 @@ void tensor_le(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
 
 template <typename L, typename R>
 void tensor_ge(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
-  auto dst_ptr = reinterpret_cast<char *>(dst->data_->get_blob());
+  auto dst_ptr = reinterpret_cast<bool *>(dst->data_->get_blob());
   auto l_ptr = reinterpret_cast<L *>(l->data_->get_blob());
   auto r_ptr = reinterpret_cast<R *>(r->data_->get_blob());
   for_each_sizevec(dst->view->sizes, [=](const SizeVec &sv) {
@@ -336,7 +638,7 @@ void tensor_ge(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
 
 template <typename L, typename R>
 void tensor_eq(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
-  auto dst_ptr = reinterpret_cast<char *>(dst->data_->get_blob());
+  auto dst_ptr = reinterpret_cast<bool *>(dst->data_->get_blob());
   auto l_ptr = reinterpret_cast<L *>(l->data_->get_blob());
   auto r_ptr = reinterpret_cast<R *>(r->data_->get_blob());
   for_each_sizevec(dst->view->sizes, [=](const SizeVec &sv) {
@@ -348,7 +650,7 @@ void tensor_eq(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
 
 template <typename L, typename R>
 void tensor_ne(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
-  auto dst_ptr = reinterpret_cast<char *>(dst->data_->get_blob());
+  auto dst_ptr = reinterpret_cast<bool *>(dst->data_->get_blob());
   auto l_ptr = reinterpret_cast<L *>(l->data_->get_blob());
   auto r_ptr = reinterpret_cast<R *>(r->data_->get_blob());
   for_each_sizevec(dst->view->sizes, [=](const SizeVec &sv) {
@@ -358,6 +660,274 @@ void tensor_ne(TensorImpl *dst, const TensorImpl *l, const TensorImpl *r) {
   });
 }
 
+#if defined(__AVX2__)
+template <typename Cmp> constexpr int avx_cmp_predicate_ = 0;
+template <> constexpr int avx_cmp_predicate_<std::less<>> = _CMP_LT_OQ;
+template <> constexpr int avx_cmp_predicate_<std::greater<>> = _CMP_GT_OQ;
+template <> constexpr int avx_cmp_predicate_<std::less_equal<>> = _CMP_LE_OQ;
+template <> constexpr int avx_cmp_predicate_<std::greater_equal<>> = _CMP_GE_OQ;
+template <> constexpr int avx_cmp_predicate_<std::equal_to<>> = _CMP_EQ_OQ;
+template <> constexpr int avx_cmp_predicate_<std::not_equal_to<>> = _CMP_NEQ_UQ;
+#endif
+
+// Packs the comparison of 64 consecutive elements into one word.
+template <typename Cmp, typename L, typename R>
+inline std::uint64_t cmp_word_(const L *l, const R *r) {
+  std::uint64_t word = 0;
+#if defined(__AVX2__)
+  if constexpr (std::is_same_v<L, float> && std::is_same_v<R, float>) {
+    for (int j = 0; j < 8; ++j) {
+      __m256 c = _mm256_cmp_ps(_mm256_loadu_ps(l + 8 * j),
+                               _mm256_loadu_ps(r + 8 * j),
+                               avx_cmp_predicate_<Cmp>);
+      word |= std::uint64_t(_mm256_movemask_ps(c)) << (8 * j);
+    }
+    return word;
+  }
+#endif
+  Cmp cmp;
+  for (int j = 0; j < 64; ++j)
+    word |= std::uint64_t(cmp(l[j], r[j])) << j;
+  return word;
+}
+
+template <typename Cmp, typename L, typename R>
+void tensor_cmp_mask_(BitMask *dst, const TensorImpl *l, const TensorImpl *r) {
+  Cmp cmp;
+  auto l_ptr = reinterpret_cast<L *>(l->data_->get_blob());
+  auto r_ptr = reinterpret_cast<R *>(r->data_->get_blob());
+  if (l->view->sizes == r->view->sizes && l->is_contiguous() &&
+      r->is_contiguous()) {
+    l_ptr += dynamic_cast<StridedLayout *>(l->view.get())->offset;
+    r_ptr += dynamic_cast<StridedLayout *>(r->view.get())->offset;
+    size_t n = dst->numel(), full = n / 64;
+    for (size_t w = 0; w < full; ++w)
+      dst->words[w] = cmp_word_<Cmp>(l_ptr + 64 * w, r_ptr + 64 * w);
+    for (size_t i = full * 64; i < n; ++i)
+      if (cmp(l_ptr[i], r_ptr[i]))
+        dst->set(i);
+    return;
+  }
+  size_t i = 0;
+  for_each_sizevec(dst->sizes, [&](const SizeVec &sv) {
+    if (cmp(*(l_ptr + l->cnt_from_aug_index(sv)),
+            *(r_ptr + r->cnt_from_aug_index(sv))))
+      dst->set(i);
+    ++i;
+  });
+}
+
+template <typename L, typename R>
+void tensor_cmp_mask(BitMask *dst, const TensorImpl *l, const TensorImpl *r,
+                     cmp op) {
+  switch (op) {
+  case cmp::lt:
+    return tensor_cmp_mask_<std::less<>, L, R>(dst, l, r);
+  case cmp::gt:
+    return tensor_cmp_mask_<std::greater<>, L, R>(dst, l, r);
+  case cmp::le:
+    return tensor_cmp_mask_<std::less_equal<>, L, R>(dst, l, r);
+  case cmp::ge:
+    return tensor_cmp_mask_<std::greater_equal<>, L, R>(dst, l, r);
+  case cmp::eq:
+    return tensor_cmp_mask_<std::equal_to<>, L, R>(dst, l, r);
+  case cmp::ne:
+    return tensor_cmp_mask_<std::not_equal_to<>, L, R>(dst, l, r);
+  }
+}
+
+template <typename T>
+void tensor_to_mask(BitMask *dst, const TensorImpl *from) {
+  auto from_ptr = reinterpret_cast<T *>(from->data_->get_blob());
+  size_t i = 0;
+  for_each_sizevec(dst->sizes, [&](const SizeVec &sv) {
+    if (*(from_ptr + from->cnt_from_index(sv)) != T{})
+      dst->set(i);
+    ++i;
+  });
+}
+
+template <typename T>
+void tensor_masked_fill(TensorImpl *to, const TensorImpl *from,
+                        const BitMask *mask, double value) {
+  auto to_ptr = reinterpret_cast<T *>(to->data_->get_blob());
+  auto from_ptr = reinterpret_cast<T *>(from->data_->get_blob());
+  const T v = static_cast<T>(value);
+  size_t i = 0;
+  for_each_sizevec(to->view->sizes, [&](const SizeVec &sv) {
+    *(to_ptr + to->cnt_from_index(sv)) =
+        mask->test(i) ? v : *(from_ptr + from->cnt_from_index(sv));
+    ++i;
+  });
+}
+
+// Elements handled by one thread at least in index kernels.
+constexpr size_t index_grain_ = 1 << 15;
+
+inline size_t checked_index_(const TensorImpl *index, const SizeVec &sv,
+                             size_t size) {
+  auto i = *(reinterpret_cast<std::int64_t *>(index->data_->get_blob()) +
+             index->cnt_from_index(sv));
+  run_expect(i >= 0 && static_cast<size_t>(i) < size, "index ", i,
+             " is out of bounds for size ", size);
+  return i;
+}
+
+template <typename T>
+constexpr bool has_atomic_add_ =
+    (std::is_integral_v<T> && !std::is_same_v<T, bool>) ||
+    std::is_floating_point_v<T>;
+
+// dst[locate(sv)] += src[sv] for every `sv` in `range`, where `locate` gives
+// a storage position of `dst` and may map several `sv` to the same one.
+template <typename T>
+void scatter_accumulate_(TensorImpl *dst, const TensorImpl *src,
+                         const SizeVec &range, auto locate) {
+  auto dst_ptr = reinterpret_cast<T *>(dst->data_->get_blob());
+  auto src_ptr = reinterpret_cast<T *>(src->data_->get_blob());
+  size_t n = 1;
+  for (auto r : range)
+    n *= r;
+  size_t chunks = parallel_chunks(n, index_grain_);
+  if (chunks == 1) {
+    for_each_sizevec(range, [&](const SizeVec &sv) {
+      dst_ptr[locate(sv)] += *(src_ptr + src->cnt_from_index(sv));
+    });
+    return;
+  }
+  if constexpr (has_atomic_add_<T>) {
+    if (!deterministic_algorithms()) {
+      parallel_for_each_sizevec(
+          range, index_grain_, [&](const SizeVec &sv, size_t, size_t) {
+            std::atomic_ref<T>(dst_ptr[locate(sv)])
+                .fetch_add(*(src_ptr + src->cnt_from_index(sv)),
+                           std::memory_order_relaxed);
+          });
+      return;
+    }
+  }
+  size_t span = dst->data_->get_size() / sizeof(T);
+  std::vector<std::unique_ptr<T[]>> partial(chunks);
+  for (auto &p : partial)
+    p.reset(new T[span]());
+  parallel_for_each_sizevec(
+      range, index_grain_, [&](const SizeVec &sv, size_t, size_t c) {
+        partial[c][locate(sv)] += *(src_ptr + src->cnt_from_index(sv));
+      });
+  parallel_for(span, index_grain_, [&](size_t begin, size_t end, size_t) {
+    for (size_t p = begin; p < end; ++p)
+      for (const auto &part : partial)
+        dst_ptr[p] += part[p];
+  });
+}
+
+template <typename T>
+void tensor_gather(TensorImpl *dst, const TensorImpl *src,
+                   const TensorImpl *index, size_t dim) {
+  auto dst_ptr = reinterpret_cast<T *>(dst->data_->get_blob());
+  auto src_ptr = reinterpret_cast<T *>(src->data_->get_blob());
+  parallel_for_each_sizevec(
+      index->view->sizes, index_grain_, [=](const SizeVec &sv, size_t, size_t) {
+        SizeVec src_sv = sv;
+        src_sv[dim] = checked_index_(index, sv, src->view->sizes[dim]);
+        *(dst_ptr + dst->cnt_from_index(sv)) =
+            *(src_ptr + src->cnt_from_index(src_sv));
+      });
+}
+
+template <typename T>
+void tensor_scatter(TensorImpl *dst, const TensorImpl *index,
+                    const TensorImpl *src, size_t dim) {
+  auto dst_ptr = reinterpret_cast<T *>(dst->data_->get_blob());
+  auto src_ptr = reinterpret_cast<T *>(src->data_->get_blob());
+  parallel_for_each_sizevec(
+      index->view->sizes, index_grain_, [=](const SizeVec &sv, size_t, size_t) {
+        SizeVec dst_sv = sv;
+        dst_sv[dim] = checked_index_(index, sv, dst->view->sizes[dim]);
+        *(dst_ptr + dst->cnt_from_index(dst_sv)) =
+            *(src_ptr + src->cnt_from_index(sv));
+      });
+}
+
+template <typename T>
+void tensor_scatter_add(TensorImpl *dst, const TensorImpl *index,
+                        const TensorImpl *src, size_t dim) {
+  scatter_accumulate_<T>(dst, src, index->view->sizes, [=](const SizeVec &sv) {
+    SizeVec dst_sv = sv;
+    dst_sv[dim] = checked_index_(index, sv, dst->view->sizes[dim]);
+    return dst->cnt_from_index(dst_sv);
+  });
+}
+
+template <typename T>
+void tensor_index_select(TensorImpl *dst, const TensorImpl *src,
+                         const TensorImpl *index, size_t dim) {
+  auto dst_ptr = reinterpret_cast<T *>(dst->data_->get_blob());
+  auto src_ptr = reinterpret_cast<T *>(src->data_->get_blob());
+  parallel_for_each_sizevec(
+      dst->view->sizes, index_grain_, [=](const SizeVec &sv, size_t, size_t) {
+        SizeVec src_sv = sv;
+        src_sv[dim] =
+            checked_index_(index, SizeVec{sv[dim]}, src->view->sizes[dim]);
+        *(dst_ptr + dst->cnt_from_index(sv)) =
+            *(src_ptr + src->cnt_from_index(src_sv));
+      });
+}
+
+template <typename T>
+void tensor_index_add(TensorImpl *dst, const TensorImpl *index,
+                      const TensorImpl *src, size_t dim) {
+  scatter_accumulate_<T>(dst, src, src->view->sizes, [=](const SizeVec &sv) {
+    SizeVec dst_sv = sv;
+    dst_sv[dim] =
+        checked_index_(index, SizeVec{sv[dim]}, dst->view->sizes[dim]);
+    return dst->cnt_from_index(dst_sv);
+  });
+}
+
+// Start positions in the packed selection for every chunk of `mask`.
+inline std::vector<size_t> masked_chunk_starts_(const BitMask *mask) {
+  size_t n = mask->numel();
+  std::vector<size_t> starts(parallel_chunks(n, index_grain_) + 1, 0);
+  parallel_for(n, index_grain_, [&](size_t begin, size_t end, size_t c) {
+    size_t cnt = 0;
+    for (size_t i = begin; i < end; ++i)
+      cnt += mask->test(i);
+    starts[c + 1] = cnt;
+  });
+  for (size_t c = 1; c < starts.size(); ++c)
+    starts[c] += starts[c - 1];
+  return starts;
+}
+
+// `dst` is a contiguous 1-D tensor of `mask->count()` elements.
+template <typename T>
+void tensor_masked_select(TensorImpl *dst, const TensorImpl *src,
+                          const BitMask *mask) {
+  auto dst_ptr = reinterpret_cast<T *>(dst->data_->get_blob());
+  auto src_ptr = reinterpret_cast<T *>(src->data_->get_blob());
+  auto starts = masked_chunk_starts_(mask);
+  parallel_for_each_sizevec(
+      mask->sizes, index_grain_, [&](const SizeVec &sv, size_t i, size_t c) {
+        if (mask->test(i))
+          dst_ptr[starts[c]++] = *(src_ptr + src->cnt_from_index(sv));
+      });
+}
+
+// The inverse of `tensor_masked_select`: `src` is a contiguous 1-D tensor.
+template <typename T>
+void tensor_masked_scatter(TensorImpl *dst, const TensorImpl *src,
+                           const BitMask *mask) {
+  auto dst_ptr = reinterpret_cast<T *>(dst->data_->get_blob());
+  auto src_ptr = reinterpret_cast<T *>(src->data_->get_blob());
+  auto starts = masked_chunk_starts_(mask);
+  parallel_for_each_sizevec(
+      mask->sizes, index_grain_, [&](const SizeVec &sv, size_t i, size_t c) {
+        if (mask->test(i))
+          *(dst_ptr + dst->cnt_from_index(sv)) = src_ptr[starts[c]++];
+      });
+}
+
 template <typename D, typename L, typename R>
 void tensor_div_back_numerator(TensorImpl *dst, const TensorImpl *out_grad,
                                const TensorImpl *den) {
@@ -416,13 +986,27 @@ generate_binary_op_helper(tensor_le);
 generate_binary_op_helper(tensor_ge);
 generate_binary_op_helper(tensor_eq);
 generate_binary_op_helper(tensor_ne);
+generate_binary_op_helper(tensor_cmp_mask);
+generate_i_op2_helper(tensor_to_mask);
+generate_i_op2_helper(tensor_masked_fill);
+generate_i_op2_helper(tensor_gather);
+generate_i_op2_helper(tensor_scatter);
+generate_i_op2_helper(tensor_scatter_add);
+generate_i_op2_helper(tensor_index_select);
+generate_i_op2_helper(tensor_index_add);
+generate_i_op2_helper(tensor_masked_select);
+generate_i_op2_helper(tensor_masked_scatter);
 generate_unary_op_helper(tensor_fill);
 generate_unary_op_helper(tensor_eye);
 generate_unary_op_helper(tensor_to_type);
 generate_unary_op_helper(tensor_sum);
 generate_unary_op_helper(tensor_mean);
+generate_ff_op4_helper(tensor_sum_to);
+generate_ff_op4_helper(tensor_scale_acc);
 generate_unary_op_helper(tensor_clone);
 generate_unary_grad_op_helper(tensor_abs);
+generate_f_op_helper(tensor_unary_math);
+generate_f_op_helper(tensor_unary_math_back);
 generate_ffi_op_helper(tensor_mul_acc_f);
 generate_ffi_op_helper(tensor_div_back_numerator);
 generate_ff_op4_helper(tensor_div_back_denominator);
@@ -0,0 +1,76 @@
+#pragma once
+#include "INNC/tensor.hpp"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace INNC {
+class TensorImpl;
+
+namespace optim {
+// Updates a fixed list of parameters from their grads. A step touches every
+// element once: the whole update of all parameters, including weight decay
+// and moments, runs as one pass split among threads across parameter
+// boundaries, without temporaries. Parameters must be contiguous float
+// tensors; those without a grad are skipped.
+class Optimizer {
+public:
+  Optimizer(const std::vector<Tensor> &params, double lr);
+  Optimizer(const Optimizer &) = delete;
+  Optimizer &operator=(const Optimizer &) = delete;
+  virtual ~Optimizer();
+  virtual void step() = 0;
+  void zero_grad() const noexcept;
+  double lr;
+
+protected:
+  std::vector<std::shared_ptr<TensorImpl>> params;
+  // A zeroed buffer of the size and type of every parameter.
+  std::vector<std::shared_ptr<TensorImpl>> make_state() const;
+  // Calls `update(i, begin, end)` for runs of elements [begin, end) of the
+  // i-th parameter, which together cover all parameters having a grad.
+  void multi_tensor_apply(
+      const std::function<void(size_t, size_t, size_t)> &update) const;
+};
+
+// Stochastic gradient descent with optional momentum and L2 weight decay.
+class SGD : public Optimizer {
+public:
+  SGD(const std::vector<Tensor> &params, double lr, double momentum = 0,
+      double weight_decay = 0, bool nesterov = false);
+  void step() override;
+  double momentum, weight_decay;
+  bool nesterov;
+
+private:
+  std::vector<std::shared_ptr<TensorImpl>> buffers;
+};
+
+// Adam, adding `weight_decay * param` to the grad.
+class Adam : public Optimizer {
+public:
+  Adam(const std::vector<Tensor> &params, double lr = 1e-3, double beta1 = .9,
+       double beta2 = .999, double eps = 1e-8, double weight_decay = 0);
+  void step() override;
+  double beta1, beta2, eps, weight_decay;
+
+protected:
+  // Whether weight decay shrinks the parameters directly, see `AdamW`.
+  bool decoupled = false;
+
+private:
+  std::vector<std::shared_ptr<TensorImpl>> exp_avg, exp_avg_sq;
+  size_t steps = 0;
+};
+
+// Adam with decoupled weight decay: the parameters shrink by
+// `lr * weight_decay` before each update instead of the grad growing.
+class AdamW : public Adam {
+public:
+  AdamW(const std::vector<Tensor> &params, double lr = 1e-3,
+        double beta1 = .9, double beta2 = .999, double eps = 1e-8,
+        double weight_decay = 1e-2);
+};
+} // namespace optim
+} // namespace INNC
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace INNC {
+
+// Affine quantization: real = (q - zero_point) * scale. A per-tensor scheme
+// has a single scale and zero point and `axis == -1`; a per-channel scheme has
+// one pair for every index along `axis`.
+struct QuantParams {
+  std::vector<float> scales;
+  std::vector<std::int32_t> zero_points;
+  long long axis;
+  bool per_channel() const noexcept { return axis >= 0; }
+  float scale(size_t channel) const noexcept {
+    return scales[per_channel() ? channel : 0];
+  }
+  std::int32_t zero_point(size_t channel) const noexcept {
+    return zero_points[per_channel() ? channel : 0];
+  }
+};
+
+namespace native {
+// c[m, n] = a[m, k] * b[k, n] with 32-bit accumulation. `bt` is b transposed,
+// i.e. of shape [n, k]. All operands are row-major and contiguous.
+void gemm_s8s8s32(const std::int8_t *a, const std::int8_t *bt, std::int32_t *c,
+                  size_t m, size_t n, size_t k);
+
+// Removes the zero points from the raw products of `gemm_s8s8s32` in place.
+// `zb` holds one zero point per column when `zb_n == n`, otherwise one.
+void gemm_s8_zero_point_fix(std::int32_t *c, const std::int8_t *a,
+                            const std::int8_t *bt, size_t m, size_t n, size_t k,
+                            std::int32_t za, const std::int32_t *zb,
+                            size_t zb_n);
+
+// dst = clamp(round(acc * multiplier[col]) + zero_point, -128, 127) where
+// `multiplier` has one entry per column when `mul_n == n`, otherwise one.
+void requantize_s32_s8(const std::int32_t *acc, std::int8_t *dst, size_t m,
+                       size_t n, const float *multiplier, size_t mul_n,
+                       std::int32_t zero_point);
+} // namespace native
+} // namespace INNC
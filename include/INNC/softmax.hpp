@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace INNC {
+namespace native {
+// Softmax, or log-softmax when `log`, over the middle dimension of the
+// contiguous x[outer, n, inner] into y of the same size. Every run of n
+// elements is read twice and written once, with its maximum subtracted
+// before exp.
+void softmax(const float *x, float *y, size_t outer, size_t n, size_t inner,
+             bool log);
+void softmax(const double *x, double *y, size_t outer, size_t n, size_t inner,
+             bool log);
+
+// dx = dy * softmax'(x) for the outputs y of `softmax` with the same `log`.
+void softmax_backward(const float *y, const float *dy, float *dx, size_t outer,
+                      size_t n, size_t inner, bool log);
+void softmax_backward(const double *y, const double *dy, double *dx,
+                      size_t outer, size_t n, size_t inner, bool log);
+
+// For m rows of n logits x and their classes `target`, lse[i] receives
+// log(sum(exp(x[i]))) and loss[i] = lse[i] - x[i, target[i]].
+void cross_entropy(const float *x, const std::int64_t *target, float *loss,
+                   float *lse, size_t m, size_t n);
+void cross_entropy(const double *x, const std::int64_t *target, double *loss,
+                   double *lse, size_t m, size_t n);
+
+// dx[i] = scale[i / group] * (softmax(x[i]) - onehot(target[i])) from the
+// `lse` of `cross_entropy`.
+void cross_entropy_backward(const float *x, const std::int64_t *target,
+                            const float *lse, const float *scale, size_t group,
+                            float *dx, size_t m, size_t n);
+void cross_entropy_backward(const double *x, const std::int64_t *target,
+                            const double *lse, const double *scale,
+                            size_t group, double *dx, size_t m, size_t n);
+} // namespace native
+} // namespace INNC
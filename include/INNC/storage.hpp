@@ -5,6 +5,9 @@
 class UntypedStorage {
   size_t size; // in unit of bypes
   std::unique_ptr<uint8_t[]> blob;
+  // Set when the bytes are borrowed from a buffer shared with other storages.
+  std::shared_ptr<uint8_t[]> pool;
+  uint8_t *ptr = nullptr;
 
 public:
   UntypedStorage(size_t size, bool prealloc = true);
@@ -14,6 +17,8 @@ public:
   uint8_t *get_blob() const noexcept;
   void reset_blob(uint8_t ptr[]);
   void reset_blob(std::unique_ptr<uint8_t[]> &&ptr);
+  // Frees the owned bytes and uses `pool[offset, offset + size)` instead.
+  void share_blob(const std::shared_ptr<uint8_t[]> &pool, size_t offset);
   void release() noexcept;
   bool is_alloc() const noexcept;
 };
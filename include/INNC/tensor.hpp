@@ -1,10 +1,20 @@
 #pragma once
 
+#include "INNC/indexing.hpp"
 #include "INNC/layouts.hpp"
+#include "INNC/linear.hpp"
+#include "INNC/mask.hpp"
 #include "INNC/types.hpp"
+#include "INNC/utils/rand.hpp"
+#include <algorithm>
+#include <functional>
+#include <span>
 
 namespace INNC {
 class TensorImpl;
+namespace optim {
+class Optimizer;
+}
 class TensorInit;
 /**
  * @brief ``Tensor`` holds the information of a multi-dimentional matrix. The
@@ -28,6 +38,11 @@ private:
   std::shared_ptr<TensorImpl> fptr;
   Tensor(std::unique_ptr<TensorImpl> &&tf);
   Tensor(std::shared_ptr<TensorImpl> tf);
+  static std::vector<std::shared_ptr<TensorImpl>>
+  impls_of(const std::vector<Tensor> &tensors);
+  static std::function<std::shared_ptr<TensorImpl>(
+      const std::vector<std::shared_ptr<TensorImpl>> &)>
+  impl_fn_of(const std::function<Tensor(const std::vector<Tensor> &)> &fn);
 
 public:
   /**
@@ -62,7 +77,13 @@ public:
   Tensor &operator=(TensorInit init);
   Tensor(const SizeVec &sizes, types dtype);
   ~Tensor();
-  void backward();
+  /**
+   * @brief Accumulates the gradient of this scalar into the leaves. Unless
+   * ``retain_graph`` is set, every node of the graph is released as soon as
+   * its gradient has been propagated, and reaching it again throws.
+   *
+   */
+  void backward(bool retain_graph = false);
   std::string to_string() const;
   const SizeVec size() const;
   const SignedVec stride() const;
@@ -75,21 +96,114 @@ public:
   static Tensor eye(size_t n, types dtype = types::i8);
   static Tensor eye(size_t n, size_t m, types dtype = types::i8);
   static Tensor from_blob(void *data, const SizeVec &sizes, types dtype);
-  static Tensor randn(const SizeVec &sizes, types dtype);
+  /**
+   * @brief Uniform numbers of ``[0, 1)``, integers of ``[low, high)`` and
+   * standard normal numbers, drawn from the Philox stream of ``gen``. Any
+   * element only depends on the seed of ``gen``, the draws before, and its
+   * position, so results do not change with the number of threads.
+   *
+   * Example:
+   * \code{.cpp}
+   * INNC::Generator gen(42);
+   * auto w = INNC::Tensor::randn({128, 784}, INNC::f32, gen);
+   * auto idx = INNC::Tensor::randint(0, 10, {32}, INNC::i64, gen);
+   * \endcode
+   *
+   */
+  static Tensor rand(const SizeVec &sizes, types dtype,
+                     Generator &gen = default_generator());
+  static Tensor randint(std::int64_t low, std::int64_t high,
+                        const SizeVec &sizes, types dtype = i64,
+                        Generator &gen = default_generator());
+  static Tensor randn(const SizeVec &sizes, types dtype,
+                      Generator &gen = default_generator());
   static Tensor randn_like(const Tensor &t);
+  /**
+   * @brief 1 with the probability held by every element of ``p``, else 0.
+   *
+   */
+  static Tensor bernoulli(const Tensor &p,
+                          Generator &gen = default_generator());
   size_t numel() const noexcept;
   void release() noexcept;
   INNC::types type() const;
   Tensor type(types t);
   Tensor operator[](const std::string &slice);
+  Tensor index(std::initializer_list<TensorIndex> indices);
+  Tensor index(std::span<const TensorIndex> indices);
   static Tensor transpose(const Tensor &input, size_t dim0, size_t dim1);
   Tensor transpose(size_t dim0, size_t dim1);
   static Tensor reshape(const Tensor &input, const SignedVec &sizes);
   Tensor reshape(const SignedVec &sizes);
   Tensor reshape_as(const Tensor &input);
+  Tensor permute(const SizeVec &dims);
+  Tensor squeeze();
+  Tensor squeeze(size_t dim);
+  Tensor unsqueeze(size_t dim);
+  Tensor narrow(size_t dim, size_t start, size_t length);
+  Tensor select(size_t dim, long long index);
+  Tensor flip(const SizeVec &dims);
+  Tensor unfold(size_t dim, size_t size, size_t step);
+  Tensor as_strided(const SizeVec &sizes, const SignedVec &strides,
+                    size_t offset = 0);
+  static Tensor expand(const Tensor &input, const SignedVec &sizes);
+  Tensor expand(const SignedVec &sizes);
+  Tensor expand_as(const Tensor &input);
+  Tensor broadcast_to(const SizeVec &sizes);
   static Tensor cat(const std::vector<Tensor> &input_tensors,
                     const size_t dim = 0);
+  /**
+   * @brief Returns ``fn(inputs)`` without keeping the intermediates of ``fn``
+   * alive. ``fn`` runs again during backward to recompute them, so it must be
+   * deterministic. Random ops drawing from the default generator, e.g.
+   * ``dropout``, draw the same numbers again. Tensors requiring grad that
+   * ``fn`` reads besides ``inputs`` must be leaves.
+   *
+   * Example:
+   * \code{.cpp}
+   * std::vector<INNC::Tensor> in(1);
+   * in[0] = x;
+   * auto y = INNC::Tensor::checkpoint(
+   *     [&w](const std::vector<INNC::Tensor> &in) { return in[0] * w; }, in);
+   * \endcode
+   *
+   */
+  static Tensor
+  checkpoint(const std::function<Tensor(const std::vector<Tensor> &)> &fn,
+             const std::vector<Tensor> &inputs);
+  /**
+   * @brief Calls ``fn`` once on all examples stacked along dimension 0 of
+   * ``inputs``, as if it ran on every example separately. Inside ``fn``,
+   * dims and sizes given to ops refer to one example, and so do ``size()``,
+   * ``stride()``, ``numel()`` and ``dim()``. Ops mixing examples, e.g.
+   * ``max``, ``cat`` and ``index``, throw.
+   *
+   * Example:
+   * \code{.cpp}
+   * std::vector<INNC::Tensor> in(1);
+   * in[0] = x; // [B, 3]
+   * auto y = INNC::Tensor::vmap(
+   *     [&w](const std::vector<INNC::Tensor> &in) {
+   *       return (in[0] * w).sum(); // one example of size [3]
+   *     }, in); // [B]
+   * \endcode
+   *
+   */
+  static Tensor
+  vmap(const std::function<Tensor(const std::vector<Tensor> &)> &fn,
+       const std::vector<Tensor> &inputs);
+  /**
+   * @brief The grads of ``params`` for every example of ``inputs`` in one
+   * backward pass. ``fn`` gets ``params`` followed by ``inputs`` like under
+   * ``vmap`` and returns the scalar loss of one example. The i-th result
+   * holds the grads of ``params[i]`` stacked along a new dimension 0.
+   *
+   */
+  static std::vector<Tensor> per_sample_grad(
+      const std::function<Tensor(const std::vector<Tensor> &)> &fn,
+      const std::vector<Tensor> &params, const std::vector<Tensor> &inputs);
   Tensor &operator+=(const Tensor &rhs);
+  Tensor &copy_(const Tensor &src);
   bool requires_grad() const noexcept;
   void requires_grad(bool b);
   bool retain_grad() const noexcept;
@@ -99,6 +213,20 @@ public:
   Tensor sum() const;
   Tensor mean() const;
   Tensor abs() const;
+  /**
+   * @brief Elementwise math on float tensors. The grads of ``exp``, ``sqrt``,
+   * ``tanh``, ``sigmoid`` and ``relu`` are computed from their outputs,
+   * those of ``log`` and ``gelu`` (``x * Phi(x)``) from their inputs. See
+   * ``use_fast_math`` for faster approximations.
+   *
+   */
+  Tensor exp() const;
+  Tensor log() const;
+  Tensor sqrt() const;
+  Tensor tanh() const;
+  Tensor sigmoid() const;
+  Tensor gelu() const;
+  Tensor relu() const;
   Tensor max() const;
   Tensor min() const;
   void zero_grad() const noexcept;
@@ -107,6 +235,116 @@ public:
   Tensor clone() const;
   Tensor detach() const;
   bool all() const;
+  bool any() const;
+  BitMask to_mask() const;
+  BitMask compare_mask(const Tensor &rhs, cmp op) const;
+  static Tensor from_mask(const BitMask &mask);
+  Tensor masked_fill(const BitMask &mask, double value) const;
+  Tensor gather(size_t dim, const Tensor &index) const;
+  Tensor scatter(size_t dim, const Tensor &index, const Tensor &src) const;
+  Tensor scatter_add(size_t dim, const Tensor &index, const Tensor &src) const;
+  Tensor index_select(size_t dim, const Tensor &index) const;
+  Tensor index_add(size_t dim, const Tensor &index, const Tensor &src) const;
+  Tensor masked_select(const BitMask &mask) const;
+  bool is_quantized() const noexcept;
+  Tensor quantize(float scale, std::int32_t zero_point) const;
+  Tensor quantize_per_channel(const std::vector<float> &scales,
+                              const std::vector<std::int32_t> &zero_points,
+                              size_t axis) const;
+  Tensor dequantize() const;
+  static Tensor qmatmul(const Tensor &a, const Tensor &b);
+  static Tensor qmatmul(const Tensor &a, const Tensor &b, float out_scale,
+                        std::int32_t out_zero_point);
+  /**
+   * @brief ``act(input * weight^T + bias)`` for a weight of size ``[out,
+   * in]`` applied to the last dimension of ``input``. The bias is added and
+   * the activation applied while the product is written, and the backward
+   * pass sums up the grad of the bias within the GEMM of the grad of the
+   * weight. An empty ``bias`` is left out.
+   *
+   * Example:
+   * \code{.cpp}
+   * auto x = INNC::Tensor::randn({32, 784}, INNC::f32);
+   * auto w = INNC::Tensor::randn({128, 784}, INNC::f32);
+   * auto b = INNC::Tensor::zeros({128}, INNC::f32);
+   * // [32, 128]
+   * auto y = INNC::Tensor::linear(x, w, b, INNC::activation::relu);
+   * \endcode
+   *
+   */
+  static Tensor linear(const Tensor &input, const Tensor &weight,
+                       const Tensor &bias, activation act = activation::none);
+  /**
+   * @brief Softmax, or its logarithm, along ``dim``. The maximum of every row
+   * is subtracted before exp, and the whole op runs as one kernel reading
+   * each row twice. The grad is computed from the output.
+   *
+   */
+  Tensor softmax(size_t dim) const;
+  Tensor log_softmax(size_t dim) const;
+  /**
+   * @brief The mean cross entropy of the logits along the last dimension of
+   * ``input`` against the classes ``target``, an i64 tensor of the other
+   * dimensions. Equivalent to gathering ``-log_softmax(-1)`` at ``target``,
+   * without materializing the probabilities.
+   *
+   * Example:
+   * \code{.cpp}
+   * auto logits = INNC::Tensor::randn({32, 50000}, INNC::f32);
+   * auto target = INNC::Tensor::zeros({32}, INNC::i64);
+   * auto loss = INNC::Tensor::cross_entropy(logits, target);
+   * \endcode
+   *
+   */
+  static Tensor cross_entropy(const Tensor &input, const Tensor &target);
+  /**
+   * @brief Normalizes every slice of the trailing dimensions
+   * ``normalized_shape`` of ``input`` to zero mean and unit variance, then
+   * scales it by ``weight`` and shifts it by ``bias``, both of that shape or
+   * both empty. Mean and variance come from one Welford pass per slice, and
+   * the affine transform is applied by the same kernel.
+   *
+   * Example:
+   * \code{.cpp}
+   * auto x = INNC::Tensor::randn({32, 16, 512}, INNC::f32);
+   * auto w = INNC::Tensor::ones({512}, INNC::f32);
+   * auto b = INNC::Tensor::zeros({512}, INNC::f32);
+   * auto y = INNC::Tensor::layer_norm(x, {512}, w, b);
+   * \endcode
+   *
+   */
+  static Tensor layer_norm(const Tensor &input,
+                           const SizeVec &normalized_shape,
+                           const Tensor &weight, const Tensor &bias,
+                           double eps = 1e-5);
+  /**
+   * @brief Normalizes every channel, the dimension 1, of ``input`` of size
+   * ``[N, C, ...]``, then applies the per-channel ``weight`` and ``bias``,
+   * both of size ``[C]`` or both empty. In ``training`` the statistics of
+   * the input are used and folded into ``running_mean`` and ``running_var``
+   * in place with ``momentum``, unless they are empty. Otherwise the running
+   * statistics are used.
+   *
+   */
+  static Tensor batch_norm(const Tensor &input, const Tensor &running_mean,
+                           const Tensor &running_var, const Tensor &weight,
+                           const Tensor &bias, bool training,
+                           double momentum = .1, double eps = 1e-5);
+  /**
+   * @brief Zeroes every element of ``input`` with probability ``p`` and
+   * scales the others by ``1 / (1 - p)`` when ``training``, else returns
+   * ``input``. The mask is drawn from ``gen`` while the output is written,
+   * and the backward pass draws it again instead of storing it.
+   *
+   * Example:
+   * \code{.cpp}
+   * auto x = INNC::Tensor::randn({32, 512}, INNC::f32);
+   * auto y = INNC::Tensor::dropout(x, .1);
+   * \endcode
+   *
+   */
+  static Tensor dropout(const Tensor &input, double p, bool training = true,
+                        Generator &gen = default_generator());
   Tensor operator-();
   Tensor operator+();
   friend Tensor operator+(const Tensor &lhs, const Tensor &rhs);
@@ -120,6 +358,7 @@ public:
   friend Tensor operator==(const Tensor &lhs, const Tensor &rhs);
   friend Tensor operator!=(const Tensor &lhs, const Tensor &rhs);
   friend class Backward;
+  friend class optim::Optimizer;
 };
 
 class TensorInit {
@@ -162,7 +401,8 @@ public:
           "Shapes or types of subtensor does not match");
     dtype = first_sub->dtype;
     shape[0] = args.size();
-    copy(first_sub->shape.begin(), first_sub->shape.end(), shape.begin() + 1);
+    std::copy(first_sub->shape.begin(), first_sub->shape.end(),
+              shape.begin() + 1);
     auto data_rawp = new uint8_t[numel() * size_of(dtype)];
     data_ptr.reset(data_rawp);
     auto step = first_sub->numel() * size_of(dtype);
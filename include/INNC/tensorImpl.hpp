@@ -1,8 +1,18 @@
 #pragma once
 
+#include "INNC/grad_mode.hpp"
+#include "INNC/indexing.hpp"
 #include "INNC/layouts.hpp"
+#include "INNC/linear.hpp"
+#include "INNC/mask.hpp"
+#include "INNC/norm.hpp"
+#include "INNC/quantized.hpp"
+#include "INNC/softmax.hpp"
 #include "INNC/storage.hpp"
 #include "INNC/types.hpp"
+#include "INNC/utils/rand.hpp"
+#include <functional>
+#include <span>
 
 namespace INNC {
 
@@ -27,6 +37,13 @@ public:
   bool retain_grad;
   size_t _version;
   std::unique_ptr<Backward> grad_fn;
+  std::shared_ptr<const QuantParams> qparams;
+  // Dimension 0 indexes independent examples, see `vmap`.
+  bool batched;
+  // Whether ops on this tensor record `Backward` nodes, see `NoGrad`.
+  bool tracks_grad() const noexcept {
+    return requires_grad && is_grad_enabled();
+  }
 
   static std::shared_ptr<TensorImpl> create(types dtype,
                                             const std::shared_ptr<Layout> &view,
@@ -64,8 +81,23 @@ public:
                                          types dtype = types::i8);
   static std::shared_ptr<TensorImpl> from_blob(void *data, const SizeVec &sizes,
                                                types dtype);
-  static std::shared_ptr<TensorImpl> randn(const SizeVec &sizes, types dtype);
+  // Random tensors from the counters reserved in `gen`: uniform numbers of
+  // [0, 1), integers of [low, high), standard normal numbers and 0 or 1 with
+  // the probabilities of `p`. Reduced floats are drawn in f32 and integers in
+  // i64.
+  static std::shared_ptr<TensorImpl>
+  rand(const SizeVec &sizes, types dtype,
+       Generator &gen = default_generator());
+  static std::shared_ptr<TensorImpl>
+  randint(std::int64_t low, std::int64_t high, const SizeVec &sizes,
+          types dtype = i64, Generator &gen = default_generator());
+  static std::shared_ptr<TensorImpl>
+  randn(const SizeVec &sizes, types dtype,
+        Generator &gen = default_generator());
   static std::shared_ptr<TensorImpl> randn_like(const TensorImpl &t);
+  static std::shared_ptr<TensorImpl>
+  bernoulli(const std::shared_ptr<TensorImpl> &p,
+            Generator &gen = default_generator());
   size_t numel() const noexcept;
   void release() noexcept;
   INNC::types type() const;
@@ -74,6 +106,7 @@ public:
   SizeVec size() const;
   size_t size(int d) const;
   std::shared_ptr<TensorImpl> operator[](const std::string &slice);
+  std::shared_ptr<TensorImpl> index(std::span<const TensorIndex> indices);
   static std::shared_ptr<TensorImpl>
   transpose(const std::shared_ptr<TensorImpl> &input, size_t dim0, size_t dim1);
   static std::shared_ptr<TensorImpl>
@@ -84,11 +117,47 @@ public:
   std::shared_ptr<TensorImpl> reshape(const SignedVec &sizes);
   std::shared_ptr<TensorImpl> reshape_as(const TensorImpl &sizes);
   static std::shared_ptr<TensorImpl>
+  permute(const std::shared_ptr<TensorImpl> &input, const SizeVec &dims);
+  static std::shared_ptr<TensorImpl>
+  squeeze(const std::shared_ptr<TensorImpl> &input);
+  static std::shared_ptr<TensorImpl>
+  squeeze(const std::shared_ptr<TensorImpl> &input, size_t dim);
+  static std::shared_ptr<TensorImpl>
+  unsqueeze(const std::shared_ptr<TensorImpl> &input, size_t dim);
+  static std::shared_ptr<TensorImpl>
+  narrow(const std::shared_ptr<TensorImpl> &input, size_t dim, size_t start,
+         size_t length);
+  static std::shared_ptr<TensorImpl>
+  select(const std::shared_ptr<TensorImpl> &input, size_t dim,
+         long long index);
+  static std::shared_ptr<TensorImpl>
+  flip(const std::shared_ptr<TensorImpl> &input, const SizeVec &dims);
+  static std::shared_ptr<TensorImpl>
+  unfold(const std::shared_ptr<TensorImpl> &input, size_t dim, size_t size,
+         size_t step);
+  // `offset` counts elements from the start of the underlying storage.
+  static std::shared_ptr<TensorImpl>
+  as_strided(const std::shared_ptr<TensorImpl> &input, const SizeVec &sizes,
+             const SignedVec &strides, size_t offset = 0);
+  static std::shared_ptr<TensorImpl>
+  expand(const std::shared_ptr<TensorImpl> &input, const SignedVec &sizes);
+  std::shared_ptr<TensorImpl> expand(const SignedVec &sizes);
+  std::shared_ptr<TensorImpl> expand_as(const TensorImpl &t);
+  std::shared_ptr<TensorImpl> broadcast_to(const SizeVec &sizes);
+  static std::shared_ptr<TensorImpl>
   cat(const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_ts,
       const size_t dim);
   std::shared_ptr<TensorImpl> sum();
   std::shared_ptr<TensorImpl> mean();
   std::shared_ptr<TensorImpl> abs();
+  // Elementwise math on float tensors, see `use_fast_math`.
+  std::shared_ptr<TensorImpl> exp();
+  std::shared_ptr<TensorImpl> log();
+  std::shared_ptr<TensorImpl> sqrt();
+  std::shared_ptr<TensorImpl> tanh();
+  std::shared_ptr<TensorImpl> sigmoid();
+  std::shared_ptr<TensorImpl> gelu();
+  std::shared_ptr<TensorImpl> relu();
   std::shared_ptr<TensorImpl> max();
   std::shared_ptr<TensorImpl> min();
   void zero_grad() const noexcept;
@@ -105,15 +174,138 @@ public:
   friend std::shared_ptr<TensorImpl> operator==(TensorImpl &l, TensorImpl &r);
   friend std::shared_ptr<TensorImpl> operator!=(TensorImpl &l, TensorImpl &r);
   TensorImpl &operator+=(const TensorImpl &rhs);
+  // Overwrites the elements with those of `src`, converting the type. Not
+  // recorded by autograd.
+  TensorImpl &copy_(const TensorImpl &src);
   friend std::unique_ptr<TensorImpl> no_grad_add(const TensorImpl &lhs,
                                                  const TensorImpl &rhs);
   friend void check_same_size(const TensorImpl &lhs, const TensorImpl &rhs);
   friend class Backward;
-  void backward();
+  // Unless `retain_graph`, every node is released right after its step.
+  void backward(bool retain_graph = false);
   bool is_contiguous() const noexcept;
   std::shared_ptr<TensorImpl> contiguous();
   std::shared_ptr<TensorImpl> clone();
   std::shared_ptr<TensorImpl> detach();
   bool all() const;
+  bool any() const;
+  BitMask to_mask() const;
+  BitMask compare_mask(const TensorImpl &rhs, cmp op) const;
+  static std::shared_ptr<TensorImpl> from_mask(const BitMask &mask);
+  std::shared_ptr<TensorImpl> masked_fill(const BitMask &mask, double value);
+  // Index tensors are i64. `scatter` and `scatter_add` need `index` and `src`
+  // of the same size; `index_select` and `index_add` take a 1-D `index`.
+  static std::shared_ptr<TensorImpl>
+  gather(const std::shared_ptr<TensorImpl> &input, size_t dim,
+         const std::shared_ptr<TensorImpl> &index);
+  static std::shared_ptr<TensorImpl>
+  scatter(const std::shared_ptr<TensorImpl> &input, size_t dim,
+          const std::shared_ptr<TensorImpl> &index,
+          const std::shared_ptr<TensorImpl> &src);
+  static std::shared_ptr<TensorImpl>
+  scatter_add(const std::shared_ptr<TensorImpl> &input, size_t dim,
+              const std::shared_ptr<TensorImpl> &index,
+              const std::shared_ptr<TensorImpl> &src);
+  static std::shared_ptr<TensorImpl>
+  index_select(const std::shared_ptr<TensorImpl> &input, size_t dim,
+               const std::shared_ptr<TensorImpl> &index);
+  static std::shared_ptr<TensorImpl>
+  index_add(const std::shared_ptr<TensorImpl> &input, size_t dim,
+            const std::shared_ptr<TensorImpl> &index,
+            const std::shared_ptr<TensorImpl> &src);
+  static std::shared_ptr<TensorImpl>
+  masked_select(const std::shared_ptr<TensorImpl> &input, const BitMask &mask);
+  using TensorFn = std::function<std::shared_ptr<TensorImpl>(
+      const std::vector<std::shared_ptr<TensorImpl>> &)>;
+  // Returns `fn(inputs)` without keeping the intermediates of `fn` alive.
+  // They are recomputed by calling `fn` again when the backward pass reaches
+  // the result, so `fn` must be deterministic. Tensors requiring grad that
+  // `fn` reads other than `inputs` must be leaves.
+  static std::shared_ptr<TensorImpl>
+  checkpoint(const TensorFn &fn,
+             const std::vector<std::shared_ptr<TensorImpl>> &inputs);
+  // Calls `fn` once on all examples of `inputs` at the same time, where
+  // dimension 0 of every input indexes the examples. Inside `fn`, ops see the
+  // tensors with that dimension set aside: dims, sizes passed to views and
+  // reductions, and the sizes `Tensor` reports refer to one example, while
+  // those of `TensorImpl` still include the batch. The examples of the result
+  // are stacked along dimension 0. Ops whose result mixes examples (e.g.
+  // `max`, `cat`, `index`) refuse batched tensors.
+  static std::shared_ptr<TensorImpl>
+  vmap(const TensorFn &fn,
+       const std::vector<std::shared_ptr<TensorImpl>> &inputs);
+  // The grads of a scalar loss with respect to `params`, separately for
+  // every example of `inputs`. `fn` receives `params` followed by `inputs`
+  // like under `vmap` and returns the loss of one example. The i-th result
+  // holds the grads of `params[i]` stacked along a new dimension 0, all from
+  // a single backward pass.
+  static std::vector<std::shared_ptr<TensorImpl>>
+  per_sample_grad(const TensorFn &fn,
+                  const std::vector<std::shared_ptr<TensorImpl>> &params,
+                  const std::vector<std::shared_ptr<TensorImpl>> &inputs);
+  bool is_quantized() const noexcept;
+  std::shared_ptr<TensorImpl> quantize(float scale, std::int32_t zero_point);
+  std::shared_ptr<TensorImpl>
+  quantize_per_channel(const std::vector<float> &scales,
+                       const std::vector<std::int32_t> &zero_points,
+                       size_t axis);
+  std::shared_ptr<TensorImpl> dequantize();
+  static std::shared_ptr<TensorImpl>
+  qmatmul(const std::shared_ptr<TensorImpl> &a,
+          const std::shared_ptr<TensorImpl> &b);
+  static std::shared_ptr<TensorImpl>
+  qmatmul(const std::shared_ptr<TensorImpl> &a,
+          const std::shared_ptr<TensorImpl> &b, float out_scale,
+          std::int32_t out_zero_point);
+  // act(input * weight^T + bias) with a [out, in] weight applied to the last
+  // dimension of `input`, computed by one GEMM whose epilogue adds `bias`
+  // (unless null) and applies `act`. Reduced floats are computed in f32.
+  static std::shared_ptr<TensorImpl>
+  linear(const std::shared_ptr<TensorImpl> &input,
+         const std::shared_ptr<TensorImpl> &weight,
+         const std::shared_ptr<TensorImpl> &bias,
+         activation act = activation::none);
+  // Softmax and log-softmax along `dim`, each one fused kernel reading every
+  // row twice, parallel over rows. Reduced floats are computed in f32; see
+  // `use_fast_math` for exp.
+  static std::shared_ptr<TensorImpl>
+  softmax(const std::shared_ptr<TensorImpl> &input, size_t dim);
+  static std::shared_ptr<TensorImpl>
+  log_softmax(const std::shared_ptr<TensorImpl> &input, size_t dim);
+  // The mean cross entropy of the logits along the last dimension of `input`
+  // against the classes `target`, an i64 tensor of the other dimensions. No
+  // probability is stored: the backward pass recomputes them from the
+  // logits and the saved log-sum-exp of every row.
+  static std::shared_ptr<TensorImpl>
+  cross_entropy(const std::shared_ptr<TensorImpl> &input,
+                const std::shared_ptr<TensorImpl> &target);
+  // Normalizes every slice of the trailing dimensions `normalized_shape` of
+  // `input` by its mean and variance, then applies the elementwise `weight`
+  // and `bias` of that shape unless both are null. Slices run in parallel,
+  // each one read twice and written once.
+  static std::shared_ptr<TensorImpl>
+  layer_norm(const std::shared_ptr<TensorImpl> &input,
+             const SizeVec &normalized_shape,
+             const std::shared_ptr<TensorImpl> &weight,
+             const std::shared_ptr<TensorImpl> &bias, double eps);
+  // Normalizes every channel, the dimension 1, of `input`. In `training`, the
+  // statistics of the input are used and folded into `running_mean` and
+  // `running_var` (unbiased) with `momentum` unless they are null. Otherwise
+  // the running statistics are used. `weight` and `bias` hold one element per
+  // channel unless both are null. Channels run in parallel.
+  static std::shared_ptr<TensorImpl>
+  batch_norm(const std::shared_ptr<TensorImpl> &input,
+             const std::shared_ptr<TensorImpl> &running_mean,
+             const std::shared_ptr<TensorImpl> &running_var,
+             const std::shared_ptr<TensorImpl> &weight,
+             const std::shared_ptr<TensorImpl> &bias, bool training,
+             double momentum, double eps);
+  // Zeroes every element with probability `p` and scales the others by
+  // 1 / (1 - p) in training, else returns `input`. The mask is drawn from
+  // `gen` in the same pass and drawn again by the backward pass from the
+  // saved seed and counters, so it is never stored.
+  static std::shared_ptr<TensorImpl>
+  dropout(const std::shared_ptr<TensorImpl> &input, double p, bool training,
+          Generator &gen = default_generator());
 };
 } // namespace INNC
@@ -11,6 +11,8 @@ static_assert(
     sizeof(double) == 8,
     "[Arch not supported] double size is not 8bytes on this architecture.");
 
+#include "INNC/half.hpp"
+#include "INNC/utils/small_vec.hpp"
 #include "INNC/utils/traits.hpp"
 #include <array>
 #include <initializer_list>
@@ -24,8 +26,8 @@ namespace INNC {
 // have to be able to convert to those to the right. Do not touch these
 // hard-coded variables unless you know what you are doing.
 // BEGIN hard-coded variables
-enum types { i8, i16, i32, i64, f32, f64, Count };
-constexpr size_t float_type_idx_start_ = 4;
+enum types { b8, i8, i16, i32, i64, f16, bf16, f32, f64, Count };
+constexpr size_t float_type_idx_start_ = 5;
 // END hard-coded variables
 
 template <typename T> struct to_itype_aux;
@@ -41,10 +43,13 @@ template <types t> using to_native = to_native_aux<t>::type;
     using type = native_typename;                                              \
   }
 
+REGISTER_TSTYPE(b8, bool);
 REGISTER_TSTYPE(i8, int8_t);
 REGISTER_TSTYPE(i16, int16_t);
 REGISTER_TSTYPE(i32, int32_t);
 REGISTER_TSTYPE(i64, int64_t);
+REGISTER_TSTYPE(f16, half);
+REGISTER_TSTYPE(bf16, bfloat16);
 REGISTER_TSTYPE(f32, float);
 REGISTER_TSTYPE(f64, double);
 
@@ -109,41 +114,51 @@ template <typename T>
 concept is_itype = is_any_itype_s<T, Count>::value;
 
 constexpr size_t float_type_n_ = types::Count - float_type_idx_start_;
-inline types larger_type(types a, types b) { return a >= b ? a : b; }
-inline bool is_int(types t) { return t < float_type_idx_start_; }
-inline bool is_float(types t) { return t >= float_type_idx_start_; }
+// f16 and bf16 trade range for precision, so neither holds the other and a
+// mix of them promotes to f32.
+constexpr types larger_type(types a, types b) {
+  if ((a == f16 && b == bf16) || (a == bf16 && b == f16))
+    return f32;
+  return a >= b ? a : b;
+}
+constexpr bool is_int(types t) { return t < float_type_idx_start_; }
+constexpr bool is_float(types t) { return t >= float_type_idx_start_; }
 std::string innc_type_to_string(NumericType auto num, types t);
 std::string innc_type_to_string(void *ptr, types t);
 
 template <typename T1, typename T2>
 using size_larger_t = std::conditional_t<sizeof(T1) >= sizeof(T2), T1, T2>;
 
+// Follows `larger_type` so that a kernel writes exactly the dtype allocated for
+// its output, e.g. f32 for f16 mixed with bf16.
 template <typename L, typename R>
   requires is_itype<L> && is_itype<R>
 struct innc_common_type {
-  using type =
-      std::conditional_t<std::is_integral_v<L> && std::is_integral_v<R>,
-                         std::conditional_t<sizeof(L) >= sizeof(R), L, R>,
-                         decltype(L{} + R{})>;
+  using type = to_native<larger_type(to_ts<L>, to_ts<R>)>;
 };
 
 template <typename L, typename R>
 using innc_common_t = typename innc_common_type<L, R>::type;
 
-class SizeVec : public std::vector<size_t> {
+// Tensors rarely exceed eight dimensions, so shapes and indices stay inline.
+constexpr size_t inline_dims_ = 8;
+
+class SizeVec : public SmallVec<size_t, inline_dims_> {
 public:
   SizeVec();
   SizeVec(const std::initializer_list<size_t> &init_list);
-  SizeVec(is_same_wo_cvref<std::vector<int>> auto &&vec);
+  SizeVec(is_same_wo_cvref<std::vector<int>> auto &&vec)
+      : SmallVec(vec.begin(), vec.end()) {}
   friend std::ostream &operator<<(std::ostream &o, const SizeVec &sv) noexcept;
   std::string to_string() const noexcept;
 };
 
-class SignedVec : public std::vector<long long> {
+class SignedVec : public SmallVec<long long, inline_dims_> {
 public:
   SignedVec();
   SignedVec(const std::initializer_list<long long> &init_list);
-  SignedVec(is_same_wo_cvref<std::vector<int>> auto &&vec);
+  SignedVec(is_same_wo_cvref<std::vector<int>> auto &&vec)
+      : SmallVec(vec.begin(), vec.end()) {}
   friend std::ostream &operator<<(std::ostream &o,
                                   const SignedVec &sv) noexcept;
   std::string to_string() const noexcept;
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+
+namespace INNC {
+// Vectorized reductions keep this many partial results, one per lane, so
+// that no single sum is reordered.
+constexpr size_t reduce_lanes = 64;
+
+// Calls `f(l)` for l < w. The trip count of a full block is fixed, which
+// lets the loop vectorize. Every call must read and write elements of lane
+// l only, and the buffers it touches must not overlap.
+template <typename F> inline void for_lanes(size_t w, F &&f) {
+  if (w == reduce_lanes)
+#pragma GCC ivdep
+    for (size_t l = 0; l < reduce_lanes; ++l)
+      f(l);
+  else
+    for (size_t l = 0; l < w; ++l)
+      f(l);
+}
+} // namespace INNC
@@ -0,0 +1,128 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace INNC {
+// When enabled, elementwise math on f16, bf16 and f32 tensors uses the
+// approximations of `math` below instead of the C++ library. exp, log, tanh
+// and sigmoid stay within a relative error of 3e-7 (log within 3e-7 absolute
+// near 1) as long as the result is a normal float, and the normal cdf behind
+// gelu within 5e-7 absolute. f64 always uses the library.
+bool fast_math() noexcept;
+void use_fast_math(bool b) noexcept;
+
+// Functions of the elementwise math ops, e.g. `TensorImpl::exp`.
+enum class unary_fn { exp, log, sqrt, tanh, sigmoid, gelu, relu };
+
+namespace math {
+// Everything here is branch-free, so that loops over it vectorize.
+
+// exp(x) = 2^n * exp(r) with |r| <= ln(2) / 2 and ln(2) split in two parts to
+// keep r exact.
+inline float fast_exp(float x) noexcept {
+  constexpr float log2e = 1.44269504f, ln2_hi = .693145752f,
+                  ln2_lo = 1.42860677e-6f, round = 12582912.f;
+  float c = std::min(std::max(x, -87.f), 88.f);
+  float n = (c * log2e + round) - round;
+  float r = (c - n * ln2_hi) - n * ln2_lo;
+  float p = 1.f / 5040;
+  p = p * r + 1.f / 720;
+  p = p * r + 1.f / 120;
+  p = p * r + 1.f / 24;
+  p = p * r + 1.f / 6;
+  p = p * r + .5f;
+  p = p * r + 1;
+  p = p * r + 1;
+  float scale =
+      std::bit_cast<float>((static_cast<std::int32_t>(n) + 127) << 23);
+  float y = p * scale;
+  y = x < -87.f ? 0.f : y;
+  y = x > 88.f ? std::numeric_limits<float>::infinity() : y;
+  return x != x ? x : y;
+}
+
+// log(x) = e * ln(2) + log(m) with m in [sqrt(1/2), sqrt(2)), where
+// log(m) = 2 * atanh(s) for s = (m - 1) / (m + 1), |s| < 0.172. Only for
+// positive, normal and finite x, see `fast_log` for the others.
+inline float fast_log_normal(float x) noexcept {
+  constexpr float ln2 = .693147181f;
+  std::int32_t bits = std::bit_cast<std::int32_t>(x);
+  std::int32_t e = ((bits >> 23) & 0xff) - 127;
+  float m = std::bit_cast<float>((bits & 0x7fffff) | 0x3f800000);
+  // Powers of two come from their bits, as GCC would turn a select between
+  // two constants back into a branch.
+  std::int32_t big = m > 1.41421356f;
+  m *= std::bit_cast<float>((127 - big) << 23);
+  e += big;
+  float s = (m - 1) / (m + 1), s2 = s * s;
+  float p = 1.f / 11;
+  p = p * s2 + 1.f / 9;
+  p = p * s2 + 1.f / 7;
+  p = p * s2 + 1.f / 5;
+  p = p * s2 + 1.f / 3;
+  p = p * s2 + 1;
+  return 2 * s * p + static_cast<float>(e) * ln2;
+}
+
+inline float fast_log(float x) noexcept {
+  constexpr float ln2 = .693147181f;
+  // Denormals are scaled by 2^23 first.
+  std::int32_t sub = x < std::numeric_limits<float>::min();
+  float y = fast_log_normal(x * std::bit_cast<float>((127 + 23 * sub) << 23)) -
+            static_cast<float>(23 * sub) * ln2;
+  // 0, negatives, inf and NaN are blended in with a mask rather than
+  // selected, as GCC would branch around the division of `fast_log_normal`.
+  float special = x == 0 ? -std::numeric_limits<float>::infinity() : x;
+  special = (x < 0) | (x != x) ? std::numeric_limits<float>::quiet_NaN()
+                               : special;
+  std::int32_t mask =
+      -std::int32_t((x <= 0) | (x == std::numeric_limits<float>::infinity()) |
+                    (x != x));
+  return std::bit_cast<float>((std::bit_cast<std::int32_t>(y) & ~mask) |
+                              (std::bit_cast<std::int32_t>(special) & mask));
+}
+
+// A Taylor polynomial near 0 avoids the cancellation of 1 - 2 / (e^2x + 1).
+inline float fast_tanh(float x) noexcept {
+  float a = std::abs(x), a2 = a * a;
+  float p = -1382.f / 155925;
+  p = p * a2 + 62.f / 2835;
+  p = p * a2 - 17.f / 315;
+  p = p * a2 + 2.f / 15;
+  p = p * a2 - 1.f / 3;
+  p = p * a2 + 1;
+  float y = a < .4f ? a * p : 1 - 2 / (fast_exp(2 * a) + 1);
+  return std::copysign(y, x);
+}
+
+inline float fast_sigmoid(float x) noexcept { return 1 / (1 + fast_exp(-x)); }
+
+// The standard normal cdf from erfc(z) ~ t * poly(t) * e^-z^2, t = 1 / (1 +
+// p * z) (Abramowitz and Stegun 7.1.26), which has no cancellation for x < 0.
+inline float fast_normal_cdf(float x) noexcept {
+  float z = std::abs(x) * .707106781f, t = 1 / (1 + .3275911f * z);
+  float p = 1.061405429f;
+  p = p * t - 1.453152027f;
+  p = p * t + 1.421413741f;
+  p = p * t - .284496736f;
+  p = p * t + .254829592f;
+  float half_erfc = .5f * t * p * fast_exp(-z * z);
+  return x < 0 ? half_erfc : 1 - half_erfc;
+}
+
+template <typename T> T normal_cdf(T x) noexcept {
+  return T(.5) * std::erfc(-x * T(M_SQRT1_2));
+}
+
+template <typename T> T normal_pdf(T x) noexcept {
+  return std::exp(T(-.5) * x * x) * T(.5 * M_2_SQRTPI * M_SQRT1_2);
+}
+
+inline float fast_normal_pdf(float x) noexcept {
+  return fast_exp(-.5f * x * x) * float(.5 * M_2_SQRTPI * M_SQRT1_2);
+}
+} // namespace math
+} // namespace INNC
@@ -0,0 +1,103 @@
+#pragma once
+#include "INNC/types.hpp"
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace INNC {
+// Upper bound of worker threads used by parallel kernels. 0 means
+// `std::thread::hardware_concurrency()`.
+size_t get_num_threads() noexcept;
+void set_num_threads(size_t n) noexcept;
+
+// Sets the number of worker threads for the lifetime of the guard.
+class NumThreadsGuard {
+  size_t prev;
+
+public:
+  explicit NumThreadsGuard(size_t n) noexcept;
+  NumThreadsGuard(const NumThreadsGuard &) = delete;
+  NumThreadsGuard &operator=(const NumThreadsGuard &) = delete;
+  ~NumThreadsGuard();
+};
+
+// When enabled, kernels whose parallel writes may collide (e.g. scatter_add)
+// accumulate into per-thread partial buffers reduced in a fixed order instead
+// of using atomics, so that floating-point results are reproducible.
+bool deterministic_algorithms() noexcept;
+void use_deterministic_algorithms(bool b) noexcept;
+
+// The number of chunks `parallel_for(n, grain, ...)` splits its range into.
+inline size_t parallel_chunks(size_t n, size_t grain) noexcept {
+  return std::max<size_t>(1, std::min(get_num_threads(), n / grain));
+}
+
+// Calls `run(ctx, chunk)` for every chunk in [0, chunks) on the calling
+// thread and the workers of a persistent pool, and returns once all are done.
+// `run` must not throw. Nested calls, and calls while another thread uses the
+// pool, run their chunks in order on the calling thread.
+void parallel_run(size_t chunks, void (*run)(void *, size_t), void *ctx);
+
+// Calls `op(begin, end, chunk)` for `parallel_chunks(n, grain)` contiguous
+// chunks of [0, n), one thread each. The split only depends on `n` and
+// `grain`. The first exception thrown by a chunk is rethrown here.
+void parallel_for(size_t n, size_t grain, auto op) {
+  size_t chunks = parallel_chunks(n, grain);
+  size_t len = (n + chunks - 1) / std::max<size_t>(chunks, 1);
+  if (chunks == 1) {
+    op(size_t(0), n, size_t(0));
+    return;
+  }
+  std::vector<std::exception_ptr> errors(chunks);
+  auto run = [&](size_t c) {
+    try {
+      op(c * len, std::min(n, (c + 1) * len), c);
+    } catch (...) {
+      errors[c] = std::current_exception();
+    }
+  };
+  parallel_run(
+      chunks,
+      [](void *ctx, size_t c) { (*static_cast<decltype(run) *>(ctx))(c); },
+      &run);
+  for (auto &e : errors)
+    if (e)
+      std::rethrow_exception(e);
+}
+
+// The row-major multi-index of the `linear`-th element of `range`.
+inline SizeVec unravel_index(size_t linear, const SizeVec &range) {
+  SizeVec sv;
+  sv.resize(range.size(), 0);
+  for (size_t d = range.size(); d-- > 0;) {
+    sv[d] = linear % range[d];
+    linear /= range[d];
+  }
+  return sv;
+}
+
+// Steps `sv` to the next element of `range` in row-major order.
+inline void next_index(SizeVec &sv, const SizeVec &range) noexcept {
+  for (size_t d = range.size(); d-- > 0;) {
+    if (++sv[d] < range[d])
+      return;
+    sv[d] = 0;
+  }
+}
+
+// Parallel `for_each_sizevec`. `op(sv, linear, chunk)` also receives the
+// row-major position of `sv` and the chunk it runs in.
+void parallel_for_each_sizevec(const SizeVec &range, size_t grain, auto op) {
+  size_t n = 1;
+  for (auto r : range)
+    n *= r;
+  if (n == 0)
+    return;
+  parallel_for(n, grain, [&](size_t begin, size_t end, size_t chunk) {
+    auto sv = unravel_index(begin, range);
+    for (size_t i = begin; i < end; ++i, next_index(sv, range))
+      op(static_cast<const SizeVec &>(sv), i, chunk);
+  });
+}
+} // namespace INNC
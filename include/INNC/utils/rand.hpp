@@ -1,5 +1,120 @@
-#include <random>
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 
 namespace INNC {
-extern std::mt19937 rng;
+// Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2,
+// 3"): the 128-bit counter {ctr_lo, ctr_hi} encrypted under `key`. Every
+// counter gives 4 independent words, so any part of a stream is computed
+// without the rest.
+inline std::array<std::uint32_t, 4> philox(std::uint64_t key,
+                                           std::uint64_t ctr_lo,
+                                           std::uint64_t ctr_hi = 0) noexcept {
+  std::uint32_t c0 = std::uint32_t(ctr_lo), c1 = std::uint32_t(ctr_lo >> 32),
+                c2 = std::uint32_t(ctr_hi), c3 = std::uint32_t(ctr_hi >> 32);
+  std::uint32_t k0 = std::uint32_t(key), k1 = std::uint32_t(key >> 32);
+  // Unrolled, so that loops over counters vectorize.
+#pragma GCC unroll 10
+  for (int r = 0; r < 10; ++r) {
+    std::uint64_t p0 = std::uint64_t(0xD2511F53) * c0,
+                  p1 = std::uint64_t(0xCD9E8D57) * c2;
+    c0 = std::uint32_t(p1 >> 32) ^ c1 ^ k0;
+    c1 = std::uint32_t(p1);
+    c2 = std::uint32_t(p0 >> 32) ^ c3 ^ k1;
+    c3 = std::uint32_t(p0);
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+  return {c0, c1, c2, c3};
 }
+
+// A Philox stream: a seed, which is the key, and the next unused counter.
+// Every op reserves the counters it uses before drawing from them, so the
+// numbers only depend on the seed and the order of the ops, not on threads.
+class Generator {
+public:
+  explicit Generator(std::uint64_t seed) noexcept : seed_(seed) {}
+  // Restarts the stream of `seed`.
+  void manual_seed(std::uint64_t seed) noexcept {
+    seed_ = seed;
+    offset_ = 0;
+  }
+  std::uint64_t seed() const noexcept { return seed_; }
+  std::uint64_t offset() const noexcept { return offset_; }
+  void set_offset(std::uint64_t offset) noexcept { offset_ = offset; }
+  // Reserves `n` counters and returns the first one.
+  std::uint64_t reserve(std::uint64_t n) noexcept {
+    return offset_.fetch_add(n);
+  }
+
+private:
+  std::uint64_t seed_;
+  std::atomic<std::uint64_t> offset_ = 0;
+};
+
+// The generator of random ops given none, seeded by `std::random_device`.
+Generator &default_generator() noexcept;
+void manual_seed(std::uint64_t seed) noexcept;
+
+// Puts `gen` at `seed` and `offset` for the lifetime of the guard, e.g. to
+// draw the same numbers again.
+class GeneratorStateGuard {
+  Generator &gen;
+  std::uint64_t prev_seed, prev_offset;
+
+public:
+  GeneratorStateGuard(Generator &gen, std::uint64_t seed,
+                      std::uint64_t offset) noexcept
+      : gen(gen), prev_seed(gen.seed()), prev_offset(gen.offset()) {
+    gen.manual_seed(seed);
+    gen.set_offset(offset);
+  }
+  GeneratorStateGuard(const GeneratorStateGuard &) = delete;
+  GeneratorStateGuard &operator=(const GeneratorStateGuard &) = delete;
+  ~GeneratorStateGuard() {
+    gen.manual_seed(prev_seed);
+    gen.set_offset(prev_offset);
+  }
+};
+
+namespace native {
+// The number of counters the kernels below reserve for n draws of
+// `draw_size` bytes, the size of their output type. Counters are taken in
+// blocks whose words fill consecutive elements, so that element i always
+// comes from the same word whatever the threads.
+std::uint64_t philox_counters(size_t n, size_t draw_size) noexcept;
+
+// Uniform numbers of [low, high) from the counters at `offset` of `seed`,
+// made of `digits` random bits. Fewer digits keep [0, 1) below 1 once
+// rounded to a narrower type.
+void uniform(float *y, size_t n, double low, double high, std::uint64_t seed,
+             std::uint64_t offset, int digits = 24);
+void uniform(double *y, size_t n, double low, double high, std::uint64_t seed,
+             std::uint64_t offset, int digits = 53);
+
+// Standard normal numbers by Box-Muller, every pair of words giving two.
+void normal(float *y, size_t n, std::uint64_t seed, std::uint64_t offset);
+void normal(double *y, size_t n, std::uint64_t seed, std::uint64_t offset);
+
+// Integers of [low, high), with low < high.
+void randint(std::int64_t *y, size_t n, std::int64_t low, std::int64_t high,
+             std::uint64_t seed, std::uint64_t offset);
+
+// y[i] = 1 with probability p[i], else 0. Probabilities out of [0, 1] act as
+// if clamped.
+void bernoulli(const float *p, float *y, size_t n, std::uint64_t seed,
+               std::uint64_t offset);
+void bernoulli(const double *p, double *y, size_t n, std::uint64_t seed,
+               std::uint64_t offset);
+
+// y[i] = x[i] / (1 - p), or 0 with probability p. The mask only depends on
+// the counters, so the backward pass runs the same kernel on dy instead of
+// storing it.
+void dropout(const float *x, float *y, size_t n, double p, std::uint64_t seed,
+             std::uint64_t offset);
+void dropout(const double *x, double *y, size_t n, double p,
+             std::uint64_t seed, std::uint64_t offset);
+} // namespace native
+} // namespace INNC
@@ -0,0 +1,229 @@
+#pragma once
+#include "INNC/utils/compile_opt.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+namespace INNC {
+
+// A `std::vector`-like container which keeps up to `N` elements inline and
+// only touches the heap beyond that. Restricted to trivially copyable `T` so
+// that growth and copies are plain memory moves.
+template <typename T, std::size_t N> class SmallVec {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "SmallVec only holds trivially copyable types");
+  static_assert(N > 0);
+
+  T *ptr_;
+  std::size_t size_;
+  std::size_t cap_;
+  T inline_[N];
+
+  bool is_inline() const noexcept { return ptr_ == inline_; }
+
+  void grow_to(std::size_t new_cap) {
+    T *p = std::allocator<T>{}.allocate(new_cap);
+    std::copy_n(ptr_, size_, p);
+    release();
+    ptr_ = p;
+    cap_ = new_cap;
+  }
+
+  void release() noexcept {
+    if (!is_inline())
+      std::allocator<T>{}.deallocate(ptr_, cap_);
+  }
+
+  void grow_for(std::size_t n) {
+    if (__UNLIKELY(n > cap_))
+      grow_to(std::max(n, cap_ * 2));
+  }
+
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T &;
+  using const_reference = const T &;
+  using pointer = T *;
+  using const_pointer = const T *;
+  using iterator = T *;
+  using const_iterator = const T *;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  SmallVec() noexcept : ptr_(inline_), size_(0), cap_(N) {}
+  explicit SmallVec(size_type n, const T &v = T{}) : SmallVec() {
+    assign(n, v);
+  }
+  SmallVec(std::initializer_list<T> init_list) : SmallVec() {
+    assign(init_list.begin(), init_list.end());
+  }
+  template <std::input_iterator It> SmallVec(It first, It last) : SmallVec() {
+    assign(first, last);
+  }
+  SmallVec(const SmallVec &rhs) : SmallVec() {
+    assign(rhs.begin(), rhs.end());
+  }
+  SmallVec(SmallVec &&rhs) noexcept : SmallVec() { *this = std::move(rhs); }
+  ~SmallVec() { release(); }
+
+  SmallVec &operator=(const SmallVec &rhs) {
+    if (this != &rhs)
+      assign(rhs.begin(), rhs.end());
+    return *this;
+  }
+  SmallVec &operator=(SmallVec &&rhs) noexcept {
+    if (this == &rhs)
+      return *this;
+    if (rhs.is_inline()) {
+      std::copy_n(rhs.ptr_, rhs.size_, begin_for_(rhs.size_));
+      size_ = rhs.size_;
+    } else {
+      release();
+      ptr_ = rhs.ptr_;
+      size_ = rhs.size_;
+      cap_ = rhs.cap_;
+      rhs.ptr_ = rhs.inline_;
+      rhs.cap_ = N;
+    }
+    rhs.size_ = 0;
+    return *this;
+  }
+  SmallVec &operator=(std::initializer_list<T> init_list) {
+    assign(init_list.begin(), init_list.end());
+    return *this;
+  }
+
+  void assign(size_type n, const T &v) {
+    std::fill_n(begin_for_(n), n, v);
+    size_ = n;
+  }
+  template <std::input_iterator It> void assign(It first, It last) {
+    clear();
+    insert(end(), first, last);
+  }
+
+  size_type size() const noexcept { return size_; }
+  size_type capacity() const noexcept { return cap_; }
+  bool empty() const noexcept { return size_ == 0; }
+  T *data() noexcept { return ptr_; }
+  const T *data() const noexcept { return ptr_; }
+
+  iterator begin() noexcept { return ptr_; }
+  iterator end() noexcept { return ptr_ + size_; }
+  const_iterator begin() const noexcept { return ptr_; }
+  const_iterator end() const noexcept { return ptr_ + size_; }
+  const_iterator cbegin() const noexcept { return ptr_; }
+  const_iterator cend() const noexcept { return ptr_ + size_; }
+  reverse_iterator rbegin() noexcept { return reverse_iterator(end()); }
+  reverse_iterator rend() noexcept { return reverse_iterator(begin()); }
+  const_reverse_iterator rbegin() const noexcept {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator rend() const noexcept {
+    return const_reverse_iterator(begin());
+  }
+
+  T &operator[](size_type i) noexcept { return ptr_[i]; }
+  const T &operator[](size_type i) const noexcept { return ptr_[i]; }
+  T &at(size_type i) {
+    if (i >= size_)
+      throw std::out_of_range("SmallVec::at");
+    return ptr_[i];
+  }
+  const T &at(size_type i) const {
+    if (i >= size_)
+      throw std::out_of_range("SmallVec::at");
+    return ptr_[i];
+  }
+  T &front() noexcept { return ptr_[0]; }
+  const T &front() const noexcept { return ptr_[0]; }
+  T &back() noexcept { return ptr_[size_ - 1]; }
+  const T &back() const noexcept { return ptr_[size_ - 1]; }
+
+  void reserve(size_type n) {
+    if (n > cap_)
+      grow_to(n);
+  }
+  void clear() noexcept { size_ = 0; }
+  void resize(size_type n, const T &v = T{}) {
+    grow_for(n);
+    if (n > size_)
+      std::fill(ptr_ + size_, ptr_ + n, v);
+    size_ = n;
+  }
+  void push_back(const T &v) {
+    T tmp = v; // `v` may live in this container
+    grow_for(size_ + 1);
+    ptr_[size_++] = tmp;
+  }
+  template <typename... Args> T &emplace_back(Args &&...args) {
+    push_back(T(std::forward<Args>(args)...));
+    return back();
+  }
+  void pop_back() noexcept { --size_; }
+
+  iterator insert(const_iterator pos, const T &v) {
+    return insert(pos, size_type(1), v);
+  }
+  iterator insert(const_iterator pos, size_type n, const T &v) {
+    T tmp = v;
+    size_type i = pos - ptr_;
+    grow_for(size_ + n);
+    std::copy_backward(ptr_ + i, ptr_ + size_, ptr_ + size_ + n);
+    std::fill_n(ptr_ + i, n, tmp);
+    size_ += n;
+    return ptr_ + i;
+  }
+  template <std::input_iterator It>
+  iterator insert(const_iterator pos, It first, It last) {
+    size_type i = pos - ptr_;
+    if constexpr (std::forward_iterator<It>) {
+      size_type n = std::distance(first, last);
+      grow_for(size_ + n);
+      std::copy_backward(ptr_ + i, ptr_ + size_, ptr_ + size_ + n);
+      std::copy(first, last, ptr_ + i);
+      size_ += n;
+    } else {
+      for (size_type j = i; first != last; ++first, ++j)
+        insert(ptr_ + j, *first);
+    }
+    return ptr_ + i;
+  }
+  iterator insert(const_iterator pos, std::initializer_list<T> init_list) {
+    return insert(pos, init_list.begin(), init_list.end());
+  }
+  iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+  iterator erase(const_iterator first, const_iterator last) {
+    size_type i = first - ptr_, j = last - ptr_;
+    std::copy(ptr_ + j, ptr_ + size_, ptr_ + i);
+    size_ -= j - i;
+    return ptr_ + i;
+  }
+
+  friend bool operator==(const SmallVec &lhs, const SmallVec &rhs) noexcept {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+  }
+  friend auto operator<=>(const SmallVec &lhs, const SmallVec &rhs) noexcept {
+    return std::lexicographical_compare_three_way(lhs.begin(), lhs.end(),
+                                                  rhs.begin(), rhs.end());
+  }
+
+private:
+  // Ensures room for `n` elements without preserving the contents.
+  T *begin_for_(size_type n) {
+    if (n > cap_) {
+      release();
+      ptr_ = std::allocator<T>{}.allocate(n);
+      cap_ = n;
+    }
+    return ptr_;
+  }
+};
+
+} // namespace INNC
@@ -6,6 +6,9 @@
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace INNC {
@@ -55,6 +58,73 @@ concept is_valid_forward = is_valid_forward_func_<ForwardType>();
 
 SizeVec broadcast_range(const SizeVec &u, const SizeVec &v);
 
+// The sizes and the number of elements of one example of `t`, i.e. those of
+// `t` unless it is batched, see `TensorImpl::vmap`.
+SizeVec example_sizes(const TensorImpl &t);
+size_t example_numel(const TensorImpl &t);
+
+// Views the operands of a binary op of which at least one is batched so that
+// they broadcast example by example, see `TensorImpl::vmap`.
+std::pair<std::shared_ptr<TensorImpl>, std::shared_ptr<TensorImpl>>
+batch_aligned(const TensorImpl &lhs, const TensorImpl &rhs);
+
+// `t` detached from autograd as a contiguous tensor of type `dtype`, copied
+// only when needed.
+std::shared_ptr<TensorImpl> contiguous_as(TensorImpl &t, types dtype);
+
+// The type `TensorImpl::linear` computes in for operands of type `t`.
+inline types linear_compute_type(types t) noexcept {
+  return t == f64 ? f64 : f32;
+}
+
+// The native type of `linear_compute_type` for operands of native type `T`.
+template <typename T>
+using linear_compute_t =
+    std::conditional_t<std::is_same_v<T, double>, double, float>;
+
+// Calls `f(T{})` with the native type `T` of `linear_compute_type(t)`.
+template <typename F> void visit_linear_type(types t, F &&f) {
+  if (linear_compute_type(t) == f64)
+    f(double{});
+  else
+    f(float{});
+}
+
+// Calls `f(T{})` with the native type `T` of the float type `t`.
+template <typename F> void visit_float_type(types t, F &&f) {
+  switch (t) {
+  case f16:
+    return f(to_native<f16>{});
+  case bf16:
+    return f(to_native<bf16>{});
+  case f32:
+    return f(to_native<f32>{});
+  case f64:
+    return f(to_native<f64>{});
+  default:
+    throw std::runtime_error(
+        sformat("Expected a float type, got %s.", to_string(t)));
+  }
+}
+
+// The product of the sizes before `dim`, the size at `dim` and the product
+// of the sizes after it.
+inline std::tuple<size_t, size_t, size_t> split_sizes_at(const SizeVec &sizes,
+                                                         size_t dim) {
+  size_t outer = 1, inner = 1;
+  for (size_t d = 0; d < dim; ++d)
+    outer *= sizes[d];
+  for (size_t d = dim + 1; d < sizes.size(); ++d)
+    inner *= sizes[d];
+  return {outer, sizes[dim], inner};
+}
+
+// The first element of the contiguous tensor `t`.
+template <typename T> T *data_of(const TensorImpl &t) noexcept {
+  return reinterpret_cast<T *>(t.data_->get_blob()) +
+         static_cast<StridedLayout *>(t.view.get())->offset;
+}
+
 template <typename ForwardType>
   requires is_valid_forward<ForwardType>
 std::shared_ptr<TensorImpl> apply_no_grad_binary_op(const TensorImpl &lhs,
@@ -78,8 +148,16 @@ template <typename ForwardType>
   requires is_valid_forward<ForwardType>
 std::shared_ptr<TensorImpl> apply_cmp_op(const TensorImpl &lhs,
                                          const TensorImpl &rhs) {
+  if (__UNLIKELY(lhs.batched || rhs.batched)) {
+    auto [l, r] = batch_aligned(lhs, rhs);
+    auto ret = INNC::TensorImpl::create(
+        INNC::b8, StridedLayout{broadcast_range(l->size(), r->size())});
+    ForwardType::dispatch(l->dtype, r->dtype)(ret.get(), l.get(), r.get());
+    ret->batched = true;
+    return ret;
+  }
   auto ret = INNC::TensorImpl::create(
-      INNC::i8, StridedLayout{broadcast_range(lhs.size(), rhs.size())});
+      INNC::b8, StridedLayout{broadcast_range(lhs.size(), rhs.size())});
   ForwardType::dispatch(lhs.dtype, rhs.dtype)(ret.get(), &lhs, &rhs);
   return ret;
 }
@@ -97,8 +175,12 @@ template <typename ForwardType, typename BackwardType>
 std::shared_ptr<TensorImpl>
 apply_binary_operator(std::shared_ptr<TensorImpl> lhs,
                       std::shared_ptr<TensorImpl> rhs, bool order = false) {
+  bool batched = lhs->batched || rhs->batched;
+  if (__UNLIKELY(batched))
+    std::tie(lhs, rhs) = batch_aligned(*lhs, *rhs);
   auto ret = apply_no_grad_binary_op<ForwardType>(*lhs, *rhs, order);
-  if (!lhs->requires_grad && !rhs->requires_grad)
+  ret->batched = batched;
+  if (!lhs->tracks_grad() && !rhs->tracks_grad())
     return ret;
   ret->requires_grad = true;
   ret->grad_fn.reset(new BackwardType(ret.get(), {lhs, rhs}));
@@ -1,21 +1,52 @@
 #include "INNC/function.hpp"
 #include "INNC/dispatcher.hpp"
+#include "INNC/graph.hpp"
 #include "INNC/ops.hpp"
 #include "INNC/tensor.hpp"
 #include "INNC/tensorImpl.hpp"
 #include "INNC/types.hpp"
 #include "INNC/utils/utils.hpp"
+#include <algorithm>
 #include <memory>
+#include <unordered_set>
 
 namespace INNC {
 
 size_t Backward::global_back_version = 0;
+size_t Backward::graph_epoch = 0;
 
 Backward::Backward(
     TensorImpl *this_tf,
     const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs)
-    : input_tfs(input_tfs), this_tf(this_tf), n_outway(0),
-      accumulated_n_outway(0), back_version(0) {}
+    : input_tfs(input_tfs), this_tf(this_tf), back_version(0),
+      schedule_epoch(0) {}
+
+// Reversed post-order of an iterative DFS, so that every node comes after all
+// of the nodes consuming it.
+const std::vector<TensorImpl *> &Backward::get_schedule() {
+  if (!schedule.empty() && schedule_epoch == graph_epoch)
+    return schedule;
+  schedule.clear();
+  std::unordered_set<const Backward *> visited{this};
+  std::vector<std::pair<TensorImpl *, size_t>> stack{{this_tf, 0}};
+  while (!stack.empty()) {
+    auto t = stack.back().first;
+    auto i = stack.back().second++;
+    auto &inputs = t->grad_fn->input_tfs;
+    if (i < inputs.size()) {
+      auto it = inputs[i].get();
+      if (it->grad_fn.get() != nullptr &&
+          visited.insert(it->grad_fn.get()).second)
+        stack.emplace_back(it, 0);
+    } else {
+      schedule.push_back(t);
+      stack.pop_back();
+    }
+  }
+  std::reverse(schedule.begin(), schedule.end());
+  schedule_epoch = graph_epoch;
+  return schedule;
+}
 
 Backward::~Backward() = default;
 
@@ -23,6 +54,19 @@ void tensor_mul_add_f(TensorImpl &dst, TensorImpl &tf1, TensorImpl &tf2) {
   apply_no_grad_binary_op<native::tensor_mul_acc_f_helper>(dst, tf1, tf2);
 }
 
+// grad += from * scale without materializing `from` at the size of `grad`.
+void accumulate_scaled(TensorImpl &grad, const TensorImpl &from,
+                       double scale) {
+  // Reduces the broadcast dimensions of `from` in one pass, e.g. for the
+  // grad of a bias added to a whole batch.
+  if (broadcast_range(grad.view->sizes, from.view->sizes) == from.view->sizes)
+    native::tensor_sum_to_helper::dispatch(grad.dtype, from.dtype)(
+        &grad, &from, scale);
+  else
+    native::tensor_scale_acc_helper::dispatch(grad.dtype, from.dtype)(
+        &grad, &from, scale);
+}
+
 void Backward::try_accumulate_grad(TensorImpl *tf_prev, TensorImpl *tf_w,
                                    TensorImpl *tf_o) {
   if (!tf_prev->requires_grad)
@@ -31,26 +75,34 @@ void Backward::try_accumulate_grad(TensorImpl *tf_prev, TensorImpl *tf_w,
   if (tf_o == nullptr) {
     if (tf_w == nullptr)
       return;
-    *tf_prev->grad += *tf_w;
+    accumulate_scaled(*tf_prev->grad, *tf_w, 1.);
   } else if (is_float(tf_w->type()))
     tensor_mul_add_f(*tf_prev->grad.get(), *tf_w, *tf_o);
   else
     tensor_mul_add_f(*tf_prev->grad.get(), *tf_o, *tf_w);
 }
 
+void Backward::try_accumulate_scaled(TensorImpl *tf_prev, TensorImpl *tf_o,
+                                     double scale) {
+  if (!tf_prev->requires_grad)
+    return;
+  try_accumulate_update(tf_prev);
+  accumulate_scaled(*tf_prev->grad, *tf_o, scale);
+}
+
 void Backward::try_accumulate_update(TensorImpl *tf_prev, bool zero_init) {
   if (!tf_prev->requires_grad)
     return;
   if (tf_prev->grad_fn.get() != nullptr)
-    ++tf_prev->grad_fn->accumulated_n_outway;
+    tf_prev->grad_fn->back_version = global_back_version;
   if (tf_prev->grad.get() == nullptr) {
     tf_prev->grad = TensorImpl::create(tf_prev->dtype, tf_prev->view);
     if (zero_init)
-      tf_prev->grad->data_->zero_();
+      zero_storage(tf_prev->grad->data_);
   } else if (!tf_prev->grad->data_->is_alloc()) {
     tf_prev->grad->data_->alloc();
     if (zero_init)
-      tf_prev->grad->data_->zero_();
+      zero_storage(tf_prev->grad->data_);
   }
 }
 
@@ -63,8 +115,7 @@ void AddBack::step_back() {
 
 void SubBack::step_back() {
   try_accumulate_grad(input_tfs[0].get(), &get_out_grad());
-  try_accumulate_grad(input_tfs[1].get(), &get_out_grad(),
-                      TensorImpl::create(-1).get());
+  try_accumulate_scaled(input_tfs[1].get(), &get_out_grad(), -1.);
 }
 
 void MulBack::step_back() {
@@ -78,35 +129,63 @@ void tensor_div_back_numerator_f(TensorImpl &dst, TensorImpl &tf1,
                                                                     tf2);
 }
 void DivBack::step_back() {
-  try_accumulate_update(input_tfs[0].get());
-  tensor_div_back_numerator_f(*input_tfs[0]->grad, get_out_grad(),
-                              *input_tfs[1]);
-  try_accumulate_update(input_tfs[1].get());
-  native::tensor_div_back_denominator_helper::dispatch(input_tfs[1]->type(),
-                                                       this_tf->type())(
-      input_tfs[1]->grad.get(), &get_out_grad(), this_tf, input_tfs[1].get());
+  if (input_tfs[0]->requires_grad) {
+    try_accumulate_update(input_tfs[0].get());
+    tensor_div_back_numerator_f(*input_tfs[0]->grad, get_out_grad(),
+                                *input_tfs[1]);
+  }
+  if (input_tfs[1]->requires_grad) {
+    try_accumulate_update(input_tfs[1].get());
+    native::tensor_div_back_denominator_helper::dispatch(input_tfs[1]->type(),
+                                                         this_tf->type())(
+        input_tfs[1]->grad.get(), &get_out_grad(), this_tf,
+        input_tfs[1].get());
+  }
 }
 
 void SumBack::step_back() {
-  try_accumulate_grad(input_tfs[0].get(),
-                      TensorImpl::ones_like(*input_tfs[0]).get(),
-                      &get_out_grad());
+  try_accumulate_scaled(input_tfs[0].get(), &get_out_grad(), 1.);
 }
 
 void MeanBack::step_back() {
-  try_accumulate_grad(input_tfs[0].get(),
-                      TensorImpl::full(input_tfs[0]->view->sizes,
-                                       1. / ((double)input_tfs[0]->numel()),
-                                       input_tfs[0]->dtype)
-                          .get());
+  try_accumulate_scaled(input_tfs[0].get(), &get_out_grad(),
+                        1. / input_tfs[0]->numel());
 }
 
 void NoBack::step_back() { try_accumulate_grad(input_tfs[0].get(), nullptr); }
 
+void ReleasedBack::step_back() {
+  throw std::runtime_error("Trying to backward through the graph a second "
+                           "time. Pass retain_graph = true to the first "
+                           "backward.");
+}
+
 void CloneBack::step_back() {
   try_accumulate_grad(input_tfs[0].get(), &get_out_grad());
 }
 
+void ExpandBack::step_back() {
+  try_accumulate_grad(input_tfs[0].get(), &get_out_grad());
+}
+
+// Reads the grad of the storage through the layout of the input. Elements of
+// the input sharing a storage element split its grad evenly, so that reducing
+// them, e.g. through an expand, adds up to the grad of that element.
+void AsStridedBack::step_back() {
+  auto input = input_tfs[0].get();
+  if (!input->requires_grad)
+    return;
+  auto &grad = get_out_grad();
+  auto read = TensorImpl::create(grad.dtype, input->view, grad.data_);
+  auto count = TensorImpl::create(
+      grad.dtype, input->view,
+      std::make_shared<UntypedStorage>(grad.data_->get_size()));
+  zero_storage(count->data_);
+  accumulate_scaled(*count, *TensorImpl::ones(input->view->sizes, grad.dtype),
+                    1.);
+  try_accumulate_grad(input, (*read / *count).get());
+}
+
 CatBack::CatBack(
     TensorImpl *this_tf,
     const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
@@ -129,6 +208,116 @@ void CatBack::step_back() {
   }
 }
 
+MaskedFillBack::MaskedFillBack(
+    TensorImpl *this_tf,
+    const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+    const BitMask &mask)
+    : Backward(this_tf, input_tfs), mask(mask) {}
+
+void MaskedFillBack::step_back() {
+  auto grad = get_out_grad().detach()->masked_fill(mask, 0);
+  try_accumulate_grad(input_tfs[0].get(), grad.get());
+}
+
+IndexedBack::IndexedBack(
+    TensorImpl *this_tf,
+    const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+    size_t dim)
+    : Backward(this_tf, input_tfs), dim(dim) {}
+
+void GatherBack::step_back() {
+  auto &input = input_tfs[0];
+  auto grad = TensorImpl::scatter_add(
+      TensorImpl::zeros(input->view->sizes, this_tf->dtype), dim, input_tfs[1],
+      this_tf->grad);
+  try_accumulate_grad(input.get(), grad.get());
+}
+
+void ScatterBack::step_back() {
+  auto &src = input_tfs[2];
+  if (input_tfs[0]->requires_grad) {
+    auto grad = TensorImpl::scatter(
+        this_tf->grad, dim, input_tfs[1],
+        TensorImpl::zeros(src->view->sizes, this_tf->dtype));
+    try_accumulate_grad(input_tfs[0].get(), grad.get());
+  }
+  if (src->requires_grad) {
+    auto grad = TensorImpl::gather(this_tf->grad, dim, input_tfs[1]);
+    try_accumulate_grad(src.get(), grad.get());
+  }
+}
+
+void ScatterAddBack::step_back() {
+  try_accumulate_grad(input_tfs[0].get(), &get_out_grad());
+  if (input_tfs[2]->requires_grad) {
+    auto grad = TensorImpl::gather(this_tf->grad, dim, input_tfs[1]);
+    try_accumulate_grad(input_tfs[2].get(), grad.get());
+  }
+}
+
+void IndexSelectBack::step_back() {
+  auto &input = input_tfs[0];
+  auto grad = TensorImpl::index_add(
+      TensorImpl::zeros(input->view->sizes, this_tf->dtype), dim, input_tfs[1],
+      this_tf->grad);
+  try_accumulate_grad(input.get(), grad.get());
+}
+
+void IndexAddBack::step_back() {
+  try_accumulate_grad(input_tfs[0].get(), &get_out_grad());
+  if (input_tfs[2]->requires_grad) {
+    auto grad = TensorImpl::index_select(this_tf->grad, dim, input_tfs[1]);
+    try_accumulate_grad(input_tfs[2].get(), grad.get());
+  }
+}
+
+MaskedSelectBack::MaskedSelectBack(
+    TensorImpl *this_tf,
+    const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+    const BitMask &mask)
+    : Backward(this_tf, input_tfs), mask(mask) {}
+
+void MaskedSelectBack::step_back() {
+  auto &input = input_tfs[0];
+  auto grad = TensorImpl::zeros(input->view->sizes, this_tf->dtype);
+  native::tensor_masked_scatter_helper::dispatch(grad->dtype)(
+      grad.get(), this_tf->grad.get(), &mask);
+  try_accumulate_grad(input.get(), grad.get());
+}
+
+CheckpointBack::CheckpointBack(
+    TensorImpl *this_tf,
+    const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+    Fn fn, std::uint64_t seed, std::uint64_t offset)
+    : Backward(this_tf, input_tfs), fn(std::move(fn)), seed(seed),
+      offset(offset) {}
+
+// Recomputes the segment on detached inputs and back-propagates the output
+// grad through it with a nested backward of `sum(out * grad)`.
+void CheckpointBack::step_back() {
+  AutoGradMode enable_grad(true);
+  std::vector<std::shared_ptr<TensorImpl>> detached;
+  for (auto &t : input_tfs) {
+    detached.push_back(t->detach());
+    detached.back()->requires_grad = t->requires_grad;
+  }
+  std::shared_ptr<TensorImpl> out;
+  {
+    GeneratorStateGuard replay(default_generator(), seed, offset);
+    out = fn(detached);
+  }
+  if (out->requires_grad) {
+    auto root = (*out * *this_tf->grad)->sum();
+    // The enclosing pass keeps marking nodes with its own version.
+    auto version = global_back_version;
+    root->backward();
+    global_back_version = version;
+  }
+  for (size_t i = 0; i < input_tfs.size(); ++i)
+    if (detached[i]->grad.get() != nullptr)
+      try_accumulate_grad(input_tfs[i].get(), detached[i]->grad.get());
+}
+
 KnownGradBack::KnownGradBack(
     TensorImpl *this_tf,
     const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
@@ -139,6 +328,245 @@ void KnownGradBack::step_back() {
   try_accumulate_grad(input_tfs[0].get(), grad.get(), &get_out_grad());
 }
 
+UnaryMathBack::UnaryMathBack(
+    TensorImpl *this_tf,
+    const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+    unary_fn fn, bool fast)
+    : Backward(this_tf, input_tfs), fn(fn), fast(fast) {}
+
+void UnaryMathBack::step_back() {
+  auto input = input_tfs[0].get();
+  if (!input->requires_grad)
+    return;
+  try_accumulate_update(input);
+  bool from_input = fn == unary_fn::log || fn == unary_fn::gelu;
+  native::tensor_unary_math_back_helper::dispatch(input->dtype)(
+      input->grad.get(), &get_out_grad(), from_input ? input : this_tf, fn,
+      fast);
+}
+
+LinearBack::LinearBack(
+    TensorImpl *this_tf,
+    const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+    activation act, std::shared_ptr<INNC::TensorImpl> pre_act)
+    : Backward(this_tf, input_tfs), act(act), pre_act(std::move(pre_act)) {}
+
+// With dz = dy * act'(z), the grads are dx = dz * w, dw = dz^T * x and
+// db = sum(dz) over the rows. db is summed up by the GEMM of dw, which reads
+// every element of dz anyway.
+void LinearBack::step_back() {
+  auto &input = input_tfs[0], &weight = input_tfs[1];
+  bool bias_grad = input_tfs.size() == 3 && input_tfs[2]->requires_grad;
+  size_t n = weight->size(0), k = weight->size(1), m = 1;
+  for (size_t d = 0; d + 1 < input->dim(); ++d)
+    m *= input->view->sizes[d];
+  auto ct = linear_compute_type(input->dtype);
+  auto dz = contiguous_as(get_out_grad(), ct);
+  if (act != activation::none) {
+    auto z = pre_act != nullptr ? pre_act : contiguous_as(*this_tf, ct);
+    auto dy = dz;
+    dz = TensorImpl::create(ct, StridedLayout{SizeVec{m, n}});
+    visit_linear_type(ct, [&]<typename T>(T) {
+      native::activation_backward(data_of<T>(*dy), data_of<T>(*z),
+                                  data_of<T>(*dz), m * n, act);
+    });
+  }
+  if (input->requires_grad) {
+    auto w = contiguous_as(*weight, ct);
+    auto dx = TensorImpl::create(ct, StridedLayout{input->view->sizes});
+    visit_linear_type(ct, [&]<typename T>(T) {
+      native::gemm_epilogue(data_of<T>(*dz), n, 1, data_of<T>(*w), k, 1,
+                            data_of<T>(*dx), m, k, n, nullptr,
+                            activation::none, nullptr, nullptr);
+    });
+    try_accumulate_grad(input.get(), dx.get());
+  }
+  if (!weight->requires_grad) {
+    if (bias_grad)
+      try_accumulate_grad(input_tfs[2].get(), dz.get());
+    return;
+  }
+  auto x = contiguous_as(*input, ct);
+  auto dw = TensorImpl::create(ct, StridedLayout{SizeVec{n, k}});
+  auto db =
+      bias_grad ? TensorImpl::create(ct, StridedLayout{SizeVec{n}}) : nullptr;
+  visit_linear_type(ct, [&]<typename T>(T) {
+    native::gemm_epilogue(data_of<T>(*dz), 1, n, data_of<T>(*x), k, 1,
+                          data_of<T>(*dw), n, k, m, nullptr, activation::none,
+                          nullptr, db == nullptr ? nullptr : data_of<T>(*db));
+  });
+  try_accumulate_grad(weight.get(), dw.get());
+  if (bias_grad)
+    try_accumulate_grad(input_tfs[2].get(), db.get());
+}
+
+SoftmaxBack::SoftmaxBack(
+    TensorImpl *this_tf,
+    const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+    size_t dim, bool log)
+    : Backward(this_tf, input_tfs), dim(dim), log(log) {}
+
+void SoftmaxBack::step_back() {
+  auto &input = input_tfs[0];
+  if (!input->requires_grad)
+    return;
+  auto [outer, n, inner] = split_sizes_at(input->view->sizes, dim);
+  auto ct = linear_compute_type(input->dtype);
+  auto y = contiguous_as(*this_tf, ct);
+  auto dy = contiguous_as(get_out_grad(), ct);
+  auto dx = TensorImpl::create(ct, StridedLayout{input->view->sizes});
+  visit_linear_type(ct, [&]<typename T>(T) {
+    native::softmax_backward(data_of<T>(*y), data_of<T>(*dy), data_of<T>(*dx),
+                             outer, n, inner, log);
+  });
+  try_accumulate_grad(input.get(), dx.get());
+}
+
+CrossEntropyBack::CrossEntropyBack(
+    TensorImpl *this_tf,
+    const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+    std::shared_ptr<INNC::TensorImpl> lse)
+    : Backward(this_tf, input_tfs), lse(std::move(lse)) {}
+
+// d loss / dx = (softmax(x) - onehot(target)) * dy / rows, one pass over the
+// logits.
+void CrossEntropyBack::step_back() {
+  auto &input = input_tfs[0];
+  if (!input->requires_grad)
+    return;
+  size_t m = lse->numel(), n = input->size(-1);
+  auto ct = lse->dtype;
+  auto x = contiguous_as(*input, ct);
+  auto t = contiguous_as(*input_tfs[1], i64);
+  auto dy = contiguous_as(get_out_grad(), ct);
+  // A batched loss holds the mean of every example.
+  size_t groups = dy->numel(), group = groups == 0 ? 0 : m / groups;
+  auto scale = TensorImpl::create(ct, StridedLayout{SizeVec{groups}});
+  auto dx = TensorImpl::create(ct, StridedLayout{input->view->sizes});
+  visit_linear_type(ct, [&]<typename T>(T) {
+    for (size_t g = 0; g < groups; ++g)
+      data_of<T>(*scale)[g] = data_of<T>(*dy)[g] / T(group);
+    native::cross_entropy_backward(
+        data_of<T>(*x), data_of<std::int64_t>(*t), data_of<T>(*lse),
+        data_of<T>(*scale), std::max<size_t>(group, 1), data_of<T>(*dx), m, n);
+  });
+  try_accumulate_grad(input.get(), dx.get());
+}
+
+LayerNormBack::LayerNormBack(
+    TensorImpl *this_tf,
+    const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+    std::shared_ptr<INNC::TensorImpl> mean,
+    std::shared_ptr<INNC::TensorImpl> rstd)
+    : Backward(this_tf, input_tfs), mean(std::move(mean)),
+      rstd(std::move(rstd)) {}
+
+// dx, dw and db come from one kernel reading dy and the input once for the
+// parameters and twice for dx.
+void LayerNormBack::step_back() {
+  auto &input = input_tfs[0];
+  bool affine = input_tfs.size() == 3;
+  bool param_grad =
+      affine && (input_tfs[1]->requires_grad || input_tfs[2]->requires_grad);
+  if (!input->requires_grad && !param_grad)
+    return;
+  size_t m = mean->numel();
+  size_t n = affine ? input_tfs[1]->numel() : m == 0 ? 0 : input->numel() / m;
+  auto ct = mean->dtype;
+  auto x = contiguous_as(*input, ct);
+  auto dy = contiguous_as(get_out_grad(), ct);
+  auto w = affine ? contiguous_as(*input_tfs[1], ct) : nullptr;
+  auto dx = input->requires_grad
+                ? TensorImpl::create(ct, StridedLayout{input->view->sizes})
+                : nullptr;
+  auto dw = param_grad ? TensorImpl::create(
+                             ct, StridedLayout{input_tfs[1]->view->sizes})
+                       : nullptr;
+  auto db = param_grad ? TensorImpl::create(
+                             ct, StridedLayout{input_tfs[2]->view->sizes})
+                       : nullptr;
+  visit_linear_type(ct, [&]<typename T>(T) {
+    native::layer_norm_backward(
+        data_of<T>(*dy), data_of<T>(*x), data_of<T>(*mean), data_of<T>(*rstd),
+        w == nullptr ? nullptr : data_of<T>(*w),
+        dx == nullptr ? nullptr : data_of<T>(*dx),
+        dw == nullptr ? nullptr : data_of<T>(*dw),
+        db == nullptr ? nullptr : data_of<T>(*db), m, n);
+  });
+  if (dx != nullptr)
+    try_accumulate_grad(input.get(), dx.get());
+  if (param_grad && input_tfs[1]->requires_grad)
+    try_accumulate_grad(input_tfs[1].get(), dw.get());
+  if (param_grad && input_tfs[2]->requires_grad)
+    try_accumulate_grad(input_tfs[2].get(), db.get());
+}
+
+BatchNormBack::BatchNormBack(
+    TensorImpl *this_tf,
+    const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
+    std::shared_ptr<INNC::TensorImpl> mean,
+    std::shared_ptr<INNC::TensorImpl> var, double eps, bool training)
+    : Backward(this_tf, input_tfs), mean(std::move(mean)), var(std::move(var)),
+      eps(eps), training(training) {}
+
+// One kernel per channel sums dy and dy * (x - mean), which give dw and db,
+// then writes dx in a second pass.
+void BatchNormBack::step_back() {
+  auto &input = input_tfs[0];
+  bool affine = input_tfs.size() == 3;
+  bool param_grad =
+      affine && (input_tfs[1]->requires_grad || input_tfs[2]->requires_grad);
+  if (!input->requires_grad && !param_grad)
+    return;
+  auto [outer, c, inner] = split_sizes_at(input->view->sizes, 1);
+  auto ct = mean->dtype;
+  auto x = contiguous_as(*input, ct);
+  auto dy = contiguous_as(get_out_grad(), ct);
+  auto w = affine ? contiguous_as(*input_tfs[1], ct) : nullptr;
+  auto dx = input->requires_grad
+                ? TensorImpl::create(ct, StridedLayout{input->view->sizes})
+                : nullptr;
+  auto dw = param_grad ? TensorImpl::create(ct, StridedLayout{SizeVec{c}})
+                       : nullptr;
+  auto db = param_grad ? TensorImpl::create(ct, StridedLayout{SizeVec{c}})
+                       : nullptr;
+  visit_linear_type(ct, [&]<typename T>(T) {
+    native::batch_norm_backward(
+        data_of<T>(*dy), data_of<T>(*x), data_of<T>(*mean), data_of<T>(*var),
+        w == nullptr ? nullptr : data_of<T>(*w),
+        dx == nullptr ? nullptr : data_of<T>(*dx),
+        dw == nullptr ? nullptr : data_of<T>(*dw),
+        db == nullptr ? nullptr : data_of<T>(*db), outer, c, inner, eps,
+        training);
+  });
+  if (dx != nullptr)
+    try_accumulate_grad(input.get(), dx.get());
+  if (param_grad && input_tfs[1]->requires_grad)
+    try_accumulate_grad(input_tfs[1].get(), dw.get());
+  if (param_grad && input_tfs[2]->requires_grad)
+    try_accumulate_grad(input_tfs[2].get(), db.get());
+}
+
+DropoutBack::DropoutBack(
+    TensorImpl *this_tf,
+    const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs, double p,
+    std::uint64_t seed, std::uint64_t offset)
+    : Backward(this_tf, input_tfs), p(p), seed(seed), offset(offset) {}
+
+void DropoutBack::step_back() {
+  auto &input = input_tfs[0];
+  if (!input->requires_grad)
+    return;
+  auto ct = linear_compute_type(input->dtype);
+  auto dy = contiguous_as(get_out_grad(), ct);
+  auto dx = TensorImpl::create(ct, StridedLayout{input->view->sizes});
+  visit_linear_type(ct, [&]<typename T>(T) {
+    native::dropout(data_of<T>(*dy), data_of<T>(*dx), dx->numel(), p, seed,
+                    offset);
+  });
+  try_accumulate_grad(input.get(), dx.get());
+}
+
 SingletonBack::SingletonBack(
     TensorImpl *this_tf,
     const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_tfs,
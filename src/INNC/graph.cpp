@@ -0,0 +1,197 @@
+#include "INNC/graph.hpp"
+#include "INNC/function.hpp"
+#include "INNC/mask.hpp"
+#include "INNC/storage.hpp"
+#include "INNC/tensorImpl.hpp"
+#include <algorithm>
+
+namespace INNC {
+
+// Offsets in the arena are aligned for any vector load.
+constexpr size_t arena_alignment_ = 64;
+
+void Graph::capture_begin() {
+  run_expect(current_ == nullptr,
+             "Another graph is already being captured on this thread.");
+  reset();
+  current_ = this;
+}
+
+void Graph::capture_end() {
+  run_expect(current_ == this, "This graph is not being captured.");
+  current_ = nullptr;
+}
+
+void Graph::replay() const {
+  run_expect(current_ == nullptr, "Cannot replay a graph while capturing.");
+  for (auto &launch : launches)
+    launch.run();
+}
+
+void Graph::reset() noexcept {
+  launches.clear();
+  tensors.clear();
+  storages.clear();
+  keep_alive.clear();
+}
+
+void Graph::record_zero(const std::shared_ptr<UntypedStorage> &storage) {
+  storages.try_emplace(storage.get(), storage);
+  Launch launch;
+  launch.run = [s = storage.get()]() { s->zero_(); };
+  launch.accesses.push_back({storage.get(), true});
+  launches.push_back(std::move(launch));
+}
+
+TensorImpl *Graph::hold_(TensorImpl *t, std::vector<Access> &accesses) {
+  if (t == nullptr)
+    return t;
+  tensors.try_emplace(t, t->shared_from_this());
+  accesses.push_back({t->data_.get(), true});
+  return t;
+}
+
+const TensorImpl *Graph::hold_(const TensorImpl *t,
+                               std::vector<Access> &accesses) {
+  if (t == nullptr)
+    return t;
+  tensors.try_emplace(t, t->shared_from_this());
+  accesses.push_back({t->data_.get(), false});
+  return t;
+}
+
+// Masks are host-side values without shared ownership, so the graph keeps its
+// own copy of the mask seen at capture time.
+const BitMask *Graph::hold_(const BitMask *m, std::vector<Access> &) {
+  if (m == nullptr)
+    return m;
+  auto copy = std::make_shared<const BitMask>(*m);
+  keep_alive.push_back(copy);
+  return copy.get();
+}
+
+BitMask *Graph::hold_(BitMask *, std::vector<Access> &) {
+  throw std::runtime_error(
+      "Kernels writing into a BitMask cannot be captured into a Graph.");
+}
+
+// A tensor is internal if the graph and other internal tensors (through
+// `grad` and `grad_fn`) hold all of its references. A storage is internal if
+// internal tensors and the graph hold all of its references.
+std::unordered_set<const UntypedStorage *> Graph::internal_storages() const {
+  auto for_each_edge = [this](const TensorImpl *t, auto op) {
+    if (t->grad.get() != nullptr && tensors.contains(t->grad.get()))
+      op(t->grad.get());
+    if (t->grad_fn.get() != nullptr)
+      for (auto &input : t->grad_fn->input_tfs)
+        if (tensors.contains(input.get()))
+          op(input.get());
+  };
+  std::unordered_map<const TensorImpl *, long> refs;
+  for (auto &[t, held] : tensors)
+    ++refs[t];
+  for (auto &[t, held] : tensors)
+    for_each_edge(t, [&refs](const TensorImpl *u) { ++refs[u]; });
+  std::unordered_set<const TensorImpl *> external;
+  std::vector<const TensorImpl *> stack;
+  for (auto &[t, held] : tensors)
+    if (held.use_count() > refs[t] && external.insert(t).second)
+      stack.push_back(t);
+  while (!stack.empty()) {
+    auto t = stack.back();
+    stack.pop_back();
+    for_each_edge(t, [&](const TensorImpl *u) {
+      if (external.insert(u).second)
+        stack.push_back(u);
+    });
+  }
+
+  std::unordered_map<const UntypedStorage *, long> owners, uses;
+  for (auto &[s, held] : storages) {
+    ++owners[s];
+    uses[s] = held.use_count();
+  }
+  for (auto &[t, held] : tensors) {
+    auto s = t->data_.get();
+    uses[s] = t->data_.use_count();
+    if (!external.contains(t))
+      ++owners[s];
+  }
+  std::unordered_set<const UntypedStorage *> ret;
+  for (auto &[s, n] : owners)
+    if (n == uses[s])
+      ret.insert(s);
+  return ret;
+}
+
+Graph::MemoryPlan Graph::plan_memory() {
+  run_expect(current_ == nullptr,
+             "Cannot plan the memory of a graph while capturing it.");
+  struct Block {
+    UntypedStorage *storage;
+    size_t first, last; // live range in launches
+    bool first_write;   // the first launch only writes the storage
+    size_t size, offset;
+  };
+  std::unordered_map<const UntypedStorage *, Block> ranges;
+  for (size_t i = 0; i < launches.size(); ++i)
+    for (auto [s, write] : launches[i].accesses) {
+      auto [it, fresh] = ranges.try_emplace(s, Block{s, i, i, write, 0, 0});
+      auto &b = it->second;
+      if (b.first == i)
+        b.first_write = b.first_write && write;
+      b.last = i;
+    }
+
+  auto internal = internal_storages();
+  std::vector<Block> blocks;
+  MemoryPlan plan;
+  for (auto &[s, b] : ranges) {
+    if (!b.first_write || !internal.contains(s) || !s->is_alloc() ||
+        s->get_size() == 0)
+      continue;
+    b.size = (s->get_size() + arena_alignment_ - 1) / arena_alignment_ *
+             arena_alignment_;
+    blocks.push_back(b);
+    ++plan.storages;
+    plan.bytes += s->get_size();
+  }
+
+  // Greedy by size: place the largest blocks first, each at the lowest
+  // offset not used by a placed block whose live range overlaps.
+  std::sort(blocks.begin(), blocks.end(), [](const Block &l, const Block &r) {
+    return l.size != r.size ? l.size > r.size : l.first < r.first;
+  });
+  std::vector<const Block *> live;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    auto &b = blocks[i];
+    live.clear();
+    for (size_t j = 0; j < i; ++j)
+      if (blocks[j].first <= b.last && b.first <= blocks[j].last)
+        live.push_back(&blocks[j]);
+    std::sort(live.begin(), live.end(), [](const Block *l, const Block *r) {
+      return l->offset < r->offset;
+    });
+    b.offset = 0;
+    for (auto p : live) {
+      if (b.offset + b.size <= p->offset)
+        break;
+      b.offset = std::max(b.offset, p->offset + p->size);
+    }
+    plan.arena_bytes = std::max(plan.arena_bytes, b.offset + b.size);
+  }
+
+  if (blocks.empty())
+    return plan;
+  std::shared_ptr<uint8_t[]> arena(new uint8_t[plan.arena_bytes]);
+  for (auto &b : blocks)
+    b.storage->share_blob(arena, b.offset);
+  return plan;
+}
+
+void zero_storage(const std::shared_ptr<UntypedStorage> &storage) {
+  storage->zero_();
+  if (auto g = Graph::capturing())
+    g->record_zero(storage);
+}
+} // namespace INNC
@@ -3,6 +3,10 @@
 #include "INNC/storage.hpp"
 #include "INNC/tensorImpl.hpp"
 #include "INNC/types.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+#include <vector>
 
 namespace INNC {
 
@@ -58,6 +62,21 @@ size_t StridedLayout::cnt_from_index(const SizeVec &index) const {
   return pos;
 }
 
+size_t StridedLayout::cnt_from_aug_index(const SizeVec &index) const {
+  auto phy_dim = dim();
+  auto idx_dim = index.size();
+  size_t pos = offset;
+  for (size_t i = 1; i <= phy_dim; ++i) {
+    auto s = sizes[phy_dim - i];
+    if (__LIKELY(s != 1)) {
+      run_expect(index[idx_dim - i] < s, "the index ", index,
+                 " is out of range ", sizes.to_string());
+      pos += strides[phy_dim - i] * index[idx_dim - i];
+    }
+  }
+  return pos;
+}
+
 std::string StridedLayout::to_string_from_helper(const UntypedStorage &data_,
                                                  types dtype,
                                                  std::ptrdiff_t offset,
@@ -99,6 +118,24 @@ bool StridedLayout::is_contiguous() {
   return true;
 }
 
+bool StridedLayout::is_non_overlapping() const {
+  std::vector<std::pair<unsigned long long, size_t>> dims;
+  for (size_t d = 0; d < dim(); ++d) {
+    if (sizes[d] == 0)
+      return true;
+    if (sizes[d] > 1)
+      dims.emplace_back(std::abs(strides[d]), sizes[d]);
+  }
+  std::sort(dims.begin(), dims.end());
+  unsigned long long span = 0;
+  for (auto [stride, size] : dims) {
+    if (stride <= span)
+      return false;
+    span += stride * (size - 1);
+  }
+  return true;
+}
+
 std::shared_ptr<TensorImpl> StridedLayout::contiguous_from(TensorImpl &t) {
   return t.clone();
 }
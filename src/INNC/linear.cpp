@@ -0,0 +1,149 @@
+#include "INNC/linear.hpp"
+#include "INNC/utils/math.hpp"
+#include "INNC/utils/parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <type_traits>
+
+namespace INNC {
+namespace native {
+
+// Multiply-adds done by one thread at least.
+constexpr size_t gemm_grain_ = 1 << 16;
+// Rows of a sharing every load of b, and columns of c kept in registers and
+// L1 while they accumulate.
+constexpr size_t gemm_rows_ = 4, gemm_cols_ = 256;
+
+// gelu follows `use_fast_math` like `TensorImpl::gelu`.
+template <typename T> T apply_activation_(T z, activation act, bool fast) {
+  switch (act) {
+  case activation::relu:
+    return z > 0 ? z : T(0);
+  case activation::gelu:
+    if constexpr (std::is_same_v<T, float>)
+      if (fast)
+        return z * math::fast_normal_cdf(z);
+    return z * math::normal_cdf(z);
+  default:
+    return z;
+  }
+}
+
+// b is copied into panels of `gemm_cols_` columns, zero-padded at the end,
+// and every block of `gemm_rows_` rows sweeps each panel once. The inner loop
+// is then an axpy of fixed length on rows of the panel and of c, which
+// vectorizes, instead of a dot product whose reduction order the compiler
+// must keep.
+template <typename T>
+void gemm_epilogue_(const T *a, size_t a_rs, size_t a_cs, const T *b,
+                    size_t b_rs, size_t b_cs, T *c, size_t m, size_t n,
+                    size_t k, const T *bias, activation act, T *pre_act,
+                    T *a_sums) {
+  bool fast = fast_math();
+  size_t panels = (n + gemm_cols_ - 1) / gemm_cols_;
+  std::unique_ptr<T[]> packed(new T[panels * k * gemm_cols_]);
+  parallel_for(panels, gemm_grain_ / std::max<size_t>(1, k * gemm_cols_) + 1,
+               [&](size_t begin, size_t end, size_t) {
+                 for (size_t pn = begin; pn < end; ++pn) {
+                   T *dst = packed.get() + pn * k * gemm_cols_;
+                   size_t j0 = pn * gemm_cols_;
+                   size_t cols = std::min(gemm_cols_, n - j0);
+                   for (size_t p = 0; p < k; ++p) {
+                     for (size_t j = 0; j < cols; ++j)
+                       dst[p * gemm_cols_ + j] = b[p * b_rs + (j0 + j) * b_cs];
+                     std::fill(dst + p * gemm_cols_ + cols,
+                               dst + (p + 1) * gemm_cols_, T(0));
+                   }
+                 }
+               });
+  size_t blocks = (m + gemm_rows_ - 1) / gemm_rows_;
+  size_t grain = gemm_grain_ / std::max<size_t>(1, gemm_rows_ * n * k) + 1;
+  parallel_for(blocks, grain, [&](size_t begin, size_t end, size_t) {
+    T acc[gemm_rows_][gemm_cols_];
+    for (size_t blk = begin; blk < end; ++blk) {
+      size_t i0 = blk * gemm_rows_, rows = std::min(gemm_rows_, m - i0);
+      if (a_sums != nullptr)
+        std::fill(a_sums + i0, a_sums + i0 + rows, T(0));
+      for (size_t pn = 0; pn < panels; ++pn) {
+        size_t j0 = pn * gemm_cols_, cols = std::min(gemm_cols_, n - j0);
+        for (size_t r = 0; r < gemm_rows_; ++r)
+          for (size_t j = 0; j < cols; ++j)
+            acc[r][j] = bias != nullptr ? bias[j0 + j] : T(0);
+        const T *panel = packed.get() + pn * k * gemm_cols_;
+        for (size_t p = 0; p < k; ++p) {
+          T ar[gemm_rows_];
+          for (size_t r = 0; r < gemm_rows_; ++r)
+            ar[r] = r < rows ? a[(i0 + r) * a_rs + p * a_cs] : T(0);
+          if (a_sums != nullptr && pn == 0)
+            for (size_t r = 0; r < rows; ++r)
+              a_sums[i0 + r] += ar[r];
+          const T *bp = panel + p * gemm_cols_;
+          for (size_t j = 0; j < gemm_cols_; ++j) {
+            T bj = bp[j];
+            acc[0][j] += ar[0] * bj;
+            acc[1][j] += ar[1] * bj;
+            acc[2][j] += ar[2] * bj;
+            acc[3][j] += ar[3] * bj;
+          }
+        }
+        for (size_t r = 0; r < rows; ++r) {
+          T *cr = c + (i0 + r) * n + j0;
+          if (pre_act != nullptr)
+            std::copy(acc[r], acc[r] + cols, pre_act + (i0 + r) * n + j0);
+          for (size_t j = 0; j < cols; ++j)
+            cr[j] = apply_activation_(acc[r][j], act, fast);
+        }
+      }
+    }
+  });
+}
+
+void gemm_epilogue(const float *a, size_t a_rs, size_t a_cs, const float *b,
+                   size_t b_rs, size_t b_cs, float *c, size_t m, size_t n,
+                   size_t k, const float *bias, activation act,
+                   float *pre_act, float *a_sums) {
+  gemm_epilogue_(a, a_rs, a_cs, b, b_rs, b_cs, c, m, n, k, bias, act, pre_act,
+                 a_sums);
+}
+
+void gemm_epilogue(const double *a, size_t a_rs, size_t a_cs, const double *b,
+                   size_t b_rs, size_t b_cs, double *c, size_t m, size_t n,
+                   size_t k, const double *bias, activation act,
+                   double *pre_act, double *a_sums) {
+  gemm_epilogue_(a, a_rs, a_cs, b, b_rs, b_cs, c, m, n, k, bias, act, pre_act,
+                 a_sums);
+}
+
+// gelu'(x) = Phi(x) + x * phi(x) with the standard normal cdf Phi and pdf phi.
+template <typename T>
+void activation_backward_(const T *dy, const T *x, T *dz, size_t n,
+                          activation act) {
+  bool fast = std::is_same_v<T, float> && fast_math();
+  parallel_for(n, gemm_grain_, [&](size_t begin, size_t end, size_t) {
+    for (size_t i = begin; i < end; ++i) {
+      if (act == activation::relu)
+        dz[i] = x[i] > 0 ? dy[i] : T(0);
+      else if (act == activation::gelu)
+        dz[i] = dy[i] * (fast ? T(math::fast_normal_cdf(x[i]) +
+                                  x[i] * math::fast_normal_pdf(x[i]))
+                              : math::normal_cdf(x[i]) +
+                                    x[i] * math::normal_pdf(x[i]));
+      else
+        dz[i] = dy[i];
+    }
+  });
+}
+
+void activation_backward(const float *dy, const float *x, float *dz, size_t n,
+                         activation act) {
+  activation_backward_(dy, x, dz, n, act);
+}
+
+void activation_backward(const double *dy, const double *x, double *dz,
+                         size_t n, activation act) {
+  activation_backward_(dy, x, dz, n, act);
+}
+
+} // namespace native
+} // namespace INNC
@@ -0,0 +1,43 @@
+#include "INNC/mask.hpp"
+#include <algorithm>
+#include <bit>
+
+namespace INNC {
+
+BitMask::BitMask() : BitMask(SizeVec{}) {}
+
+BitMask::BitMask(const SizeVec &sizes) : sizes(sizes) {
+  words.resize((numel() + 63) / 64, 0);
+}
+
+size_t BitMask::numel() const noexcept {
+  size_t num = 1;
+  for (auto s : sizes)
+    num *= s;
+  return num;
+}
+
+bool BitMask::all() const noexcept {
+  size_t n = numel();
+  size_t full = n / 64;
+  if (!std::all_of(words.begin(), words.begin() + full,
+                   [](std::uint64_t w) { return w == ~std::uint64_t(0); }))
+    return false;
+  if (n % 64 == 0)
+    return true;
+  return words[full] == (std::uint64_t(1) << (n % 64)) - 1;
+}
+
+bool BitMask::any() const noexcept {
+  return std::any_of(words.begin(), words.end(),
+                     [](std::uint64_t w) { return w != 0; });
+}
+
+size_t BitMask::count() const noexcept {
+  size_t ret = 0;
+  for (auto w : words)
+    ret += std::popcount(w);
+  return ret;
+}
+
+} // namespace INNC
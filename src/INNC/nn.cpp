@@ -0,0 +1,86 @@
+#include "INNC/nn.hpp"
+#include <cmath>
+
+namespace INNC {
+namespace nn {
+
+Linear::Linear(size_t in_features, size_t out_features, bool bias,
+               activation act, types dtype)
+    : act(act), with_bias(bias) {
+  weight = Tensor::randn({out_features, in_features}, dtype) *
+           Tensor::full({}, 1 / std::sqrt(double(in_features)), dtype);
+  weight.requires_grad(true);
+  if (bias) {
+    this->bias = Tensor::zeros({out_features}, dtype);
+    this->bias.requires_grad(true);
+  }
+}
+
+Tensor Linear::forward(const Tensor &input) const {
+  return Tensor::linear(input, weight, bias, act);
+}
+
+std::vector<Tensor> Linear::parameters() const {
+  std::vector<Tensor> ret(with_bias ? 2 : 1);
+  ret[0] = weight;
+  if (with_bias)
+    ret[1] = bias;
+  return ret;
+}
+
+LayerNorm::LayerNorm(const SizeVec &normalized_shape, double eps, bool affine,
+                     types dtype)
+    : normalized_shape(normalized_shape), eps(eps), affine(affine) {
+  if (affine) {
+    weight = Tensor::ones(normalized_shape, dtype);
+    weight.requires_grad(true);
+    bias = Tensor::zeros(normalized_shape, dtype);
+    bias.requires_grad(true);
+  }
+}
+
+Tensor LayerNorm::forward(const Tensor &input) const {
+  return Tensor::layer_norm(input, normalized_shape, weight, bias, eps);
+}
+
+std::vector<Tensor> LayerNorm::parameters() const {
+  std::vector<Tensor> ret(affine ? 2 : 0);
+  if (affine) {
+    ret[0] = weight;
+    ret[1] = bias;
+  }
+  return ret;
+}
+
+BatchNorm::BatchNorm(size_t num_features, double eps, double momentum,
+                     bool affine, types dtype)
+    : running_mean(Tensor::zeros({num_features}, dtype)),
+      running_var(Tensor::ones({num_features}, dtype)), eps(eps),
+      momentum(momentum), affine(affine) {
+  if (affine) {
+    weight = Tensor::ones({num_features}, dtype);
+    weight.requires_grad(true);
+    bias = Tensor::zeros({num_features}, dtype);
+    bias.requires_grad(true);
+  }
+}
+
+Tensor BatchNorm::forward(const Tensor &input) const {
+  return Tensor::batch_norm(input, running_mean, running_var, weight, bias,
+                            training, momentum, eps);
+}
+
+std::vector<Tensor> BatchNorm::parameters() const {
+  std::vector<Tensor> ret(affine ? 2 : 0);
+  if (affine) {
+    ret[0] = weight;
+    ret[1] = bias;
+  }
+  return ret;
+}
+
+Tensor Dropout::forward(const Tensor &input) const {
+  return Tensor::dropout(input, p, training);
+}
+} // namespace nn
+} // namespace INNC
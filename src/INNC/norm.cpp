@@ -0,0 +1,370 @@
+#include "INNC/norm.hpp"
+#include "INNC/utils/lanes.hpp"
+#include "INNC/utils/parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace INNC {
+namespace native {
+
+// Elements handled by one thread at least.
+constexpr size_t norm_grain_ = 1 << 14;
+constexpr size_t lanes_ = reduce_lanes;
+
+// Running means and sums of squared deviations of every lane (Welford).
+template <typename T> struct Welford_ {
+  T cnt[lanes_] = {}, mean[lanes_] = {}, m2[lanes_] = {};
+
+  // Adds x[l] to lane l for l < w.
+  void add(const T *x, size_t w) {
+    for_lanes(w, [&](size_t l) {
+      cnt[l] += 1;
+      T d = x[l] - mean[l];
+      mean[l] += d / cnt[l];
+      m2[l] += d * (x[l] - mean[l]);
+    });
+  }
+
+  // Adds n elements spread over the lanes.
+  void add_run(const T *x, size_t n) {
+    for (size_t j = 0; j < n; j += lanes_)
+      add(x + j, std::min(lanes_, n - j));
+  }
+
+  // The mean and the biased variance of everything added, merging the lanes
+  // one by one as Chan et al. do.
+  std::pair<T, T> merge() const {
+    T n = 0, mu = 0, s = 0;
+    for (size_t l = 0; l < lanes_; ++l) {
+      if (cnt[l] == 0)
+        continue;
+      T nl = n + cnt[l], d = mean[l] - mu;
+      mu += d * cnt[l] / nl;
+      s += m2[l] + d * d * n * cnt[l] / nl;
+      n = nl;
+    }
+    return {mu, s / n};
+  }
+};
+
+template <typename T> T lane_sum_(const T *lane) {
+  T s = 0;
+  for (size_t l = 0; l < lanes_; ++l)
+    s += lane[l];
+  return s;
+}
+
+// Weights of one followed by biases of zero, standing in for a missing
+// affine transform of n elements so that no loop tests for it.
+template <typename T>
+void identity_affine_(std::vector<T> &buf, const T *&w, const T *&b,
+                      size_t n) {
+  if (w != nullptr)
+    return;
+  buf.assign(2 * n, T(0));
+  std::fill(buf.begin(), buf.begin() + n, T(1));
+  w = buf.data();
+  b = w + n;
+}
+
+template <typename T>
+void layer_norm_(const T *x, const T *w, const T *b, T *y, T *mean, T *rstd,
+                 size_t m, size_t n, double eps) {
+  std::vector<T> identity;
+  identity_affine_(identity, w, b, n);
+  parallel_for(m, norm_grain_ / std::max<size_t>(n, 1) + 1,
+               [&](size_t begin, size_t end, size_t) {
+                 for (size_t i = begin; i < end; ++i) {
+                   const T *xr = x + i * n;
+                   T *yr = y + i * n;
+                   Welford_<T> acc;
+                   acc.add_run(xr, n);
+                   auto [mu, var] = acc.merge();
+                   T r = 1 / std::sqrt(var + T(eps));
+                   mean[i] = mu;
+                   rstd[i] = r;
+                   for (size_t j = 0; j < n; j += lanes_)
+                     for_lanes(std::min(lanes_, n - j), [&](size_t l) {
+                       yr[j + l] = (xr[j + l] - mu) * r * w[j + l] + b[j + l];
+                     });
+                 }
+               });
+}
+
+void layer_norm(const float *x, const float *w, const float *b, float *y,
+                float *mean, float *rstd, size_t m, size_t n, double eps) {
+  layer_norm_(x, w, b, y, mean, rstd, m, n, eps);
+}
+
+void layer_norm(const double *x, const double *w, const double *b, double *y,
+                double *mean, double *rstd, size_t m, size_t n, double eps) {
+  layer_norm_(x, w, b, y, mean, rstd, m, n, eps);
+}
+
+// With g = dy * w and xhat = (x - mean) * rstd,
+// dx = rstd * (g - mean(g) - xhat * mean(g * xhat)) over every row. dw and db
+// are summed by every chunk of rows on its own, then over the chunks in
+// order.
+template <typename T>
+void layer_norm_backward_(const T *dy, const T *x, const T *mean,
+                          const T *rstd, const T *w, T *dx, T *dw, T *db,
+                          size_t m, size_t n) {
+  std::vector<T> identity;
+  const T *unused = nullptr;
+  identity_affine_(identity, w, unused, n);
+  size_t grain = norm_grain_ / std::max<size_t>(n, 1) + 1;
+  bool params = dw != nullptr;
+  std::vector<T> partial(params ? parallel_chunks(m, grain) * 2 * n : 0);
+  parallel_for(m, grain, [&](size_t begin, size_t end, size_t chunk) {
+    T *pw = params ? partial.data() + chunk * 2 * n : nullptr;
+    for (size_t i = begin; i < end; ++i) {
+      const T *dyr = dy + i * n, *xr = x + i * n;
+      T mu = mean[i], r = rstd[i];
+      if (params)
+        for (size_t j = 0; j < n; j += lanes_)
+          for_lanes(std::min(lanes_, n - j), [&](size_t l) {
+            pw[j + l] += dyr[j + l] * (xr[j + l] - mu) * r;
+            pw[n + j + l] += dyr[j + l];
+          });
+      if (dx == nullptr)
+        continue;
+      T sg[lanes_] = {}, sgx[lanes_] = {};
+      for (size_t j = 0; j < n; j += lanes_)
+        for_lanes(std::min(lanes_, n - j), [&](size_t l) {
+          T g = dyr[j + l] * w[j + l];
+          sg[l] += g;
+          sgx[l] += g * (xr[j + l] - mu);
+        });
+      T a = lane_sum_(sg) / T(n), c = lane_sum_(sgx) * r * r / T(n);
+      T *dxr = dx + i * n;
+      for (size_t j = 0; j < n; j += lanes_)
+        for_lanes(std::min(lanes_, n - j), [&](size_t l) {
+          dxr[j + l] =
+              r * (dyr[j + l] * w[j + l] - a - (xr[j + l] - mu) * c);
+        });
+    }
+  });
+  if (!params)
+    return;
+  std::fill(dw, dw + n, T(0));
+  std::fill(db, db + n, T(0));
+  for (size_t k = 0; k * 2 * n < partial.size(); ++k)
+    for (size_t j = 0; j < n; ++j) {
+      dw[j] += partial[k * 2 * n + j];
+      db[j] += partial[k * 2 * n + n + j];
+    }
+}
+
+void layer_norm_backward(const float *dy, const float *x, const float *mean,
+                         const float *rstd, const float *w, float *dx,
+                         float *dw, float *db, size_t m, size_t n) {
+  layer_norm_backward_(dy, x, mean, rstd, w, dx, dw, db, m, n);
+}
+
+void layer_norm_backward(const double *dy, const double *x,
+                         const double *mean, const double *rstd,
+                         const double *w, double *dx, double *dw, double *db,
+                         size_t m, size_t n) {
+  layer_norm_backward_(dy, x, mean, rstd, w, dx, dw, db, m, n);
+}
+
+// With inner == 1 the channels lie side by side, and blocks of `lanes_`
+// channels are processed together, one channel per lane. Otherwise every
+// channel is made of `outer` runs of `inner` elements and processed alone.
+template <typename T>
+void batch_norm_(const T *x, const T *w, const T *b, T *y, T *mean, T *var,
+                 size_t outer, size_t c, size_t inner, double eps,
+                 bool stats) {
+  std::vector<T> identity;
+  identity_affine_(identity, w, b, c);
+  if (inner == 1) {
+    size_t blocks = (c + lanes_ - 1) / lanes_;
+    parallel_for(
+        blocks, norm_grain_ / std::max<size_t>(outer * lanes_, 1) + 1,
+        [&](size_t begin, size_t end, size_t) {
+          for (size_t u = begin; u < end; ++u) {
+            size_t c0 = u * lanes_, wd = std::min(lanes_, c - c0);
+            if (stats) {
+              Welford_<T> acc;
+              for (size_t o = 0; o < outer; ++o)
+                acc.add(x + o * c + c0, wd);
+              for (size_t l = 0; l < wd; ++l) {
+                mean[c0 + l] = acc.mean[l];
+                var[c0 + l] = acc.m2[l] / acc.cnt[l];
+              }
+            }
+            T mu[lanes_], scale[lanes_], shift[lanes_];
+            for (size_t l = 0; l < wd; ++l) {
+              mu[l] = mean[c0 + l];
+              scale[l] = w[c0 + l] / std::sqrt(var[c0 + l] + T(eps));
+              shift[l] = b[c0 + l];
+            }
+            for (size_t o = 0; o < outer; ++o) {
+              const T *xr = x + o * c + c0;
+              T *yr = y + o * c + c0;
+              for_lanes(wd, [&](size_t l) {
+                yr[l] = (xr[l] - mu[l]) * scale[l] + shift[l];
+              });
+            }
+          }
+        });
+    return;
+  }
+  parallel_for(
+      c, norm_grain_ / std::max<size_t>(outer * inner, 1) + 1,
+      [&](size_t begin, size_t end, size_t) {
+        for (size_t ch = begin; ch < end; ++ch) {
+          if (stats) {
+            Welford_<T> acc;
+            for (size_t o = 0; o < outer; ++o)
+              acc.add_run(x + (o * c + ch) * inner, inner);
+            std::tie(mean[ch], var[ch]) = acc.merge();
+          }
+          T mu = mean[ch], scale = w[ch] / std::sqrt(var[ch] + T(eps)),
+            shift = b[ch];
+          for (size_t o = 0; o < outer; ++o) {
+            const T *xr = x + (o * c + ch) * inner;
+            T *yr = y + (o * c + ch) * inner;
+            for (size_t j = 0; j < inner; j += lanes_)
+              for_lanes(std::min(lanes_, inner - j), [&](size_t l) {
+                yr[j + l] = (xr[j + l] - mu) * scale + shift;
+              });
+          }
+        }
+      });
+}
+
+void batch_norm(const float *x, const float *w, const float *b, float *y,
+                float *mean, float *var, size_t outer, size_t c, size_t inner,
+                double eps, bool stats) {
+  batch_norm_(x, w, b, y, mean, var, outer, c, inner, eps, stats);
+}
+
+void batch_norm(const double *x, const double *w, const double *b, double *y,
+                double *mean, double *var, size_t outer, size_t c,
+                size_t inner, double eps, bool stats) {
+  batch_norm_(x, w, b, y, mean, var, outer, c, inner, eps, stats);
+}
+
+// The grads of one channel from s_dy = sum(dy) and s_dyx = sum(dy * (x -
+// mean)) over its M elements: db = s_dy, dw = s_dyx * rstd and
+// dx = k * dy - cx * (x - mean) - cc, where k = w * rstd, and cx and cc are
+// k * rstd^2 * s_dyx / M and k * s_dy / M if the statistics came from x, or
+// zero.
+template <typename T> struct ChannelGrad_ {
+  T k, cx, cc;
+  ChannelGrad_(T s_dy, T s_dyx, T w, T var, double eps, size_t m, bool stats,
+               T *dw, T *db) {
+    T r = 1 / std::sqrt(var + T(eps));
+    if (dw != nullptr) {
+      *dw = s_dyx * r;
+      *db = s_dy;
+    }
+    k = w * r;
+    cx = stats ? k * r * r * s_dyx / T(m) : T(0);
+    cc = stats ? k * s_dy / T(m) : T(0);
+  }
+};
+
+template <typename T>
+void batch_norm_backward_(const T *dy, const T *x, const T *mean,
+                          const T *var, const T *w, T *dx, T *dw, T *db,
+                          size_t outer, size_t c, size_t inner, double eps,
+                          bool stats) {
+  std::vector<T> identity;
+  const T *unused = nullptr;
+  identity_affine_(identity, w, unused, c);
+  size_t m = outer * inner;
+  if (inner == 1) {
+    size_t blocks = (c + lanes_ - 1) / lanes_;
+    parallel_for(
+        blocks, norm_grain_ / std::max<size_t>(outer * lanes_, 1) + 1,
+        [&](size_t begin, size_t end, size_t) {
+          for (size_t u = begin; u < end; ++u) {
+            size_t c0 = u * lanes_, wd = std::min(lanes_, c - c0);
+            T mu[lanes_] = {}, s_dy[lanes_] = {}, s_dyx[lanes_] = {};
+            std::copy(mean + c0, mean + c0 + wd, mu);
+            for (size_t o = 0; o < outer; ++o) {
+              const T *dyr = dy + o * c + c0, *xr = x + o * c + c0;
+              for_lanes(wd, [&](size_t l) {
+                s_dy[l] += dyr[l];
+                s_dyx[l] += dyr[l] * (xr[l] - mu[l]);
+              });
+            }
+            T k[lanes_], cx[lanes_], cc[lanes_];
+            for (size_t l = 0; l < wd; ++l) {
+              ChannelGrad_<T> g(s_dy[l], s_dyx[l], w[c0 + l], var[c0 + l],
+                                eps, m, stats,
+                                dw == nullptr ? nullptr : dw + c0 + l,
+                                db == nullptr ? nullptr : db + c0 + l);
+              k[l] = g.k;
+              cx[l] = g.cx;
+              cc[l] = g.cc;
+            }
+            if (dx == nullptr)
+              continue;
+            for (size_t o = 0; o < outer; ++o) {
+              const T *dyr = dy + o * c + c0, *xr = x + o * c + c0;
+              T *dxr = dx + o * c + c0;
+              for_lanes(wd, [&](size_t l) {
+                dxr[l] = k[l] * dyr[l] - cx[l] * (xr[l] - mu[l]) - cc[l];
+              });
+            }
+          }
+        });
+    return;
+  }
+  parallel_for(
+      c, norm_grain_ / std::max<size_t>(m, 1) + 1,
+      [&](size_t begin, size_t end, size_t) {
+        for (size_t ch = begin; ch < end; ++ch) {
+          T mu = mean[ch], s_dy[lanes_] = {}, s_dyx[lanes_] = {};
+          for (size_t o = 0; o < outer; ++o) {
+            const T *dyr = dy + (o * c + ch) * inner,
+                    *xr = x + (o * c + ch) * inner;
+            for (size_t j = 0; j < inner; j += lanes_)
+              for_lanes(std::min(lanes_, inner - j), [&](size_t l) {
+                s_dy[l] += dyr[j + l];
+                s_dyx[l] += dyr[j + l] * (xr[j + l] - mu);
+              });
+          }
+          ChannelGrad_<T> g(lane_sum_(s_dy), lane_sum_(s_dyx), w[ch], var[ch],
+                            eps, m, stats,
+                            dw == nullptr ? nullptr : dw + ch,
+                            db == nullptr ? nullptr : db + ch);
+          if (dx == nullptr)
+            continue;
+          for (size_t o = 0; o < outer; ++o) {
+            const T *dyr = dy + (o * c + ch) * inner,
+                    *xr = x + (o * c + ch) * inner;
+            T *dxr = dx + (o * c + ch) * inner;
+            for (size_t j = 0; j < inner; j += lanes_)
+              for_lanes(std::min(lanes_, inner - j), [&](size_t l) {
+                dxr[j + l] = g.k * dyr[j + l] - g.cx * (xr[j + l] - mu) - g.cc;
+              });
+          }
+        }
+      });
+}
+
+void batch_norm_backward(const float *dy, const float *x, const float *mean,
+                         const float *var, const float *w, float *dx,
+                         float *dw, float *db, size_t outer, size_t c,
+                         size_t inner, double eps, bool stats) {
+  batch_norm_backward_(dy, x, mean, var, w, dx, dw, db, outer, c, inner, eps,
+                       stats);
+}
+
+void batch_norm_backward(const double *dy, const double *x,
+                         const double *mean, const double *var,
+                         const double *w, double *dx, double *dw, double *db,
+                         size_t outer, size_t c, size_t inner, double eps,
+                         bool stats) {
+  batch_norm_backward_(dy, x, mean, var, w, dx, dw, db, outer, c, inner, eps,
+                       stats);
+}
+
+} // namespace native
+} // namespace INNC
@@ -0,0 +1,139 @@
+#include "INNC/optim.hpp"
+#include "INNC/exceptions.hpp"
+#include "INNC/graph.hpp"
+#include "INNC/tensorImpl.hpp"
+#include "INNC/types.hpp"
+#include "INNC/utils/parallel.hpp"
+#include "INNC/utils/utils.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace INNC {
+namespace optim {
+
+// Elements updated by one thread at least.
+constexpr size_t step_grain_ = 1 << 15;
+
+Optimizer::Optimizer(const std::vector<Tensor> &params, double lr) : lr(lr) {
+  for (const auto &p : params) {
+    run_expect(p.fptr != nullptr, "Cannot optimize an empty tensor.");
+    run_expect(is_float(p.fptr->dtype), "Only float tensors can be optimized.");
+    run_expect(p.fptr->dlayout == layouts::strided && p.is_contiguous(),
+               "Optimized tensors must be contiguous.");
+    this->params.push_back(p.fptr);
+  }
+}
+
+Optimizer::~Optimizer() = default;
+
+void Optimizer::zero_grad() const noexcept {
+  for (auto &p : params)
+    p->zero_grad();
+}
+
+std::vector<std::shared_ptr<TensorImpl>> Optimizer::make_state() const {
+  std::vector<std::shared_ptr<TensorImpl>> ret;
+  for (auto &p : params)
+    ret.push_back(TensorImpl::zeros(p->view->sizes, p->dtype));
+  return ret;
+}
+
+void Optimizer::multi_tensor_apply(
+    const std::function<void(size_t, size_t, size_t)> &update) const {
+  expect_not_capturing("Optimizer::step");
+  std::vector<size_t> active, starts;
+  size_t total = 0;
+  for (size_t i = 0; i < params.size(); ++i) {
+    auto &g = params[i]->grad;
+    if (g == nullptr || !g->data_->is_alloc() || params[i]->numel() == 0)
+      continue;
+    run_expect(g->dtype == params[i]->dtype && g->is_contiguous() &&
+                   g->view->sizes == params[i]->view->sizes,
+               "The grad of an optimized tensor must be contiguous and "
+               "match it.");
+    active.push_back(i);
+    starts.push_back(total);
+    total += params[i]->numel();
+  }
+  parallel_for(total, step_grain_, [&](size_t begin, size_t end, size_t) {
+    size_t k = std::upper_bound(starts.begin(), starts.end(), begin) -
+               starts.begin() - 1;
+    for (; begin < end; ++k) {
+      size_t stop = std::min(end, starts[k] + params[active[k]]->numel());
+      update(active[k], begin - starts[k], stop - starts[k]);
+      begin = stop;
+    }
+  });
+}
+
+SGD::SGD(const std::vector<Tensor> &params, double lr, double momentum,
+         double weight_decay, bool nesterov)
+    : Optimizer(params, lr), momentum(momentum), weight_decay(weight_decay),
+      nesterov(nesterov) {
+  run_expect(!nesterov || momentum != 0,
+             "Nesterov momentum needs a nonzero momentum.");
+}
+
+void SGD::step() {
+  // Starting from zero, the buffers hold the first grad after one step.
+  if (momentum != 0 && buffers.empty())
+    buffers = make_state();
+  multi_tensor_apply([&](size_t i, size_t begin, size_t end) {
+    visit_float_type(params[i]->dtype, [&]<typename T>(T) {
+      // Reduced floats are updated in f32.
+      using A = linear_compute_t<T>;
+      auto p = data_of<T>(*params[i]), g = data_of<T>(*params[i]->grad);
+      T *buf = momentum != 0 ? data_of<T>(*buffers[i]) : nullptr;
+      const A lr_ = lr, mom = momentum, wd = weight_decay;
+      for (size_t j = begin; j < end; ++j) {
+        A d = A(g[j]) + wd * A(p[j]);
+        if (buf != nullptr) {
+          A b = mom * A(buf[j]) + d;
+          buf[j] = b;
+          d = nesterov ? d + mom * b : b;
+        }
+        p[j] = A(p[j]) - lr_ * d;
+      }
+    });
+  });
+}
+
+Adam::Adam(const std::vector<Tensor> &params, double lr, double beta1,
+           double beta2, double eps, double weight_decay)
+    : Optimizer(params, lr), beta1(beta1), beta2(beta2), eps(eps),
+      weight_decay(weight_decay), exp_avg(make_state()),
+      exp_avg_sq(make_state()) {}
+
+void Adam::step() {
+  ++steps;
+  double bias1 = 1 - std::pow(beta1, steps),
+         bias2 = 1 - std::pow(beta2, steps);
+  multi_tensor_apply([&](size_t i, size_t begin, size_t end) {
+    visit_float_type(params[i]->dtype, [&]<typename T>(T) {
+      using A = linear_compute_t<T>;
+      auto p = data_of<T>(*params[i]), g = data_of<T>(*params[i]->grad);
+      auto m = data_of<T>(*exp_avg[i]), v = data_of<T>(*exp_avg_sq[i]);
+      const A b1 = beta1, b2 = beta2, eps_ = eps;
+      const A step_size = lr / bias1, rsqrt_bias2 = 1 / std::sqrt(bias2);
+      const A l2 = decoupled ? 0 : weight_decay,
+              shrink = decoupled ? 1 - lr * weight_decay : 1;
+      for (size_t j = begin; j < end; ++j) {
+        A x = A(p[j]) * shrink;
+        A d = A(g[j]) + l2 * x;
+        A m_ = b1 * A(m[j]) + (1 - b1) * d;
+        A v_ = b2 * A(v[j]) + (1 - b2) * d * d;
+        m[j] = m_;
+        v[j] = v_;
+        p[j] = x - step_size * m_ / (std::sqrt(v_) * rsqrt_bias2 + eps_);
+      }
+    });
+  });
+}
+
+AdamW::AdamW(const std::vector<Tensor> &params, double lr, double beta1,
+             double beta2, double eps, double weight_decay)
+    : Adam(params, lr, beta1, beta2, eps, weight_decay) {
+  decoupled = true;
+}
+} // namespace optim
+} // namespace INNC
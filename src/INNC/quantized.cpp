@@ -0,0 +1,137 @@
+#include "INNC/quantized.hpp"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+#define INNC_DPBUSD_ _mm256_dpbusd_epi32
+#elif defined(__AVXVNNI__)
+#define INNC_DPBUSD_ _mm256_dpbusd_avx_epi32
+#endif
+
+namespace INNC {
+namespace native {
+
+#if defined(__AVX2__)
+static inline std::int32_t hsum_epi32(__m256i v) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+#endif
+
+#if defined(INNC_DPBUSD_)
+// dpbusd multiplies unsigned by signed bytes, so a is biased by 128 and the
+// surplus 128 * sum(b) is subtracted afterwards.
+void gemm_s8s8s32(const std::int8_t *a, const std::int8_t *bt, std::int32_t *c,
+                  size_t m, size_t n, size_t k) {
+  std::unique_ptr<std::uint8_t[]> au(new std::uint8_t[k]);
+  std::unique_ptr<std::int32_t[]> bias(new std::int32_t[n]);
+  for (size_t j = 0; j < n; ++j) {
+    std::int32_t s = 0;
+    for (size_t p = 0; p < k; ++p)
+      s += bt[j * k + p];
+    bias[j] = 128 * s;
+  }
+  const size_t kv = k / 32 * 32;
+  for (size_t i = 0; i < m; ++i) {
+    for (size_t p = 0; p < k; ++p)
+      au[p] = static_cast<std::uint8_t>(a[i * k + p] ^ 0x80);
+    for (size_t j = 0; j < n; ++j) {
+      const std::int8_t *b = bt + j * k;
+      __m256i acc = _mm256_setzero_si256();
+      for (size_t p = 0; p < kv; p += 32)
+        acc = INNC_DPBUSD_(
+            acc, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&au[p])),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + p)));
+      std::int32_t s = hsum_epi32(acc);
+      for (size_t p = kv; p < k; ++p)
+        s += std::int32_t(au[p]) * b[p];
+      c[i * n + j] = s - bias[j];
+    }
+  }
+}
+#elif defined(__AVX2__)
+// Sign-extends both operands to 16 bits and accumulates pairs with madd.
+void gemm_s8s8s32(const std::int8_t *a, const std::int8_t *bt, std::int32_t *c,
+                  size_t m, size_t n, size_t k) {
+  const size_t kv = k / 16 * 16;
+  for (size_t i = 0; i < m; ++i) {
+    const std::int8_t *ar = a + i * k;
+    for (size_t j = 0; j < n; ++j) {
+      const std::int8_t *b = bt + j * k;
+      __m256i acc = _mm256_setzero_si256();
+      for (size_t p = 0; p < kv; p += 16) {
+        __m256i va = _mm256_cvtepi8_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(ar + p)));
+        __m256i vb = _mm256_cvtepi8_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + p)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+      }
+      std::int32_t s = hsum_epi32(acc);
+      for (size_t p = kv; p < k; ++p)
+        s += std::int32_t(ar[p]) * b[p];
+      c[i * n + j] = s;
+    }
+  }
+}
+#else
+void gemm_s8s8s32(const std::int8_t *a, const std::int8_t *bt, std::int32_t *c,
+                  size_t m, size_t n, size_t k) {
+  for (size_t i = 0; i < m; ++i) {
+    const std::int8_t *ar = a + i * k;
+    for (size_t j = 0; j < n; ++j) {
+      const std::int8_t *b = bt + j * k;
+      std::int32_t s = 0;
+      for (size_t p = 0; p < k; ++p)
+        s += std::int32_t(ar[p]) * b[p];
+      c[i * n + j] = s;
+    }
+  }
+}
+#endif
+
+// sum_p (a_ip - za)(b_pj - zb_j)
+//   = sum_p a_ip b_pj - zb_j sum_p a_ip - za sum_p b_pj + k za zb_j
+void gemm_s8_zero_point_fix(std::int32_t *c, const std::int8_t *a,
+                            const std::int8_t *bt, size_t m, size_t n, size_t k,
+                            std::int32_t za, const std::int32_t *zb,
+                            size_t zb_n) {
+  std::unique_ptr<std::int32_t[]> col_sum(new std::int32_t[n]);
+  for (size_t j = 0; j < n; ++j) {
+    std::int32_t s = 0;
+    for (size_t p = 0; p < k; ++p)
+      s += bt[j * k + p];
+    col_sum[j] = s;
+  }
+  const std::int32_t ik = static_cast<std::int32_t>(k);
+  for (size_t i = 0; i < m; ++i) {
+    std::int32_t row_sum = 0;
+    for (size_t p = 0; p < k; ++p)
+      row_sum += a[i * k + p];
+    for (size_t j = 0; j < n; ++j) {
+      std::int32_t z = zb[zb_n == n ? j : 0];
+      c[i * n + j] += ik * za * z - z * row_sum - za * col_sum[j];
+    }
+  }
+}
+
+void requantize_s32_s8(const std::int32_t *acc, std::int8_t *dst, size_t m,
+                       size_t n, const float *multiplier, size_t mul_n,
+                       std::int32_t zero_point) {
+  for (size_t i = 0; i < m; ++i)
+    for (size_t j = 0; j < n; ++j) {
+      float v = std::nearbyint(acc[i * n + j] * multiplier[mul_n == n ? j : 0]);
+      dst[i * n + j] = static_cast<std::int8_t>(
+          std::clamp<float>(v + zero_point, -128.f, 127.f));
+    }
+}
+
+} // namespace native
+} // namespace INNC
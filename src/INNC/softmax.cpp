@@ -0,0 +1,310 @@
+#include "INNC/softmax.hpp"
+#include "INNC/exceptions.hpp"
+#include "INNC/utils/lanes.hpp"
+#include "INNC/utils/math.hpp"
+#include "INNC/utils/parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+namespace INNC {
+namespace native {
+
+// Elements handled by one thread at least.
+constexpr size_t softmax_grain_ = 1 << 14;
+constexpr size_t lanes_ = reduce_lanes;
+
+// Calls `f(exp)` with the exp used for T, following `use_fast_math`.
+template <typename T, typename F> void visit_exp_(F &&f) {
+  if constexpr (std::is_same_v<T, float>)
+    if (fast_math())
+      return f([](float v) { return math::fast_exp(v); });
+  f([](T v) { return std::exp(v); });
+}
+
+template <typename T> T lane_max_(const T *x, size_t n) {
+  T lane[lanes_];
+  std::fill(lane, lane + lanes_, -std::numeric_limits<T>::infinity());
+  for (size_t j = 0; j < n; j += lanes_)
+    for_lanes(std::min(lanes_, n - j),
+              [&](size_t l) { lane[l] = std::max(lane[l], x[j + l]); });
+  return *std::max_element(lane, lane + lanes_);
+}
+
+template <typename T> T lane_sum_(const T *lane) {
+  T s = 0;
+  for (size_t l = 0; l < lanes_; ++l)
+    s += lane[l];
+  return s;
+}
+
+// sum(exp(x - shift)) over a row, storing the terms in y unless null.
+template <typename T, typename Exp>
+T exp_sum_(const T *x, T *y, size_t n, T shift, Exp exp) {
+  T lane[lanes_] = {};
+  for (size_t j = 0; j < n; j += lanes_) {
+    size_t w = std::min(lanes_, n - j);
+    if (y == nullptr)
+      for_lanes(w, [&](size_t l) { lane[l] += exp(x[j + l] - shift); });
+    else
+      for_lanes(w, [&](size_t l) {
+        T e = exp(x[j + l] - shift);
+        y[j + l] = e;
+        lane[l] += e;
+      });
+  }
+  return lane_sum_(lane);
+}
+
+template <typename T, typename Exp>
+void softmax_row_(const T *x, T *y, size_t n, bool log, Exp exp) {
+  T mx = lane_max_(x, n);
+  if (log) {
+    // The maximum is subtracted first, which is exact near it, so that
+    // large logits keep the precision of the result.
+    T c = std::log(exp_sum_(x, (T *)nullptr, n, mx, exp));
+    for (size_t j = 0; j < n; j += lanes_)
+      for_lanes(std::min(lanes_, n - j),
+                [&](size_t l) { y[j + l] = (x[j + l] - mx) - c; });
+  } else {
+    T r = 1 / exp_sum_(x, y, n, mx, exp);
+    for (size_t j = 0; j < n; j += lanes_)
+      for_lanes(std::min(lanes_, n - j), [&](size_t l) { y[j + l] *= r; });
+  }
+}
+
+// Runs of n contiguous elements.
+template <typename T, typename Exp>
+void softmax_rows_(const T *x, T *y, size_t m, size_t n, bool log, Exp exp) {
+  parallel_for(m, softmax_grain_ / std::max<size_t>(n, 1) + 1,
+               [&](size_t begin, size_t end, size_t) {
+                 for (size_t i = begin; i < end; ++i)
+                   softmax_row_(x + i * n, y + i * n, n, log, exp);
+               });
+}
+
+// Runs of n elements `inner` apart. Blocks of `lanes_` neighbouring runs
+// are reduced together, one run per lane.
+template <typename T, typename Exp>
+void softmax_cols_(const T *x, T *y, size_t outer, size_t n, size_t inner,
+                   bool log, Exp exp) {
+  size_t blocks = (inner + lanes_ - 1) / lanes_;
+  parallel_for(
+      outer * blocks,
+      softmax_grain_ / std::max<size_t>(n * lanes_, 1) + 1,
+      [&](size_t begin, size_t end, size_t) {
+        for (size_t u = begin; u < end; ++u) {
+          size_t c = u % blocks * lanes_, w = std::min(lanes_, inner - c);
+          const T *xb = x + u / blocks * n * inner + c;
+          T *yb = y + u / blocks * n * inner + c;
+          T mx[lanes_], s[lanes_] = {};
+          std::fill(mx, mx + lanes_, -std::numeric_limits<T>::infinity());
+          for (size_t j = 0; j < n; ++j)
+            for_lanes(w, [&](size_t l) {
+              mx[l] = std::max(mx[l], xb[j * inner + l]);
+            });
+          for (size_t j = 0; j < n; ++j)
+            for_lanes(w, [&](size_t l) {
+              T e = exp(xb[j * inner + l] - mx[l]);
+              yb[j * inner + l] = e;
+              s[l] += e;
+            });
+          if (log) {
+            for (size_t l = 0; l < w; ++l)
+              s[l] = std::log(s[l]);
+            for (size_t j = 0; j < n; ++j)
+              for_lanes(w, [&](size_t l) {
+                yb[j * inner + l] = (xb[j * inner + l] - mx[l]) - s[l];
+              });
+          } else {
+            for (size_t l = 0; l < w; ++l)
+              s[l] = 1 / s[l];
+            for (size_t j = 0; j < n; ++j)
+              for_lanes(w, [&](size_t l) { yb[j * inner + l] *= s[l]; });
+          }
+        }
+      });
+}
+
+template <typename T>
+void softmax_(const T *x, T *y, size_t outer, size_t n, size_t inner,
+              bool log) {
+  visit_exp_<T>([&](auto exp) {
+    if (inner == 1)
+      softmax_rows_(x, y, outer, n, log, exp);
+    else
+      softmax_cols_(x, y, outer, n, inner, log, exp);
+  });
+}
+
+void softmax(const float *x, float *y, size_t outer, size_t n, size_t inner,
+             bool log) {
+  softmax_(x, y, outer, n, inner, log);
+}
+
+void softmax(const double *x, double *y, size_t outer, size_t n, size_t inner,
+             bool log) {
+  softmax_(x, y, outer, n, inner, log);
+}
+
+// softmax: dx = y * (dy - sum(dy * y)), log-softmax: dx = dy - e^y * sum(dy).
+template <typename T, typename Exp>
+void softmax_backward_row_(const T *y, const T *dy, T *dx, size_t n, bool log,
+                           Exp exp) {
+  T lane[lanes_] = {};
+  for (size_t j = 0; j < n; j += lanes_) {
+    size_t w = std::min(lanes_, n - j);
+    if (log)
+      for_lanes(w, [&](size_t l) { lane[l] += dy[j + l]; });
+    else
+      for_lanes(w, [&](size_t l) { lane[l] += dy[j + l] * y[j + l]; });
+  }
+  T s = lane_sum_(lane);
+  for (size_t j = 0; j < n; j += lanes_) {
+    size_t w = std::min(lanes_, n - j);
+    if (log)
+      for_lanes(w,
+                [&](size_t l) { dx[j + l] = dy[j + l] - exp(y[j + l]) * s; });
+    else
+      for_lanes(w, [&](size_t l) { dx[j + l] = y[j + l] * (dy[j + l] - s); });
+  }
+}
+
+template <typename T, typename Exp>
+void softmax_backward_rows_(const T *y, const T *dy, T *dx, size_t m, size_t n,
+                            bool log, Exp exp) {
+  parallel_for(m, softmax_grain_ / std::max<size_t>(n, 1) + 1,
+               [&](size_t begin, size_t end, size_t) {
+                 for (size_t i = begin; i < end; ++i)
+                   softmax_backward_row_(y + i * n, dy + i * n, dx + i * n, n,
+                                         log, exp);
+               });
+}
+
+template <typename T, typename Exp>
+void softmax_backward_cols_(const T *y, const T *dy, T *dx, size_t outer,
+                            size_t n, size_t inner, bool log, Exp exp) {
+  size_t blocks = (inner + lanes_ - 1) / lanes_;
+  parallel_for(
+      outer * blocks,
+      softmax_grain_ / std::max<size_t>(n * lanes_, 1) + 1,
+      [&](size_t begin, size_t end, size_t) {
+        for (size_t u = begin; u < end; ++u) {
+          size_t c = u % blocks * lanes_, w = std::min(lanes_, inner - c);
+          size_t base = u / blocks * n * inner + c;
+          const T *yb = y + base, *dyb = dy + base;
+          T *dxb = dx + base;
+          T s[lanes_] = {};
+          for (size_t j = 0; j < n; ++j)
+            if (log)
+              for_lanes(w, [&](size_t l) { s[l] += dyb[j * inner + l]; });
+            else
+              for_lanes(w, [&](size_t l) {
+                s[l] += dyb[j * inner + l] * yb[j * inner + l];
+              });
+          for (size_t j = 0; j < n; ++j)
+            if (log)
+              for_lanes(w, [&](size_t l) {
+                dxb[j * inner + l] =
+                    dyb[j * inner + l] - exp(yb[j * inner + l]) * s[l];
+              });
+            else
+              for_lanes(w, [&](size_t l) {
+                dxb[j * inner + l] =
+                    yb[j * inner + l] * (dyb[j * inner + l] - s[l]);
+              });
+        }
+      });
+}
+
+template <typename T>
+void softmax_backward_(const T *y, const T *dy, T *dx, size_t outer, size_t n,
+                       size_t inner, bool log) {
+  visit_exp_<T>([&](auto exp) {
+    if (inner == 1)
+      softmax_backward_rows_(y, dy, dx, outer, n, log, exp);
+    else
+      softmax_backward_cols_(y, dy, dx, outer, n, inner, log, exp);
+  });
+}
+
+void softmax_backward(const float *y, const float *dy, float *dx, size_t outer,
+                      size_t n, size_t inner, bool log) {
+  softmax_backward_(y, dy, dx, outer, n, inner, log);
+}
+
+void softmax_backward(const double *y, const double *dy, double *dx,
+                      size_t outer, size_t n, size_t inner, bool log) {
+  softmax_backward_(y, dy, dx, outer, n, inner, log);
+}
+
+void expect_class_(std::int64_t t, size_t n) {
+  run_expect(t >= 0 && static_cast<size_t>(t) < n, "Target ", t,
+             " is out of range for ", n, " classes.");
+}
+
+// The logits are read twice and no probability is stored.
+template <typename T>
+void cross_entropy_(const T *x, const std::int64_t *target, T *loss, T *lse,
+                    size_t m, size_t n) {
+  visit_exp_<T>([&](auto exp) {
+    parallel_for(m, softmax_grain_ / std::max<size_t>(n, 1) + 1,
+                 [&](size_t begin, size_t end, size_t) {
+                   for (size_t i = begin; i < end; ++i) {
+                     expect_class_(target[i], n);
+                     const T *xr = x + i * n;
+                     T mx = lane_max_(xr, n);
+                     T c = std::log(exp_sum_(xr, (T *)nullptr, n, mx, exp));
+                     lse[i] = mx + c;
+                     loss[i] = (mx - xr[target[i]]) + c;
+                   }
+                 });
+  });
+}
+
+void cross_entropy(const float *x, const std::int64_t *target, float *loss,
+                   float *lse, size_t m, size_t n) {
+  cross_entropy_(x, target, loss, lse, m, n);
+}
+
+void cross_entropy(const double *x, const std::int64_t *target, double *loss,
+                   double *lse, size_t m, size_t n) {
+  cross_entropy_(x, target, loss, lse, m, n);
+}
+
+template <typename T>
+void cross_entropy_backward_(const T *x, const std::int64_t *target,
+                             const T *lse, const T *scale, size_t group,
+                             T *dx, size_t m, size_t n) {
+  visit_exp_<T>([&](auto exp) {
+    parallel_for(m, softmax_grain_ / std::max<size_t>(n, 1) + 1,
+                 [&](size_t begin, size_t end, size_t) {
+                   for (size_t i = begin; i < end; ++i) {
+                     const T *xr = x + i * n;
+                     T *dxr = dx + i * n;
+                     T k = scale[i / group], c = lse[i];
+                     for (size_t j = 0; j < n; j += lanes_)
+                       for_lanes(std::min(lanes_, n - j), [&](size_t l) {
+                         dxr[j + l] = k * exp(xr[j + l] - c);
+                       });
+                     dxr[target[i]] -= k;
+                   }
+                 });
+  });
+}
+
+void cross_entropy_backward(const float *x, const std::int64_t *target,
+                            const float *lse, const float *scale, size_t group,
+                            float *dx, size_t m, size_t n) {
+  cross_entropy_backward_(x, target, lse, scale, group, dx, m, n);
+}
+
+void cross_entropy_backward(const double *x, const std::int64_t *target,
+                            const double *lse, const double *scale,
+                            size_t group, double *dx, size_t m, size_t n) {
+  cross_entropy_backward_(x, target, lse, scale, group, dx, m, n);
+}
+
+} // namespace native
+} // namespace INNC
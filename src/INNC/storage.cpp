@@ -1,30 +1,45 @@
 #include "INNC/storage.hpp"
 #include <cstring>
 
-void UntypedStorage::alloc() { blob.reset(new uint8_t[size]); }
+void UntypedStorage::alloc() { reset_blob(new uint8_t[size]); }
 
 UntypedStorage::UntypedStorage(size_t size, bool prealloc) {
   this->size = size;
   if (prealloc)
-    blob.reset(new uint8_t[size]);
+    alloc();
 }
 
 size_t UntypedStorage::get_size() const noexcept { return this->size; }
 
 void UntypedStorage::zero_() const noexcept {
-  if (blob.get() == nullptr)
+  if (ptr == nullptr)
     return;
-  std::memset(blob.get(), 0, size);
+  std::memset(ptr, 0, size);
 }
 
-uint8_t *UntypedStorage::get_blob() const noexcept { return blob.get(); }
+uint8_t *UntypedStorage::get_blob() const noexcept { return ptr; }
 
-void UntypedStorage::release() noexcept { blob.reset(); }
+void UntypedStorage::release() noexcept {
+  blob.reset();
+  pool.reset();
+  ptr = nullptr;
+}
 
-bool UntypedStorage::is_alloc() const noexcept { return blob.get() != nullptr; }
+bool UntypedStorage::is_alloc() const noexcept { return ptr != nullptr; }
 
-void UntypedStorage::reset_blob(uint8_t ptr[]) { blob.reset(ptr); }
+void UntypedStorage::reset_blob(uint8_t ptr[]) {
+  reset_blob(std::unique_ptr<uint8_t[]>(ptr));
+}
 
 void UntypedStorage::reset_blob(std::unique_ptr<uint8_t[]> &&ptr) {
   blob = std::move(ptr);
+  pool.reset();
+  this->ptr = blob.get();
+}
+
+void UntypedStorage::share_blob(const std::shared_ptr<uint8_t[]> &pool,
+                                size_t offset) {
+  blob.reset();
+  this->pool = pool;
+  ptr = pool.get() + offset;
 }
@@ -5,6 +5,7 @@
 #include "INNC/tensorImpl.hpp"
 #include "INNC/types.hpp"
 #include "INNC/utils/traits.hpp"
+#include "INNC/utils/utils.hpp"
 
 namespace INNC {
 Tensor::Tensor() = default;
@@ -29,7 +30,7 @@ Tensor::Tensor(const SizeVec &sizes, types dtype)
     : fptr(TensorImpl::create(dtype, StridedLayout{sizes})){};
 Tensor::~Tensor() = default;
 
-void Tensor::backward() { fptr->backward(); }
+void Tensor::backward(bool retain_graph) { fptr->backward(retain_graph); }
 
 std::string Tensor::to_string() const {
   if (fptr == nullptr)
@@ -37,9 +38,15 @@ std::string Tensor::to_string() const {
   return fptr->to_string();
 }
 
-const SizeVec Tensor::size() const { return fptr->size(); }
+// Batched tensors only show one example to the `fn` of `vmap`.
+const SizeVec Tensor::size() const { return example_sizes(*fptr); }
 
-const SignedVec Tensor::stride() const { return fptr->stride(); }
+const SignedVec Tensor::stride() const {
+  auto strides = fptr->stride();
+  if (fptr->batched)
+    strides.erase(strides.begin());
+  return strides;
+}
 
 Tensor Tensor::zeros(const SizeVec &size, types t) {
   return Tensor(TensorImpl::zeros(size, t));
@@ -68,7 +75,9 @@ Tensor Tensor::from_blob(void *data, const SizeVec &sizes, types dtype) {
   return Tensor(TensorImpl::from_blob(data, sizes, dtype));
 }
 
-size_t Tensor::numel() const noexcept { return fptr->numel(); }
+size_t Tensor::numel() const noexcept { return example_numel(*fptr); }
+
+size_t Tensor::dim() const noexcept { return fptr->dim() - fptr->batched; }
 
 void Tensor::release() noexcept { fptr->release(); }
 
@@ -81,6 +90,11 @@ Tensor &Tensor::operator+=(const Tensor &rhs) {
   return *this;
 }
 
+Tensor &Tensor::copy_(const Tensor &src) {
+  fptr->copy_(*src.fptr);
+  return *this;
+}
+
 Tensor operator+(const Tensor &lhs, const Tensor &rhs) {
   return Tensor(*lhs.fptr + *rhs.fptr);
 }
@@ -105,7 +119,7 @@ bool Tensor::requires_grad() const noexcept { return fptr->requires_grad; }
 
 void Tensor::requires_grad(bool b) {
   if (b)
-    run_expect(fptr->type() == f32 || fptr->type() == f64,
+    run_expect(is_float(fptr->type()),
                "Only matrices of floating point number can require grad");
   fptr->requires_grad = b;
 }
@@ -124,6 +138,13 @@ Tensor Tensor::sum() const { return Tensor(fptr->sum()); }
 Tensor Tensor::mean() const { return Tensor(fptr->mean()); }
 
 Tensor Tensor::abs() const { return Tensor(fptr->abs()); }
+Tensor Tensor::exp() const { return Tensor(fptr->exp()); }
+Tensor Tensor::log() const { return Tensor(fptr->log()); }
+Tensor Tensor::sqrt() const { return Tensor(fptr->sqrt()); }
+Tensor Tensor::tanh() const { return Tensor(fptr->tanh()); }
+Tensor Tensor::sigmoid() const { return Tensor(fptr->sigmoid()); }
+Tensor Tensor::gelu() const { return Tensor(fptr->gelu()); }
+Tensor Tensor::relu() const { return Tensor(fptr->relu()); }
 
 Tensor Tensor::max() const { return Tensor(fptr->max()); }
 
@@ -135,6 +156,14 @@ Tensor Tensor::operator[](const std::string &slice) {
   return Tensor((*this->fptr)[slice]);
 }
 
+Tensor Tensor::index(std::initializer_list<TensorIndex> indices) {
+  return Tensor(fptr->index({indices.begin(), indices.size()}));
+}
+
+Tensor Tensor::index(std::span<const TensorIndex> indices) {
+  return Tensor(fptr->index(indices));
+}
+
 Tensor Tensor::transpose(const Tensor &input, size_t dim0, size_t dim1) {
   auto tf = TensorImpl::transpose(input.fptr, dim0, dim1);
   return Tensor(tf);
@@ -157,6 +186,55 @@ Tensor Tensor::reshape_as(const Tensor &input) {
   return fptr->reshape_as(*input.fptr);
 }
 
+Tensor Tensor::permute(const SizeVec &dims) {
+  return TensorImpl::permute(fptr, dims);
+}
+
+Tensor Tensor::squeeze() { return TensorImpl::squeeze(fptr); }
+
+Tensor Tensor::squeeze(size_t dim) { return TensorImpl::squeeze(fptr, dim); }
+
+Tensor Tensor::unsqueeze(size_t dim) {
+  return TensorImpl::unsqueeze(fptr, dim);
+}
+
+Tensor Tensor::narrow(size_t dim, size_t start, size_t length) {
+  return TensorImpl::narrow(fptr, dim, start, length);
+}
+
+Tensor Tensor::select(size_t dim, long long index) {
+  return TensorImpl::select(fptr, dim, index);
+}
+
+Tensor Tensor::flip(const SizeVec &dims) {
+  return TensorImpl::flip(fptr, dims);
+}
+
+Tensor Tensor::unfold(size_t dim, size_t size, size_t step) {
+  return TensorImpl::unfold(fptr, dim, size, step);
+}
+
+Tensor Tensor::as_strided(const SizeVec &sizes, const SignedVec &strides,
+                          size_t offset) {
+  return TensorImpl::as_strided(fptr, sizes, strides, offset);
+}
+
+Tensor Tensor::expand(const Tensor &input, const SignedVec &sizes) {
+  return TensorImpl::expand(input.fptr, sizes);
+}
+
+Tensor Tensor::expand(const SignedVec &sizes) {
+  return TensorImpl::expand(fptr, sizes);
+}
+
+Tensor Tensor::expand_as(const Tensor &input) {
+  return fptr->expand_as(*input.fptr);
+}
+
+Tensor Tensor::broadcast_to(const SizeVec &sizes) {
+  return fptr->broadcast_to(sizes);
+}
+
 bool Tensor::is_contiguous() const noexcept { return fptr->is_contiguous(); }
 Tensor Tensor::contiguous() const { return Tensor(fptr->contiguous()); }
 
@@ -166,6 +244,111 @@ Tensor Tensor::detach() const { return Tensor(fptr->detach()); }
 
 bool Tensor::all() const { return fptr->all(); }
 
+bool Tensor::any() const { return fptr->any(); }
+
+BitMask Tensor::to_mask() const { return fptr->to_mask(); }
+
+BitMask Tensor::compare_mask(const Tensor &rhs, cmp op) const {
+  return fptr->compare_mask(*rhs.fptr, op);
+}
+
+Tensor Tensor::from_mask(const BitMask &mask) {
+  return Tensor(TensorImpl::from_mask(mask));
+}
+
+Tensor Tensor::masked_fill(const BitMask &mask, double value) const {
+  return Tensor(fptr->masked_fill(mask, value));
+}
+
+Tensor Tensor::gather(size_t dim, const Tensor &index) const {
+  return Tensor(TensorImpl::gather(fptr, dim, index.fptr));
+}
+
+Tensor Tensor::scatter(size_t dim, const Tensor &index,
+                       const Tensor &src) const {
+  return Tensor(TensorImpl::scatter(fptr, dim, index.fptr, src.fptr));
+}
+
+Tensor Tensor::scatter_add(size_t dim, const Tensor &index,
+                           const Tensor &src) const {
+  return Tensor(TensorImpl::scatter_add(fptr, dim, index.fptr, src.fptr));
+}
+
+Tensor Tensor::index_select(size_t dim, const Tensor &index) const {
+  return Tensor(TensorImpl::index_select(fptr, dim, index.fptr));
+}
+
+Tensor Tensor::index_add(size_t dim, const Tensor &index,
+                         const Tensor &src) const {
+  return Tensor(TensorImpl::index_add(fptr, dim, index.fptr, src.fptr));
+}
+
+Tensor Tensor::masked_select(const BitMask &mask) const {
+  return Tensor(TensorImpl::masked_select(fptr, mask));
+}
+
+bool Tensor::is_quantized() const noexcept { return fptr->is_quantized(); }
+
+Tensor Tensor::quantize(float scale, std::int32_t zero_point) const {
+  return Tensor(fptr->quantize(scale, zero_point));
+}
+
+Tensor
+Tensor::quantize_per_channel(const std::vector<float> &scales,
+                             const std::vector<std::int32_t> &zero_points,
+                             size_t axis) const {
+  return Tensor(fptr->quantize_per_channel(scales, zero_points, axis));
+}
+
+Tensor Tensor::dequantize() const { return Tensor(fptr->dequantize()); }
+
+Tensor Tensor::qmatmul(const Tensor &a, const Tensor &b) {
+  return Tensor(TensorImpl::qmatmul(a.fptr, b.fptr));
+}
+
+Tensor Tensor::qmatmul(const Tensor &a, const Tensor &b, float out_scale,
+                       std::int32_t out_zero_point) {
+  return Tensor(TensorImpl::qmatmul(a.fptr, b.fptr, out_scale, out_zero_point));
+}
+
+Tensor Tensor::linear(const Tensor &input, const Tensor &weight,
+                      const Tensor &bias, activation act) {
+  return Tensor(TensorImpl::linear(input.fptr, weight.fptr, bias.fptr, act));
+}
+
+Tensor Tensor::softmax(size_t dim) const {
+  return Tensor(TensorImpl::softmax(fptr, dim));
+}
+
+Tensor Tensor::log_softmax(size_t dim) const {
+  return Tensor(TensorImpl::log_softmax(fptr, dim));
+}
+
+Tensor Tensor::cross_entropy(const Tensor &input, const Tensor &target) {
+  return Tensor(TensorImpl::cross_entropy(input.fptr, target.fptr));
+}
+
+Tensor Tensor::layer_norm(const Tensor &input, const SizeVec &normalized_shape,
+                          const Tensor &weight, const Tensor &bias,
+                          double eps) {
+  return Tensor(TensorImpl::layer_norm(input.fptr, normalized_shape,
+                                       weight.fptr, bias.fptr, eps));
+}
+
+Tensor Tensor::batch_norm(const Tensor &input, const Tensor &running_mean,
+                          const Tensor &running_var, const Tensor &weight,
+                          const Tensor &bias, bool training, double momentum,
+                          double eps) {
+  return Tensor(TensorImpl::batch_norm(input.fptr, running_mean.fptr,
+                                       running_var.fptr, weight.fptr,
+                                       bias.fptr, training, momentum, eps));
+}
+
+Tensor Tensor::dropout(const Tensor &input, double p, bool training,
+                       Generator &gen) {
+  return Tensor(TensorImpl::dropout(input.fptr, p, training, gen));
+}
+
 Tensor operator<(const Tensor &lhs, const Tensor &rhs) {
   return Tensor(*lhs.fptr < *rhs.fptr);
 }
@@ -190,14 +373,27 @@ Tensor operator!=(const Tensor &lhs, const Tensor &rhs) {
   return Tensor(*lhs.fptr != *rhs.fptr);
 }
 
-Tensor Tensor::randn(const SizeVec &sizes, types dtype) {
-  return Tensor(TensorImpl::randn(sizes, dtype));
+Tensor Tensor::rand(const SizeVec &sizes, types dtype, Generator &gen) {
+  return Tensor(TensorImpl::rand(sizes, dtype, gen));
+}
+
+Tensor Tensor::randint(std::int64_t low, std::int64_t high,
+                       const SizeVec &sizes, types dtype, Generator &gen) {
+  return Tensor(TensorImpl::randint(low, high, sizes, dtype, gen));
+}
+
+Tensor Tensor::randn(const SizeVec &sizes, types dtype, Generator &gen) {
+  return Tensor(TensorImpl::randn(sizes, dtype, gen));
 }
 
 Tensor Tensor::randn_like(const Tensor &t) {
   return Tensor(TensorImpl::randn_like(*t.fptr));
 }
 
+Tensor Tensor::bernoulli(const Tensor &p, Generator &gen) {
+  return Tensor(TensorImpl::bernoulli(p.fptr, gen));
+}
+
 Tensor Tensor::cat(const std::vector<Tensor> &input_tensors, const size_t dim) {
   std::vector<std::shared_ptr<INNC::TensorImpl>> input_tfs_;
   for (const auto &t : input_tensors)
@@ -205,6 +401,46 @@ Tensor Tensor::cat(const std::vector<Tensor> &input_tensors, const size_t dim) {
   return Tensor(TensorImpl::cat(input_tfs_, dim));
 }
 
+std::vector<std::shared_ptr<TensorImpl>>
+Tensor::impls_of(const std::vector<Tensor> &tensors) {
+  std::vector<std::shared_ptr<TensorImpl>> ret;
+  for (const auto &t : tensors)
+    ret.emplace_back(t.fptr);
+  return ret;
+}
+
+TensorImpl::TensorFn Tensor::impl_fn_of(
+    const std::function<Tensor(const std::vector<Tensor> &)> &fn) {
+  return [fn](const std::vector<std::shared_ptr<TensorImpl>> &input_tfs) {
+    std::vector<Tensor> in;
+    for (const auto &t : input_tfs)
+      in.push_back(Tensor(t));
+    return fn(in).fptr;
+  };
+}
+
+Tensor
+Tensor::checkpoint(const std::function<Tensor(const std::vector<Tensor> &)> &fn,
+                   const std::vector<Tensor> &inputs) {
+  return Tensor(TensorImpl::checkpoint(impl_fn_of(fn), impls_of(inputs)));
+}
+
+Tensor
+Tensor::vmap(const std::function<Tensor(const std::vector<Tensor> &)> &fn,
+             const std::vector<Tensor> &inputs) {
+  return Tensor(TensorImpl::vmap(impl_fn_of(fn), impls_of(inputs)));
+}
+
+std::vector<Tensor> Tensor::per_sample_grad(
+    const std::function<Tensor(const std::vector<Tensor> &)> &fn,
+    const std::vector<Tensor> &params, const std::vector<Tensor> &inputs) {
+  std::vector<Tensor> ret;
+  for (auto &g : TensorImpl::per_sample_grad(impl_fn_of(fn), impls_of(params),
+                                             impls_of(inputs)))
+    ret.push_back(Tensor(g));
+  return ret;
+}
+
 Tensor Tensor::full(const SizeVec &sv, std::int64_t num, types dtype) {
   return Tensor(TensorImpl::full(sv, num, dtype));
 }
@@ -2,37 +2,51 @@
 #include "INNC/dispatcher.hpp"
 #include "INNC/exceptions.hpp"
 #include "INNC/function.hpp"
+#include "INNC/graph.hpp"
 #include "INNC/layouts.hpp"
 #include "INNC/ops.hpp"
+#include "INNC/quantized.hpp"
 #include "INNC/storage.hpp"
 #include "INNC/types.hpp"
 #include "INNC/utils/compile_opt.hpp"
-#include "INNC/utils/rand.hpp"
 #include "INNC/utils/traits.hpp"
 #include "INNC/utils/utils.hpp"
+#include <algorithm>
+#include <cmath>
 #include <cstring>
-#include <queue>
+#include <iterator>
+#include <limits>
+#include <unordered_map>
 
 namespace INNC {
 
 size_t TensorImpl::dim() const noexcept { return view->dim(); }
 
+// For ops whose result would mix the examples of a batched tensor.
+void expect_unbatched(const TensorImpl &t, const char *op) {
+  run_expect(!t.batched, op, " is not supported on tensors batched by vmap.");
+}
+
+SizeVec example_sizes(const TensorImpl &t) {
+  SizeVec sizes = t.view->sizes;
+  if (t.batched)
+    sizes.erase(sizes.begin());
+  return sizes;
+}
+
+size_t example_numel(const TensorImpl &t) {
+  size_t n = 1;
+  for (auto s : example_sizes(t))
+    n *= s;
+  return n;
+}
+
 size_t TensorImpl::cnt_from_aug_index(const SizeVec &index) const {
-  SizeVec phy_index;
-  auto phy_dim = dim();
-  auto idx_dim = index.size();
-  phy_index.resize(phy_dim);
-  for (size_t i = 1; i <= phy_dim; ++i) {
-    auto s = view->sizes[phy_dim - i];
-    if (__LIKELY(s != 1)) {
-      run_expect(index[idx_dim - i] < s, "the index ", index,
-                 " is out of range ", view->sizes.to_string());
-      phy_index[phy_dim - i] = index[idx_dim - i];
-    } else {
-      phy_index[phy_dim - i] = 0;
-    }
-  }
-  return TensorImpl::cnt_from_index(phy_index);
+  if (__LIKELY(dlayout == layouts::strided))
+    return static_cast<StridedLayout *>(view.get())->cnt_from_aug_index(index);
+  else
+    throw std::logic_error(
+        sformat("This layout %s has not been implemented", layouts::sparse));
 }
 
 size_t TensorImpl::cnt_from_index(const SizeVec &index) const {
@@ -67,7 +81,24 @@ std::string TensorImpl::to_string() const {
   return view->to_string_from(*data_, dtype);
 }
 
-TensorImpl::~TensorImpl() = default;
+// Letting `grad_fn` destroy its inputs would recurse once per node of a chain.
+// Inputs this tensor holds the last reference to are unlinked from their own
+// inputs first and freed from a worklist instead.
+TensorImpl::~TensorImpl() {
+  if (grad_fn.get() == nullptr)
+    return;
+  auto stack = std::move(grad_fn->input_tfs);
+  grad_fn.reset();
+  while (!stack.empty()) {
+    auto t = std::move(stack.back());
+    stack.pop_back();
+    if (t.use_count() != 1 || t->grad_fn.get() == nullptr)
+      continue;
+    auto &inputs = t->grad_fn->input_tfs;
+    std::move(inputs.begin(), inputs.end(), std::back_inserter(stack));
+    inputs.clear();
+  }
+}
 
 TensorImpl::TensorImpl(types dtype, layouts dlayout,
                        const std::shared_ptr<Layout> &view,
@@ -76,6 +107,7 @@ TensorImpl::TensorImpl(types dtype, layouts dlayout,
   requires_grad = false;
   retain_grad = false;
   _version = 0;
+  batched = false;
 }
 
 std::shared_ptr<TensorImpl>
@@ -194,18 +226,28 @@ std::shared_ptr<TensorImpl> operator!=(TensorImpl &l, TensorImpl &r) {
 
 TensorImpl &TensorImpl::operator+=(const TensorImpl &rhs) {
   run_expect(
-      !requires_grad,
+      !tracks_grad(),
       "This inplace operation cannot perform on a tensor that requires grad.");
   native::tensor_add_helper::dispatch(dtype, rhs.dtype)(
       this, this, const_cast<TensorImpl *>(&rhs));
   return *this;
 }
 
+TensorImpl &TensorImpl::copy_(const TensorImpl &src) {
+  run_expect(grad_fn.get() == nullptr,
+             "Cannot copy into the result of an operation tracked by "
+             "autograd.");
+  run_expect(view->sizes == src.view->sizes, "Cannot copy a tensor of size ",
+             src.view->sizes, " into a tensor of size ", view->sizes, ".");
+  native::tensor_to_type_helper::dispatch(dtype, src.dtype)(this, &src);
+  return *this;
+}
+
 std::shared_ptr<TensorImpl> TensorImpl::ones(const SizeVec &sizes,
                                              types dtype) {
   auto one_ = create(i8, SizeVec{});
   *reinterpret_cast<char *>(one_->data_->get_blob()) = 1;
-  auto ret = create(dtype, make_shared<StridedLayout>(sizes));
+  auto ret = create(dtype, std::make_shared<StridedLayout>(sizes));
   native::tensor_fill_helper::dispatch(dtype, i8)(ret.get(), one_.get());
   return ret;
 }
@@ -213,7 +255,7 @@ std::shared_ptr<TensorImpl> TensorImpl::ones(const SizeVec &sizes,
 std::shared_ptr<TensorImpl> TensorImpl::zeros(const SizeVec &sizes,
                                               types dtype) {
   auto ret = create(dtype, StridedLayout{sizes});
-  ret->data_->zero_();
+  zero_storage(ret->data_);
   return ret;
 }
 
@@ -228,7 +270,7 @@ std::shared_ptr<TensorImpl> TensorImpl::ones_like(const TensorImpl &t) {
 std::shared_ptr<TensorImpl> TensorImpl::full(const SizeVec &sizes,
                                              std::int64_t num, types dtype) {
   auto tmp = create(num);
-  auto ret = create(dtype, make_shared<StridedLayout>(sizes));
+  auto ret = create(dtype, std::make_shared<StridedLayout>(sizes));
   native::tensor_fill_helper::dispatch(dtype, i64)(ret.get(), tmp.get());
   return ret;
 }
@@ -236,7 +278,7 @@ std::shared_ptr<TensorImpl> TensorImpl::full(const SizeVec &sizes,
 std::shared_ptr<TensorImpl> TensorImpl::full(const SizeVec &sizes, double num,
                                              types dtype) {
   auto tmp = create(num);
-  auto ret = create(dtype, make_shared<StridedLayout>(sizes));
+  auto ret = create(dtype, std::make_shared<StridedLayout>(sizes));
   native::tensor_fill_helper::dispatch(dtype, f64)(ret.get(), tmp.get());
   return ret;
 }
@@ -247,7 +289,7 @@ std::shared_ptr<TensorImpl> TensorImpl::eye(size_t n, types dtype) {
 
 std::shared_ptr<TensorImpl> TensorImpl::eye(size_t n, size_t m, types dtype) {
   auto ret = create(dtype, StridedLayout{SizeVec{n, m}});
-  ret->data_->zero_();
+  zero_storage(ret->data_);
   native::tensor_eye_helper::dispatch(dtype, dtype)(ret.get(), nullptr);
   return ret;
 }
@@ -284,81 +326,78 @@ void TensorImpl::release() noexcept { data_->release(); }
 INNC::types TensorImpl::type() const { return this->dtype; }
 
 std::shared_ptr<TensorImpl> TensorImpl::type(types t) {
-  if (requires_grad && is_int(t))
+  if (tracks_grad() && is_int(t))
     throw std::runtime_error(
         "Cannot cast a tensor that requries grad to a integer tensor.");
   if (t == dtype)
     return shared_from_this();
   auto ret = create(t, StridedLayout{view->sizes});
   native::tensor_to_type_helper::dispatch(t, dtype)(ret.get(), this);
-  if (!requires_grad)
+  ret->batched = batched;
+  if (!tracks_grad())
     return ret;
   ret->requires_grad = true;
   ret->grad_fn.reset(new CloneBack(ret.get(), {shared_from_this()}));
   return ret;
 }
 
-void refresh_n_outway(TensorImpl *tf) {
-  std::queue<TensorImpl *> q;
-  tf->grad_fn->n_outway = 0;
-  tf->grad_fn->back_version = ++Backward::global_back_version;
-  q.push(tf);
-  while (!q.empty()) {
-    auto t = q.front();
-    q.pop();
-    for (const auto &it : t->grad_fn->input_tfs) {
-      if (__LIKELY(it->grad_fn.get() != nullptr &&
-                   it->grad_fn->back_version < Backward::global_back_version)) {
-        it->grad_fn->back_version = Backward::global_back_version;
-        it->grad_fn->n_outway = 0;
-        q.push(it.get());
-      }
-    }
-  }
-  tf->grad_fn->back_version = ++Backward::global_back_version;
-  q.push(tf);
-  while (!q.empty()) {
-    auto t = q.front();
-    q.pop();
-    for (const auto &it : t->grad_fn->input_tfs) {
-      if (it->grad_fn.get() == nullptr)
-        continue;
-      ++it->grad_fn->n_outway;
-      if (__LIKELY(it->grad_fn->back_version < Backward::global_back_version)) {
-        it->grad_fn->back_version = Backward::global_back_version;
-        q.push(it.get());
-      }
-    }
-  }
-}
-
-void TensorImpl::backward() {
+void TensorImpl::backward(bool retain_graph) {
+  run_expect(!is_inference_mode(), "Cannot backward in inference mode.");
   run_expect(requires_grad,
              "Cannot backward from a tensor that does not require grad.");
   run_expect(grad_fn.get() != nullptr,
              "Cannot backward from a tensor that has no grad_func");
   run_expect(numel() == 1,
              "Only scalar number could be the start of a backward propagation");
-  refresh_n_outway(this);
-  std::queue<TensorImpl *> q; // TODO 3 multiprocessing
-  q.push(this);
   grad = ones_like(*this);
   grad_fn->back_version = ++Backward::global_back_version;
-  while (!q.empty()) {
-    auto t = q.front();
-    q.pop();
-    t->grad_fn->step_back();
-    if (!t->retain_grad)
-      t->grad.reset();
-    for (const auto &it : t->grad_fn->input_tfs) {
-      if (it->grad_fn.get() != nullptr &&
-          it->grad_fn->back_version < Backward::global_back_version &&
-          it->grad_fn->is_ready()) {
-        it->grad_fn->back_version = Backward::global_back_version;
-        q.push(it.get());
-      }
+  if (retain_graph) {
+    for (auto t : grad_fn->get_schedule()) { // TODO 3 multiprocessing
+      if (t->grad_fn->back_version != Backward::global_back_version)
+        continue;
+      t->grad_fn->step_back();
+      if (!t->retain_grad)
+        t->grad.reset();
+    }
+    return;
+  }
+  // The nodes only hold their inputs, so an input still waiting for its own
+  // step is kept alive by `pending` once its consumers are released.
+  grad_fn->get_schedule();
+  auto schedule = std::move(grad_fn->schedule);
+  std::unordered_map<TensorImpl *, std::shared_ptr<TensorImpl>> pending;
+  for (auto t : schedule) {
+    auto self = pending.extract(t);
+    if (t->grad_fn->back_version == Backward::global_back_version) {
+      t->grad_fn->step_back();
+      if (!t->retain_grad)
+        t->grad.reset();
     }
+    auto node = std::move(t->grad_fn);
+    t->grad_fn.reset(new ReleasedBack(t, {}));
+    for (auto &input : node->input_tfs)
+      if (input->grad_fn.get() != nullptr)
+        pending.try_emplace(input.get(), std::move(input));
   }
+  ++Backward::graph_epoch;
+}
+
+// Sums every example of the batched `t` on its own, see `TensorImpl::vmap`.
+std::shared_ptr<TensorImpl> batched_sum(TensorImpl &t, types dst_t) {
+  SizeVec sizes;
+  sizes.resize(t.dim(), 1);
+  sizes[0] = t.size(0);
+  auto tf = TensorImpl::zeros(sizes, dst_t);
+  // `tf` is re-read for every element, so the add accumulates over the
+  // broadcast dimensions.
+  native::tensor_add_helper::dispatch(dst_t, t.dtype)(tf.get(), tf.get(), &t);
+  if (t.tracks_grad()) {
+    tf->requires_grad = true;
+    tf->grad_fn.reset(new SumBack(tf.get(), {t.shared_from_this()}));
+  }
+  auto ret = TensorImpl::reshape(tf, SizeVec{sizes[0]});
+  ret->batched = true;
+  return ret;
 }
 
 std::shared_ptr<TensorImpl> TensorImpl::sum() {
@@ -367,9 +406,11 @@ std::shared_ptr<TensorImpl> TensorImpl::sum() {
     dst_t = i64;
   else
     dst_t = f64;
+  if (__UNLIKELY(batched))
+    return batched_sum(*this, dst_t);
   auto tf = zeros(SizeVec{}, dst_t);
   native::tensor_sum_helper::dispatch(dst_t, dtype)(tf.get(), this);
-  if (requires_grad) {
+  if (tracks_grad()) {
     tf->requires_grad = true;
     tf->grad_fn.reset(new SumBack(tf.get(), {shared_from_this()}));
   }
@@ -382,9 +423,15 @@ std::shared_ptr<TensorImpl> TensorImpl::mean() {
     dst_t = i64;
   else
     dst_t = f64;
+  if (__UNLIKELY(batched)) {
+    size_t n = numel() / size(0);
+    auto count = dst_t == i64 ? create(static_cast<std::int64_t>(n))
+                              : create(static_cast<double>(n));
+    return *batched_sum(*this, dst_t) / *count;
+  }
   auto tf = zeros(SizeVec{}, dst_t);
   native::tensor_mean_helper::dispatch(dst_t, dtype)(tf.get(), this);
-  if (requires_grad) {
+  if (tracks_grad()) {
     tf->requires_grad = true;
     tf->grad_fn.reset(new MeanBack(tf.get(), {shared_from_this()}));
   }
@@ -393,7 +440,8 @@ std::shared_ptr<TensorImpl> TensorImpl::mean() {
 
 std::shared_ptr<TensorImpl> TensorImpl::abs() {
   auto ret = create(dtype, view);
-  if (!requires_grad) {
+  ret->batched = batched;
+  if (!tracks_grad()) {
     native::tensor_abs_helper::dispatch(dtype, dtype)(ret.get(), this, nullptr);
   } else {
     auto grad = create(dtype, view);
@@ -406,9 +454,54 @@ std::shared_ptr<TensorImpl> TensorImpl::abs() {
   return ret;
 }
 
+std::shared_ptr<TensorImpl> unary_math_(TensorImpl &t, unary_fn fn,
+                                        const char *op) {
+  run_expect(is_float(t.dtype), op, " needs a float tensor, got ",
+             INNC::to_string(t.dtype), ".");
+  bool fast = fast_math();
+  auto ret = TensorImpl::create(t.dtype, StridedLayout{t.view->sizes});
+  native::tensor_unary_math_helper::dispatch(t.dtype)(ret.get(), &t, fn, fast);
+  ret->batched = t.batched;
+  if (!t.tracks_grad())
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(
+      new UnaryMathBack(ret.get(), {t.shared_from_this()}, fn, fast));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::exp() {
+  return unary_math_(*this, unary_fn::exp, "exp");
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::log() {
+  return unary_math_(*this, unary_fn::log, "log");
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::sqrt() {
+  return unary_math_(*this, unary_fn::sqrt, "sqrt");
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::tanh() {
+  return unary_math_(*this, unary_fn::tanh, "tanh");
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::sigmoid() {
+  return unary_math_(*this, unary_fn::sigmoid, "sigmoid");
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::gelu() {
+  return unary_math_(*this, unary_fn::gelu, "gelu");
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::relu() {
+  return unary_math_(*this, unary_fn::relu, "relu");
+}
+
 std::shared_ptr<TensorImpl> TensorImpl::max() {
+  expect_unbatched(*this, "max");
   auto ret = zeros(SizeVec{}, dtype);
-  if (!requires_grad) {
+  if (!tracks_grad()) {
     native::tensor_max_helper::dispatch(dtype)(ret.get(), this, nullptr);
   } else {
     auto grad = zeros_like(*this);
@@ -421,8 +514,9 @@ std::shared_ptr<TensorImpl> TensorImpl::max() {
 }
 
 std::shared_ptr<TensorImpl> TensorImpl::min() {
+  expect_unbatched(*this, "min");
   auto ret = zeros(SizeVec{}, dtype);
-  if (!requires_grad) {
+  if (!tracks_grad()) {
     native::tensor_min_helper::dispatch(dtype)(ret.get(), this, nullptr);
   } else {
     auto grad = zeros_like(*this);
@@ -437,136 +531,238 @@ std::shared_ptr<TensorImpl> TensorImpl::min() {
 void TensorImpl::zero_grad() const noexcept {
   if (grad.get() == nullptr)
     return;
-  grad->data_->zero_();
+  zero_storage(grad->data_);
+}
+
+StridedLayout *strided_view_of(const TensorImpl &t) {
+  run_expect(t.dlayout == layouts::strided,
+             "Views are only supported by StridedLayout.");
+  return dynamic_cast<StridedLayout *>(t.view.get());
 }
 
+// Maps the layout of a tensor to the layout of one of its views.
+using ViewFn = std::function<StridedLayout(const StridedLayout &)>;
+
+// The view `to` of `from` writes its grad into the grad of `from`. That grad
+// is not always laid out like the data, e.g. the dense grad of an expanded
+// tensor, so `view_fn` is applied to the layout of the grad itself.
 void share_grad_storage(TensorImpl &to, TensorImpl &from,
-                        const std::shared_ptr<Layout> &view) {
+                        const ViewFn &view_fn) {
   if (from.grad == nullptr) {
     from.grad = TensorImpl::create(from.dtype, from.view, false);
   }
-  to.grad = TensorImpl::create(to.dtype, view, from.grad->data_);
+  to.grad = TensorImpl::create(
+      to.dtype,
+      std::make_shared<StridedLayout>(view_fn(*strided_view_of(*from.grad))),
+      from.grad->data_);
+}
+
+// Wraps the layout made by `view_fn` from the layout of `input` over the
+// storage of `input`. The view is batched like `input`.
+std::shared_ptr<TensorImpl> view_of(const std::shared_ptr<TensorImpl> &input,
+                                    const ViewFn &view_fn) {
+  auto ret = TensorImpl::create(
+      input->dtype,
+      std::make_shared<StridedLayout>(view_fn(*strided_view_of(*input))),
+      input->data_);
+  ret->batched = input->batched;
+  if (!input->tracks_grad())
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new NoBack(ret.get(), {input}));
+  share_grad_storage(*ret, *input, view_fn);
+  return ret;
 }
 
-void share_grad_storage(TensorImpl &to, TensorImpl &from) {
-  share_grad_storage(to, from, to.view);
+// Wraps a layout given in terms of the storage of `input`. Unless the grad of
+// `input` is laid out like its storage, the view collects the grad of the
+// storage on its own.
+std::shared_ptr<TensorImpl> view_of(const std::shared_ptr<TensorImpl> &input,
+                                    const SizeVec &sizes,
+                                    const SignedVec &strides, size_t offset) {
+  auto view_fn = [&](const StridedLayout &) {
+    return StridedLayout(sizes, strides, offset);
+  };
+  if (!input->tracks_grad())
+    return view_of(input, view_fn);
+  if (input->grad == nullptr)
+    input->grad = TensorImpl::create(input->dtype, input->view, false);
+  auto view_s = strided_view_of(*input);
+  auto grad_s = strided_view_of(*input->grad);
+  if (grad_s->strides == view_s->strides && grad_s->offset == view_s->offset &&
+      input->grad->data_->get_size() == input->data_->get_size())
+    return view_of(input, view_fn);
+  auto ret = TensorImpl::create(
+      input->dtype, std::make_shared<StridedLayout>(view_fn(*view_s)),
+      input->data_);
+  ret->batched = input->batched;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new AsStridedBack(ret.get(), {input}));
+  ret->grad = TensorImpl::create(
+      ret->dtype, ret->view,
+      std::make_shared<UntypedStorage>(input->data_->get_size(), false));
+  return ret;
 }
 
-std::shared_ptr<TensorImpl> TensorImpl::operator[](const std::string &slice) {
-  if (dlayout == layouts::strided) {
-    std::vector<std::string> each_dim = ssplit(slice, ',');
+// Narrows one dimension of `size` and `stride` by `s` as Python does.
+void apply_slice(const indexing::Slice &s, size_t size, long long stride,
+                 SizeVec &sizes_, SignedVec &strides_, size_t &offset) {
+  auto empty = [&]() {
+    sizes_.push_back(0);
+    strides_.push_back(0);
+  };
+  if (size == 0)
+    return empty();
+  long long n = size;
+  long long step, beg, end;
+  if (s.step != indexing::none) {
+    step = s.step;
+    run_expect(step != 0, "slice step cannot be zero");
+  } else
+    step = 1;
+  if (s.start != indexing::none) {
+    beg = s.start;
+    if (beg < 0)
+      beg += n;
+    if (beg < 0) {
+      if (step > 0)
+        beg = 0;
+      else
+        return empty();
+    }
+    if (beg >= n) {
+      if (step > 0)
+        return empty();
+      else
+        beg = n - 1;
+    }
+  } else
+    beg = step > 0 ? 0 : n - 1;
+  if (s.stop != indexing::none) {
+    end = s.stop;
+    if (end < 0)
+      end += n;
+    if (step > 0) {
+      if (end <= 0)
+        return empty();
+      if (end > n)
+        end = n;
+    } else {
+      if (end < 0)
+        end = -1;
+      if (end >= n - 1)
+        return empty();
+    }
+  } else
+    end = step > 0 ? n : -1;
+  if ((step > 0 && beg >= end) || (step < 0 && beg <= end))
+    return empty();
+  sizes_.push_back((std::abs(end - beg) - 1) / std::abs(step) + 1);
+  strides_.push_back(step * stride);
+  offset += beg * stride;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::index(std::span<const TensorIndex> indices) {
+  expect_unbatched(*this, "index");
+  if (dlayout != layouts::strided)
+    throw std::runtime_error("Not implemented");
+  auto &sizes = view->sizes;
+  size_t consumed = 0;
+  bool has_ellipsis = false;
+  for (const auto &idx : indices) {
+    if (idx.kind() == TensorIndex::kinds::ellipsis) {
+      run_expect(!has_ellipsis, "An index can only have a single ellipsis.");
+      has_ellipsis = true;
+    } else if (idx.kind() != TensorIndex::kinds::new_axis)
+      ++consumed;
+  }
+  run_expect(consumed <= sizes.size(),
+             "Dimension of slicing is larger than sizes.");
+  size_t dim = 0;
+  for (const auto &idx : indices) {
+    if (idx.kind() == TensorIndex::kinds::integer) {
+      long long i = idx.integer();
+      if (i < 0)
+        i += sizes[dim];
+      run_expect(i >= 0 && i < static_cast<long long>(sizes[dim]), "index ",
+                 idx.integer(), " is out of bounds for dimension ", dim,
+                 " with size ", sizes[dim]);
+    }
+    if (idx.kind() == TensorIndex::kinds::ellipsis)
+      dim += sizes.size() - consumed;
+    else if (idx.kind() != TensorIndex::kinds::new_axis)
+      ++dim;
+  }
+  return view_of(shared_from_this(), [&](const StridedLayout &v) {
     SizeVec _sizes;
     SignedVec _strides;
-    auto view_s = dynamic_cast<StridedLayout *>(view.get());
-    auto &sizes = view_s->sizes;
-    auto &strides = view_s->strides;
-    auto offset = view_s->offset;
-    size_t _offset = offset;
-    run_expect(each_dim.size() <= sizes.size(),
-               "Dimension of slicing is larger than sizes.");
-    for (size_t dim = 0; dim < sizes.size(); ++dim) {
-      std::vector<std::string> split_slice;
-      if (dim < each_dim.size()) {
-        split_slice = ssplit(each_dim[dim], ':');
-        for (auto &s : split_slice)
-          trim_(s);
-      } else
-        split_slice = {"", "", ""};
-      if (split_slice.size() == 1) { // like a[-2]
-        long long idx = std::stoll(split_slice[0]);
-        if (idx < 0)
-          idx += sizes[dim];
-        run_expect(idx >= 0 && idx < static_cast<long long>(sizes[dim]),
-                   "index ", idx, " is out of bounds for dimension ", dim,
-                   " with size ", sizes[dim]);
-        _offset += strides[dim] * idx;
-      } else { // like a[-2:]
-        if (sizes[dim] == 0) {
-          _sizes.push_back(0);
-          _strides.push_back(0);
-          continue;
-        }
-        for (int i = split_slice.size(); i < 3; ++i)
-          split_slice.push_back("");
-        long long step, beg, end;
-        if (split_slice[2].size() != 0) {
-          step = stoll(split_slice[2]);
-          run_expect(step != 0, "slice step cannot be zero");
-        } else
-          step = 1;
-        if (split_slice[0].size() != 0) {
-          beg = stoll(split_slice[0]);
-          if (beg < 0)
-            beg += sizes[dim];
-          if (beg < 0) {
-            if (step > 0)
-              beg = 0;
-            else {
-              _sizes.push_back(0);
-              _strides.push_back(0);
-              continue;
-            }
-          }
-          if (beg >= static_cast<long long>(sizes[dim])) {
-            if (step > 0) {
-              _sizes.push_back(0);
-              _strides.push_back(0);
-              continue;
-            } else
-              beg = sizes[dim] - 1;
-          }
-        } else
-          beg = step > 0 ? 0 : sizes[dim] - 1;
-        if (split_slice[1].size() != 0) {
-          end = stoll(split_slice[1]);
-          if (end < 0)
-            end += sizes[dim];
-          if (step > 0) {
-            if (end <= 0) {
-              _sizes.push_back(0);
-              _strides.push_back(0);
-              continue;
-            }
-            if (end > static_cast<long long>(sizes[dim]))
-              end = sizes[dim];
-          } else {
-            if (end < 0)
-              end = -1;
-            if (end >= static_cast<long long>(sizes[dim]) - 1) {
-              _sizes.push_back(0);
-              _strides.push_back(0);
-              continue;
-            }
-          }
-        } else
-          end = step > 0 ? sizes[dim] : -1;
-        if ((step > 0 && beg >= end) || (step < 0 && beg <= end)) {
-          _sizes.push_back(0);
-          _strides.push_back(0);
-          continue;
+    size_t _offset = v.offset;
+    size_t dim = 0;
+    for (const auto &idx : indices) {
+      switch (idx.kind()) {
+      case TensorIndex::kinds::integer: {
+        long long i = idx.integer();
+        if (i < 0)
+          i += v.sizes[dim];
+        _offset += v.strides[dim] * i;
+        ++dim;
+        break;
+      }
+      case TensorIndex::kinds::slice:
+        apply_slice(idx.slice(), v.sizes[dim], v.strides[dim], _sizes,
+                    _strides, _offset);
+        ++dim;
+        break;
+      case TensorIndex::kinds::ellipsis:
+        for (size_t end = dim + v.dim() - consumed; dim < end; ++dim) {
+          _sizes.push_back(v.sizes[dim]);
+          _strides.push_back(v.strides[dim]);
         }
-        _sizes.push_back((std::abs(end - beg) - 1) / std::abs(step) + 1);
-        _strides.push_back(step * strides[dim]);
-        _offset += beg * strides[dim];
-      } // like a[-2:]
+        break;
+      case TensorIndex::kinds::new_axis:
+        _sizes.push_back(1);
+        _strides.push_back(
+            dim < v.dim() ? v.strides[dim] * (long long)v.sizes[dim] : 1);
+        break;
+      }
     }
-    auto ret = create(
-        dtype, std::make_unique<StridedLayout>(_sizes, _strides, _offset),
-        data_);
-    if (!requires_grad)
-      return ret;
-    ret->requires_grad = true;
-    ret->grad_fn.reset(new NoBack(ret.get(), {shared_from_this()}));
-    share_grad_storage(*ret, *this);
-    return ret;
-  } else {
-    throw std::runtime_error("Not implemented");
+    for (; dim < v.dim(); ++dim) {
+      _sizes.push_back(v.sizes[dim]);
+      _strides.push_back(v.strides[dim]);
+    }
+    return StridedLayout(_sizes, _strides, _offset);
+  });
+}
+
+// Parses e.g. "1, ::-1, -3:" into a typed index. An empty dimension stands for
+// a full slice.
+std::shared_ptr<TensorImpl> TensorImpl::operator[](const std::string &slice) {
+  std::vector<TensorIndex> indices;
+  for (const auto &each_dim : ssplit(slice, ',')) {
+    auto split_slice = ssplit(each_dim, ':');
+    for (auto &s : split_slice)
+      trim_(s);
+    if (split_slice.size() == 1) { // like a[-2]
+      indices.emplace_back(std::stoll(split_slice[0]));
+      continue;
+    }
+    // like a[-2:]
+    split_slice.resize(3);
+    auto bound = [](const std::string &s) {
+      return s.size() != 0 ? std::stoll(s) : indexing::none;
+    };
+    indices.emplace_back(indexing::Slice{
+        bound(split_slice[0]), bound(split_slice[1]), bound(split_slice[2])});
   }
+  return index(indices);
 }
 
 std::shared_ptr<TensorImpl>
 TensorImpl::transpose(const std::shared_ptr<TensorImpl> &input, size_t dim0,
                       size_t dim1) {
+  dim0 += input->batched;
+  dim1 += input->batched;
   auto dim = input->dim();
   run_expect(dim0 >= 0 && dim1 >= 0 && dim0 < dim && dim1 < dim,
              "Index out of range dimension ", dim,
@@ -576,23 +772,299 @@ TensorImpl::transpose(const std::shared_ptr<TensorImpl> &input, size_t dim0,
   run_expect(
       dim0 != dim1,
       sformat("dim0 and dim1 must be distinguished. But they are both ", dim0));
+  return view_of(input, [&](const StridedLayout &v) {
+    SizeVec _sizes = v.sizes;
+    SignedVec _strides = v.strides;
+    std::swap(_sizes[dim0], _sizes[dim1]);
+    std::swap(_strides[dim0], _strides[dim1]);
+    return StridedLayout(_sizes, _strides, v.offset);
+  });
+}
+
+// Views the batched `t` with `n` dimensions of size 1 inserted in front of
+// each example.
+std::shared_ptr<TensorImpl> pad_examples(const std::shared_ptr<TensorImpl> &t,
+                                         size_t n) {
+  return view_of(t, [&](const StridedLayout &v) {
+    SizeVec _sizes = v.sizes;
+    SignedVec _strides = v.strides;
+    _sizes.insert(_sizes.begin() + 1, n, 1);
+    _strides.insert(_strides.begin() + 1, n, 0);
+    return StridedLayout(_sizes, _strides, v.offset);
+  });
+}
+
+std::pair<std::shared_ptr<TensorImpl>, std::shared_ptr<TensorImpl>>
+batch_aligned(const TensorImpl &lhs, const TensorImpl &rhs) {
+  // Tensors are only ever owned by `shared_ptr`s to non-const objects.
+  auto l = const_cast<TensorImpl &>(lhs).shared_from_this();
+  auto r = const_cast<TensorImpl &>(rhs).shared_from_this();
+  size_t ld = l->dim() - l->batched, rd = r->dim() - r->batched;
+  if (l->batched && rd > ld)
+    l = pad_examples(l, rd - ld);
+  if (r->batched && ld > rd)
+    r = pad_examples(r, ld - rd);
+  return {l, r};
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::permute(const std::shared_ptr<TensorImpl> &input,
+                    const SizeVec &example_dims) {
+  strided_view_of(*input);
+  auto dim = input->dim();
+  SizeVec dims;
+  if (input->batched)
+    dims.push_back(0);
+  for (auto d : example_dims)
+    dims.push_back(d + input->batched);
+  run_expect(dims.size() == dim, "The number of dims ", dims.size(),
+             " does not match the dimension ", dim, " of the tensor.");
+  std::vector<bool> seen(dim, false);
+  for (auto d : dims) {
+    run_expect(d < dim && !seen[d], "The dims ", dims,
+               " are not a permutation of the dimensions.");
+    seen[d] = true;
+  }
+  return view_of(input, [&](const StridedLayout &v) {
+    SizeVec _sizes;
+    SignedVec _strides;
+    for (auto d : dims) {
+      _sizes.push_back(v.sizes[d]);
+      _strides.push_back(v.strides[d]);
+    }
+    return StridedLayout(_sizes, _strides, v.offset);
+  });
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::squeeze(const std::shared_ptr<TensorImpl> &input) {
+  return view_of(input, [&](const StridedLayout &v) {
+    SizeVec _sizes;
+    SignedVec _strides;
+    for (size_t i = 0; i < v.dim(); ++i)
+      if (v.sizes[i] != 1 || (i == 0 && input->batched)) {
+        _sizes.push_back(v.sizes[i]);
+        _strides.push_back(v.strides[i]);
+      }
+    return StridedLayout(_sizes, _strides, v.offset);
+  });
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::squeeze(const std::shared_ptr<TensorImpl> &input, size_t dim) {
+  dim += input->batched;
+  auto view_s = strided_view_of(*input);
+  run_expect(dim < input->dim(), "Index out of range dimension ",
+             input->dim(), ". Actual input of squeeze: ", dim);
+  bool squeezed = view_s->sizes[dim] == 1;
+  return view_of(input, [&](const StridedLayout &v) {
+    SizeVec _sizes = v.sizes;
+    SignedVec _strides = v.strides;
+    if (squeezed) {
+      _sizes.erase(_sizes.begin() + dim);
+      _strides.erase(_strides.begin() + dim);
+    }
+    return StridedLayout(_sizes, _strides, v.offset);
+  });
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::unsqueeze(const std::shared_ptr<TensorImpl> &input, size_t dim) {
+  dim += input->batched;
+  strided_view_of(*input);
+  run_expect(dim <= input->dim(), "Index out of range dimension ",
+             input->dim() + 1, ". Actual input of unsqueeze: ", dim);
+  return view_of(input, [&](const StridedLayout &v) {
+    SizeVec _sizes = v.sizes;
+    SignedVec _strides = v.strides;
+    long long stride =
+        dim < v.dim() ? _strides[dim] * (long long)_sizes[dim] : 1;
+    _sizes.insert(_sizes.begin() + dim, 1);
+    _strides.insert(_strides.begin() + dim, stride);
+    return StridedLayout(_sizes, _strides, v.offset);
+  });
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::narrow(const std::shared_ptr<TensorImpl> &input, size_t dim,
+                   size_t start, size_t length) {
+  dim += input->batched;
+  auto view_s = strided_view_of(*input);
+  run_expect(dim < input->dim(), "Index out of range dimension ",
+             input->dim(), ". Actual input of narrow: ", dim);
+  run_expect(start + length <= view_s->sizes[dim], "The range [", start, ", ",
+             start + length, ") exceeds the size ", view_s->sizes[dim],
+             " of dimension ", dim, ".");
+  return view_of(input, [&](const StridedLayout &v) {
+    SizeVec _sizes = v.sizes;
+    _sizes[dim] = length;
+    return StridedLayout(_sizes, v.strides, v.offset + v.strides[dim] * start);
+  });
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::select(const std::shared_ptr<TensorImpl> &input, size_t dim,
+                   long long index) {
+  dim += input->batched;
+  auto view_s = strided_view_of(*input);
+  run_expect(dim < input->dim(), "Index out of range dimension ",
+             input->dim(), ". Actual input of select: ", dim);
+  long long size = view_s->sizes[dim];
+  if (index < 0)
+    index += size;
+  run_expect(index >= 0 && index < size, "The index ", index,
+             " is out of range for dimension ", dim, " of size ", size, ".");
+  return view_of(input, [&](const StridedLayout &v) {
+    SizeVec _sizes = v.sizes;
+    SignedVec _strides = v.strides;
+    size_t offset = v.offset + _strides[dim] * index;
+    _sizes.erase(_sizes.begin() + dim);
+    _strides.erase(_strides.begin() + dim);
+    return StridedLayout(_sizes, _strides, offset);
+  });
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::flip(const std::shared_ptr<TensorImpl> &input,
+                 const SizeVec &example_dims) {
+  strided_view_of(*input);
+  SizeVec dims = example_dims;
+  for (auto &d : dims)
+    d += input->batched;
+  std::vector<bool> seen(input->dim(), false);
+  for (auto d : dims) {
+    run_expect(d < input->dim() && !seen[d], "The dims ", dims,
+               " of flip must be distinct dimensions of the tensor.");
+    seen[d] = true;
+  }
+  return view_of(input, [&](const StridedLayout &v) {
+    SignedVec _strides = v.strides;
+    size_t offset = v.offset;
+    for (auto d : dims) {
+      if (v.sizes[d] != 0)
+        offset += _strides[d] * (v.sizes[d] - 1);
+      _strides[d] = -_strides[d];
+    }
+    return StridedLayout(v.sizes, _strides, offset);
+  });
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::unfold(const std::shared_ptr<TensorImpl> &input, size_t dim,
+                   size_t size, size_t step) {
+  dim += input->batched;
+  auto view_s = strided_view_of(*input);
+  run_expect(dim < input->dim(), "Index out of range dimension ",
+             input->dim(), ". Actual input of unfold: ", dim);
+  run_expect(size <= view_s->sizes[dim], "The window size ", size,
+             " exceeds the size ", view_s->sizes[dim], " of dimension ", dim,
+             ".");
+  run_expect(step > 0, "The step of unfold must be positive.");
+  return view_of(input, [&](const StridedLayout &v) {
+    SizeVec _sizes = v.sizes;
+    SignedVec _strides = v.strides;
+    _sizes[dim] = (_sizes[dim] - size) / step + 1;
+    _strides[dim] *= step;
+    _sizes.push_back(size);
+    _strides.push_back(v.strides[dim]);
+    return StridedLayout(_sizes, _strides, v.offset);
+  });
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::as_strided(const std::shared_ptr<TensorImpl> &input,
+                       const SizeVec &sizes, const SignedVec &strides,
+                       size_t offset) {
+  strided_view_of(*input);
+  expect_unbatched(*input, "as_strided");
+  run_expect(sizes.size() == strides.size(), "The sizes ", sizes,
+             " and the strides ", strides, " have different lengths.");
+  long long lo = offset, hi = offset;
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    if (sizes[i] == 0)
+      return view_of(input, sizes, strides, offset);
+    long long span = strides[i] * (long long)(sizes[i] - 1);
+    (span < 0 ? lo : hi) += span;
+  }
+  long long n = input->data_->get_size() / size_of(input->dtype);
+  run_expect(lo >= 0 && hi < n, "as_strided with sizes ", sizes,
+             ", strides ", strides, " and offset ", offset,
+             " reaches out of the storage of ", n, " elements.");
+  return view_of(input, sizes, strides, offset);
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::expand(const std::shared_ptr<TensorImpl> &batch,
+                   const SignedVec &example_sizes) {
+  // A batched tensor keeps its batch dimension in front of the expanded
+  // example.
+  auto input = batch;
+  SignedVec sizes = example_sizes;
+  if (batch->batched) {
+    if (sizes.size() + 1 > batch->dim())
+      input = pad_examples(batch, sizes.size() + 1 - batch->dim());
+    sizes.insert(sizes.begin(), -1);
+  }
+  auto dim = input->dim();
+  run_expect(sizes.size() >= dim, "The number of sizes provided (",
+             sizes.size(), ") must be greater or equal to the dimension ", dim,
+             " of the tensor.");
   auto view_s = dynamic_cast<StridedLayout *>(input->view.get());
-  SizeVec _sizes = view_s->sizes;
-  SignedVec _strides = view_s->strides;
-  std::swap(_sizes[dim0], _sizes[dim1]);
-  std::swap(_strides[dim0], _strides[dim1]);
+  auto lead = sizes.size() - dim;
+  SizeVec _sizes;
+  SignedVec _strides;
+  _sizes.resize(sizes.size());
+  _strides.resize(sizes.size(), 0);
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    if (i < lead) {
+      run_expect(sizes[i] >= 0, "The expanded size ", sizes[i],
+                 " is not allowed in a leading, non-existing dimension ", i,
+                 ".");
+      _sizes[i] = sizes[i];
+      continue;
+    }
+    auto s = view_s->sizes[i - lead];
+    if (sizes[i] == -1 || static_cast<size_t>(sizes[i]) == s) {
+      _sizes[i] = s;
+      _strides[i] = view_s->strides[i - lead];
+    } else {
+      run_expect(s == 1, "The expanded size ", sizes[i],
+                 " must match the existing size ", s,
+                 " at non-singleton dimension ", i, ".");
+      run_expect(sizes[i] >= 0, "The expanded size ", sizes[i],
+                 " is not allowed at dimension ", i, ".");
+      _sizes[i] = sizes[i];
+    }
+  }
   auto ret =
       create(input->dtype,
              std::make_unique<StridedLayout>(_sizes, _strides, view_s->offset),
              input->data_);
-  if (!input->requires_grad)
+  ret->batched = input->batched;
+  if (!input->tracks_grad())
     return ret;
   ret->requires_grad = true;
-  ret->grad_fn.reset(new NoBack(ret.get(), {input}));
-  share_grad_storage(*ret, *input);
+  ret->grad_fn.reset(new ExpandBack(ret.get(), {input}));
+  // Elements of the view alias each other, so its grad needs dense storage.
+  ret->grad = create(ret->dtype, StridedLayout{_sizes}, false);
   return ret;
 }
 
+std::shared_ptr<TensorImpl> TensorImpl::expand(const SignedVec &sizes) {
+  return TensorImpl::expand(shared_from_this(), sizes);
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::expand_as(const TensorImpl &t) {
+  return broadcast_to(example_sizes(t));
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::broadcast_to(const SizeVec &sizes) {
+  SignedVec sizes_;
+  for (auto s : sizes)
+    sizes_.push_back(s);
+  return TensorImpl::expand(shared_from_this(), sizes_);
+}
+
 SizeVec regularize_size(const SignedVec &sizes, size_t numel = 0) {
   SignedVec sizes_ = sizes;
   if (sizes_.size() == 0) {
@@ -628,7 +1100,11 @@ SizeVec regularize_size(const SignedVec &sizes, size_t numel = 0) {
 
 std::shared_ptr<TensorImpl>
 TensorImpl::reshape(const std::shared_ptr<TensorImpl> &input,
-                    const SizeVec &sizes) {
+                    const SizeVec &new_sizes) {
+  // A batched tensor keeps its batch dimension in front of each example.
+  SizeVec sizes = new_sizes;
+  if (input->batched)
+    sizes.insert(sizes.begin(), input->size(0));
   size_t numel = 1;
   for (auto i : sizes)
     numel *= i;
@@ -643,61 +1119,31 @@ TensorImpl::reshape(const std::shared_ptr<TensorImpl> &input,
              "input of reshape: (",
              sizes, ")");
 
-  if (numel == 1) {
+  // A layout whose dimensions nest in one another keeps its elements in a
+  // single run of equal steps, which `sizes` can be laid over.
+  auto isometric = [](const StridedLayout &v) {
+    for (size_t i = 1; i < v.dim(); i++)
+      if (v.strides[i - 1] != v.strides[i] * (long long)v.sizes[i])
+        return false;
+    return true;
+  };
+  auto reshaped = [&](const StridedLayout &v) {
     SignedVec strides;
     strides.resize(sizes.size(), 1);
-    auto tf =
-        create(input->dtype,
-               std::make_unique<StridedLayout>(sizes, strides, view_s->offset),
-               input->data_);
-    if (!input->requires_grad)
-      return tf;
-    tf->requires_grad = true;
-    tf->grad_fn.reset(new NoBack(tf.get(), {input}));
-    share_grad_storage(*tf, *input);
-  }
-
-  bool isometry = true;
-  SizeVec sizes_;
-  sizes_.resize(view_s->dim());
-  SignedVec strides = view_s->strides;
-  std::vector<size_t> indexOrder(strides.size());
-  for (size_t i = 0; i < indexOrder.size(); ++i)
-    indexOrder[i] = i;
-  std::sort(indexOrder.begin(), indexOrder.end(),
-            [&strides](size_t i, size_t j) { return strides[i] < strides[j]; });
-  for (size_t i = 0; i < indexOrder.size(); ++i) {
-    sizes_[indexOrder[i]] = view_s->sizes[indexOrder[i]];
-    strides[indexOrder[i]] = view_s->strides[indexOrder[i]];
-  }
-
-  for (size_t i = 1; i < strides.size(); i++)
-    if (strides[i - 1] != (strides[i] * (long long)sizes_[i]))
-      isometry = false;
-  std::shared_ptr<TensorImpl> tf;
-  auto last_node = input;
-  if (isometry) {
-    auto sn = sizes.size();
-    if (sn != 0) {
-      strides.resize(sn);
-      strides[sn - 1] = view_s->strides[view_s->strides.size() - 1];
-      for (size_t idx = sn - 1; idx > 0; --idx) {
+    if (numel != 1 && sizes.size() != 0) {
+      strides.back() = v.strides.back();
+      for (size_t idx = sizes.size() - 1; idx > 0; --idx)
         strides[idx - 1] = strides[idx] * sizes[idx];
-      }
     }
-    tf = create(input->dtype,
-                std::make_unique<StridedLayout>(sizes, strides, view_s->offset),
-                input->data_);
-  } else {
-    auto m_tf = input->clone();
-    tf = create(input->dtype, make_shared<StridedLayout>(sizes), m_tf->data_);
-    last_node = m_tf;
-  }
-  if (!input->requires_grad)
-    return tf;
-  tf->requires_grad = true;
-  tf->grad_fn.reset(new NoBack(tf.get(), {last_node}));
-  share_grad_storage(*tf, *last_node);
+    return StridedLayout(sizes, strides, v.offset);
+  };
+  // The grad of `input` is viewed alike, so it has to nest as well.
+  bool isometry = numel == 1 || isometric(*view_s);
+  if (isometry && input->tracks_grad() && input->grad != nullptr)
+    isometry = isometric(*strided_view_of(*input->grad));
+  auto last_node = isometry ? input : input->clone();
+  auto tf = view_of(last_node, reshaped);
+  tf->batched = input->batched;
   return tf;
 }
 
@@ -708,16 +1154,17 @@ std::shared_ptr<TensorImpl> TensorImpl::reshape(const SizeVec &sizes) {
 std::shared_ptr<TensorImpl>
 TensorImpl::reshape(const std::shared_ptr<TensorImpl> &input,
                     const SignedVec &sizes) {
-  return TensorImpl::reshape(input, regularize_size(sizes, input->numel()));
+  return TensorImpl::reshape(input,
+                             regularize_size(sizes, example_numel(*input)));
 }
 
 std::shared_ptr<TensorImpl> TensorImpl::reshape(const SignedVec &sizes) {
   return TensorImpl::reshape(shared_from_this(),
-                             regularize_size(sizes, numel()));
+                             regularize_size(sizes, example_numel(*this)));
 }
 
 std::shared_ptr<TensorImpl> TensorImpl::reshape_as(const TensorImpl &t) {
-  return TensorImpl::reshape(shared_from_this(), t.view->sizes);
+  return TensorImpl::reshape(shared_from_this(), example_sizes(t));
 }
 
 bool TensorImpl::is_contiguous() const noexcept {
@@ -725,13 +1172,25 @@ bool TensorImpl::is_contiguous() const noexcept {
 }
 
 std::shared_ptr<TensorImpl> TensorImpl::contiguous() {
-  return view->contiguous_from(*this);
+  auto ret = view->contiguous_from(*this);
+  ret->batched = batched;
+  return ret;
+}
+
+std::shared_ptr<TensorImpl> contiguous_as(TensorImpl &t, types dtype) {
+  auto ret = t.detach();
+  if (ret->dtype != dtype)
+    ret = ret->type(dtype);
+  if (!ret->is_contiguous())
+    ret = ret->contiguous();
+  return ret;
 }
 
 std::shared_ptr<TensorImpl> TensorImpl::clone() {
   auto ret = create(dtype, view->sizes);
   native::tensor_clone_helper::dispatch(dtype, dtype)(ret.get(), this);
-  if (!requires_grad)
+  ret->batched = batched;
+  if (!tracks_grad())
     return ret;
   ret->requires_grad = true;
   ret->grad_fn.reset(new CloneBack(ret.get(), {shared_from_this()}));
@@ -739,10 +1198,16 @@ std::shared_ptr<TensorImpl> TensorImpl::clone() {
 }
 
 std::shared_ptr<TensorImpl> TensorImpl::detach() {
-  return create(dtype, view, data_, dlayout);
+  auto ret = create(dtype, view, data_, dlayout);
+  ret->batched = batched;
+  return ret;
 }
 
 bool TensorImpl::all() const {
+  expect_not_capturing("all");
+  expect_unbatched(*this, "all");
+  if (dtype != b8)
+    return to_mask().all();
   if (dlayout == layouts::strided) {
     for (auto r : view->sizes) {
       if (r == 0)
@@ -775,28 +1240,840 @@ bool TensorImpl::all() const {
   }
 }
 
-std::shared_ptr<TensorImpl> TensorImpl::randn(const SizeVec &sizes,
-                                              types dtype) {
-  run_expect(INNC::is_float(dtype), "Tensors with integer type ",
-             INNC::to_string(dtype),
-             " cannot be generated from a normal distribution");
-  if (dtype == INNC::f32) {
-    std::normal_distribution<float> gen_norm{};
-    auto ret = create(INNC::f32, StridedLayout{sizes});
-    auto dptr = reinterpret_cast<float *>(ret->data_->get_blob());
-    for (size_t i = 0; i < ret->numel(); ++i) {
-      *(dptr + i) = gen_norm(rng);
+bool TensorImpl::any() const { return to_mask().any(); }
+
+BitMask TensorImpl::to_mask() const {
+  expect_not_capturing("to_mask");
+  expect_unbatched(*this, "to_mask");
+  run_expect(dlayout == layouts::strided,
+             "Layouts except StridedLayout have not been implemented yet.");
+  BitMask ret(view->sizes);
+  native::tensor_to_mask_helper::dispatch(dtype)(&ret, this);
+  return ret;
+}
+
+BitMask TensorImpl::compare_mask(const TensorImpl &rhs, cmp op) const {
+  expect_not_capturing("compare_mask");
+  expect_unbatched(*this, "compare_mask");
+  expect_unbatched(rhs, "compare_mask");
+  BitMask ret(broadcast_range(size(), rhs.size()));
+  native::tensor_cmp_mask_helper::dispatch(dtype, rhs.dtype)(&ret, this, &rhs,
+                                                             op);
+  return ret;
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::from_mask(const BitMask &mask) {
+  auto ret = create(b8, mask.sizes);
+  auto ret_ptr = reinterpret_cast<bool *>(ret->data_->get_blob());
+  for (size_t i = 0, n = mask.numel(); i < n; ++i)
+    ret_ptr[i] = mask.test(i);
+  return ret;
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::masked_fill(const BitMask &mask,
+                                                    double value) {
+  expect_unbatched(*this, "masked_fill");
+  run_expect(mask.sizes == view->sizes, "The mask of size ", mask.sizes,
+             " does not match the tensor of size ", view->sizes, ".");
+  auto ret = create(dtype, view->sizes);
+  native::tensor_masked_fill_helper::dispatch(dtype)(ret.get(), this, &mask,
+                                                     value);
+  if (!tracks_grad())
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(
+      new MaskedFillBack(ret.get(), {shared_from_this()}, mask));
+  return ret;
+}
+
+void check_indexed_(const TensorImpl &input, size_t dim,
+                    const TensorImpl &index) {
+  expect_unbatched(input, "Indexing along a dimension");
+  expect_unbatched(index, "Indexing along a dimension");
+  run_expect(index.dtype == i64, "Indices must be an i64 tensor, got ",
+             INNC::to_string(index.dtype), ".");
+  run_expect(dim < input.dim(), "Index out of range dimension ", input.dim(),
+             ". Actual input of dim: ", dim);
+}
+
+// `index` must not exceed `bound` except along `dim`.
+void check_index_sizes_(const TensorImpl &index, const TensorImpl &bound,
+                        size_t dim) {
+  run_expect(index.dim() == bound.dim(), "The index of size ", index.size(),
+             " must have the same dimension as ", bound.size(), ".");
+  for (size_t d = 0; d < index.dim(); ++d)
+    run_expect(d == dim || index.view->sizes[d] <= bound.view->sizes[d],
+               "The index of size ", index.size(), " exceeds ", bound.size(),
+               " at dimension ", d, ".");
+}
+
+void check_scatter_src_(const TensorImpl &input, const TensorImpl &index,
+                        const TensorImpl &src) {
+  run_expect(src.dtype == input.dtype, "The source of type ",
+             INNC::to_string(src.dtype), " does not match the input of type ",
+             INNC::to_string(input.dtype), ".");
+  run_expect(index.view->sizes == src.view->sizes, "The index of size ",
+             index.size(), " does not match the source of size ", src.size(),
+             ".");
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::gather(const std::shared_ptr<TensorImpl> &input, size_t dim,
+                   const std::shared_ptr<TensorImpl> &index) {
+  check_indexed_(*input, dim, *index);
+  check_index_sizes_(*index, *input, dim);
+  auto ret = create(input->dtype, index->view->sizes);
+  native::tensor_gather_helper::dispatch(input->dtype)(ret.get(), input.get(),
+                                                       index.get(), dim);
+  if (!input->tracks_grad())
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new GatherBack(ret.get(), {input, index}, dim));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::scatter(const std::shared_ptr<TensorImpl> &input, size_t dim,
+                    const std::shared_ptr<TensorImpl> &index,
+                    const std::shared_ptr<TensorImpl> &src) {
+  check_indexed_(*input, dim, *index);
+  check_index_sizes_(*index, *input, dim);
+  check_scatter_src_(*input, *index, *src);
+  auto ret = input->detach()->clone();
+  native::tensor_scatter_helper::dispatch(input->dtype)(ret.get(), index.get(),
+                                                        src.get(), dim);
+  if (!input->tracks_grad() && !src->tracks_grad())
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new ScatterBack(ret.get(), {input, index, src}, dim));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::scatter_add(const std::shared_ptr<TensorImpl> &input, size_t dim,
+                        const std::shared_ptr<TensorImpl> &index,
+                        const std::shared_ptr<TensorImpl> &src) {
+  check_indexed_(*input, dim, *index);
+  check_index_sizes_(*index, *input, dim);
+  check_scatter_src_(*input, *index, *src);
+  auto ret = input->detach()->clone();
+  native::tensor_scatter_add_helper::dispatch(input->dtype)(
+      ret.get(), index.get(), src.get(), dim);
+  if (!input->tracks_grad() && !src->tracks_grad())
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new ScatterAddBack(ret.get(), {input, index, src}, dim));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::index_select(const std::shared_ptr<TensorImpl> &input, size_t dim,
+                         const std::shared_ptr<TensorImpl> &index) {
+  check_indexed_(*input, dim, *index);
+  run_expect(index->dim() == 1, "The index of index_select must be 1-D.");
+  SizeVec sizes = input->view->sizes;
+  sizes[dim] = index->numel();
+  auto ret = create(input->dtype, sizes);
+  native::tensor_index_select_helper::dispatch(input->dtype)(
+      ret.get(), input.get(), index.get(), dim);
+  if (!input->tracks_grad())
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new IndexSelectBack(ret.get(), {input, index}, dim));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::index_add(const std::shared_ptr<TensorImpl> &input, size_t dim,
+                      const std::shared_ptr<TensorImpl> &index,
+                      const std::shared_ptr<TensorImpl> &src) {
+  check_indexed_(*input, dim, *index);
+  run_expect(index->dim() == 1, "The index of index_add must be 1-D.");
+  run_expect(src->dtype == input->dtype, "The source of type ",
+             INNC::to_string(src->dtype), " does not match the input of type ",
+             INNC::to_string(input->dtype), ".");
+  SizeVec sizes = input->view->sizes;
+  sizes[dim] = index->numel();
+  run_expect(src->view->sizes == sizes, "The source of size ", src->size(),
+             " does not match the expected size ", sizes, ".");
+  auto ret = input->detach()->clone();
+  native::tensor_index_add_helper::dispatch(input->dtype)(
+      ret.get(), index.get(), src.get(), dim);
+  if (!input->tracks_grad() && !src->tracks_grad())
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new IndexAddBack(ret.get(), {input, index, src}, dim));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::masked_select(const std::shared_ptr<TensorImpl> &input,
+                          const BitMask &mask) {
+  expect_unbatched(*input, "masked_select");
+  run_expect(mask.sizes == input->view->sizes, "The mask of size ",
+             mask.sizes, " does not match the tensor of size ", input->size(),
+             ".");
+  auto ret = create(input->dtype, SizeVec{mask.count()});
+  native::tensor_masked_select_helper::dispatch(input->dtype)(
+      ret.get(), input.get(), &mask);
+  if (!input->tracks_grad())
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new MaskedSelectBack(ret.get(), {input}, mask));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::checkpoint(const TensorFn &fn,
+                       const std::vector<std::shared_ptr<TensorImpl>> &inputs) {
+  std::vector<std::shared_ptr<TensorImpl>> detached;
+  for (auto &t : inputs)
+    detached.push_back(t->detach());
+  auto &gen = default_generator();
+  std::uint64_t seed = gen.seed(), offset = gen.offset();
+  auto out = fn(detached);
+  bool requires_grad =
+      out->requires_grad ||
+      std::any_of(inputs.begin(), inputs.end(),
+                  [](const auto &t) { return t->tracks_grad(); });
+  auto ret = out->detach();
+  if (!requires_grad)
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new CheckpointBack(ret.get(), inputs, fn, seed, offset));
+  return ret;
+}
+
+// The number of examples shared by `inputs` along dimension 0.
+size_t batch_size_of(const std::vector<std::shared_ptr<TensorImpl>> &inputs) {
+  run_expect(!inputs.empty(), "vmap needs at least one batched input.");
+  size_t n = 0;
+  for (auto &t : inputs) {
+    run_expect(!t->batched, "Nested vmap is not supported.");
+    run_expect(t->dim() != 0, "The inputs of vmap need a batch dimension.");
+    if (n == 0)
+      n = t->size(0);
+    run_expect(t->size(0) == n, "The inputs of vmap have different batch "
+                                "sizes ", n, " and ", t->size(0), ".");
+  }
+  run_expect(n != 0, "The inputs of vmap hold no examples.");
+  return n;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::vmap(const TensorFn &fn,
+                 const std::vector<std::shared_ptr<TensorImpl>> &inputs) {
+  size_t n = batch_size_of(inputs);
+  std::vector<std::shared_ptr<TensorImpl>> batched_inputs;
+  auto same = [](const StridedLayout &v) { return v; };
+  for (auto &t : inputs) {
+    auto b = view_of(t, same);
+    b->batched = true;
+    batched_inputs.push_back(b);
+  }
+  auto out = fn(batched_inputs);
+  if (!out->batched) {
+    // The result does not depend on the example, e.g. a constant.
+    SignedVec sizes;
+    sizes.resize(out->dim() + 1, -1);
+    sizes[0] = n;
+    return expand(out, sizes);
+  }
+  auto ret = view_of(out, same);
+  ret->batched = false;
+  return ret;
+}
+
+std::vector<std::shared_ptr<TensorImpl>> TensorImpl::per_sample_grad(
+    const TensorFn &fn, const std::vector<std::shared_ptr<TensorImpl>> &params,
+    const std::vector<std::shared_ptr<TensorImpl>> &inputs) {
+  size_t n = batch_size_of(inputs);
+  std::vector<std::shared_ptr<TensorImpl>> args, leaves;
+  for (auto &p : params) {
+    run_expect(is_float(p->dtype), "Only float tensors have grads, got ",
+               INNC::to_string(p->dtype), ".");
+    // A copy of `p` for every example without copying the data. Each of
+    // them collects the grad of its own example into a dense grad, which
+    // views of the copies inside `fn` are taken of.
+    auto view_s = strided_view_of(*p);
+    SizeVec _sizes{n};
+    SignedVec _strides{0};
+    _sizes.insert(_sizes.end(), view_s->sizes.begin(), view_s->sizes.end());
+    _strides.insert(_strides.end(), view_s->strides.begin(),
+                    view_s->strides.end());
+    auto leaf = create(
+        p->dtype,
+        std::make_shared<StridedLayout>(_sizes, _strides, view_s->offset),
+        p->data_);
+    leaf->requires_grad = true;
+    leaf->batched = true;
+    leaf->grad = zeros(_sizes, p->dtype);
+    args.push_back(leaf);
+    leaves.push_back(leaf);
+  }
+  for (auto &t : inputs) {
+    auto b = t->detach();
+    b->batched = true;
+    args.push_back(b);
+  }
+  AutoGradMode enable_grad(true);
+  auto out = fn(args);
+  run_expect(out->batched && out->dim() == 1 && out->requires_grad,
+             "The function of per_sample_grad must return a scalar loss "
+             "depending on the params.");
+  // The examples do not interact, so the grad of the summed losses holds
+  // the grad of every example in its own slice.
+  out->batched = false;
+  out->sum()->backward();
+  std::vector<std::shared_ptr<TensorImpl>> grads;
+  for (auto &leaf : leaves)
+    grads.push_back(leaf->grad);
+  return grads;
+}
+
+bool TensorImpl::is_quantized() const noexcept { return qparams != nullptr; }
+
+std::shared_ptr<TensorImpl>
+quantize_with(TensorImpl &t, std::shared_ptr<const QuantParams> &&qp) {
+  expect_not_capturing("quantize");
+  expect_unbatched(t, "quantize");
+  run_expect(is_float(t.dtype), "Tensors with type ", INNC::to_string(t.dtype),
+             " cannot be quantized.");
+  auto src = t.detach()->type(f32);
+  auto ret = TensorImpl::create(i8, StridedLayout{t.view->sizes});
+  auto src_ptr = reinterpret_cast<float *>(src->data_->get_blob());
+  auto dst_ptr = reinterpret_cast<std::int8_t *>(ret->data_->get_blob());
+  for_each_sizevec(ret->view->sizes, [&](const SizeVec &sv) {
+    size_t ch = qp->per_channel() ? sv[qp->axis] : 0;
+    float q = std::nearbyint(*(src_ptr + src->cnt_from_index(sv)) /
+                             qp->scale(ch)) +
+              qp->zero_point(ch);
+    *(dst_ptr + ret->cnt_from_index(sv)) =
+        static_cast<std::int8_t>(std::clamp(q, -128.f, 127.f));
+  });
+  ret->qparams = std::move(qp);
+  return ret;
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::quantize(float scale,
+                                                 std::int32_t zero_point) {
+  run_expect(scale > 0, "The scale of quantization must be positive.");
+  return quantize_with(*this, std::make_shared<const QuantParams>(QuantParams{
+                                  {scale}, {zero_point}, -1}));
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::quantize_per_channel(const std::vector<float> &scales,
+                                 const std::vector<std::int32_t> &zero_points,
+                                 size_t axis) {
+  run_expect(axis < dim(), "Index out of range dimension ", dim(),
+             ". Actual axis of quantization: ", axis);
+  run_expect(scales.size() == size(axis) && zero_points.size() == size(axis),
+             "Expect ", size(axis), " scales and zero points, but got ",
+             scales.size(), " and ", zero_points.size());
+  for (auto s : scales)
+    run_expect(s > 0, "The scale of quantization must be positive.");
+  return quantize_with(*this,
+                       std::make_shared<const QuantParams>(QuantParams{
+                           scales, zero_points, static_cast<long long>(axis)}));
+}
+
+template <typename T>
+void dequantize_as(const TensorImpl &from, TensorImpl &to) {
+  auto src_ptr = reinterpret_cast<T *>(from.data_->get_blob());
+  auto dst_ptr = reinterpret_cast<float *>(to.data_->get_blob());
+  auto &qp = *from.qparams;
+  for_each_sizevec(from.view->sizes, [&](const SizeVec &sv) {
+    size_t ch = qp.per_channel() ? sv[qp.axis] : 0;
+    *(dst_ptr + to.cnt_from_index(sv)) =
+        (*(src_ptr + from.cnt_from_index(sv)) - qp.zero_point(ch)) *
+        qp.scale(ch);
+  });
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::dequantize() {
+  expect_not_capturing("dequantize");
+  run_expect(is_quantized(), "Cannot dequantize a tensor without quantization "
+                             "parameters.");
+  auto ret = create(f32, StridedLayout{view->sizes});
+  if (dtype == i32)
+    dequantize_as<std::int32_t>(*this, *ret);
+  else
+    dequantize_as<std::int8_t>(*this, *ret);
+  return ret;
+}
+
+const std::int8_t *contiguous_s8(std::shared_ptr<TensorImpl> &t) {
+  if (!t->is_contiguous())
+    t = t->contiguous();
+  return reinterpret_cast<std::int8_t *>(t->data_->get_blob()) +
+         dynamic_cast<StridedLayout *>(t->view.get())->offset;
+}
+
+// Returns the zero-point corrected int32 products of `a` and `b`.
+std::shared_ptr<TensorImpl> qmatmul_s32(const std::shared_ptr<TensorImpl> &a,
+                                        const std::shared_ptr<TensorImpl> &b) {
+  expect_not_capturing("qmatmul");
+  expect_unbatched(*a, "qmatmul");
+  expect_unbatched(*b, "qmatmul");
+  run_expect(a->is_quantized() && b->is_quantized(),
+             "Both operands of qmatmul must be quantized.");
+  // The int32 products keep their scales for `dequantize`, but cannot be
+  // multiplied again.
+  run_expect(a->dtype == i8 && b->dtype == i8,
+             "qmatmul needs int8 operands, got ", to_string(a->dtype),
+             " and ", to_string(b->dtype), ".");
+  run_expect(a->dim() == 2 && b->dim() == 2,
+             "qmatmul only supports 2-D tensors.");
+  run_expect(a->size(1) == b->size(0), "Cannot multiply matrices of sizes ",
+             a->size(), " and ", b->size());
+  run_expect(!a->qparams->per_channel(),
+             "The left operand of qmatmul must be quantized per tensor.");
+  run_expect(!b->qparams->per_channel() || b->qparams->axis == 1,
+             "The right operand of qmatmul can only be quantized per column.");
+  size_t m = a->size(0), k = a->size(1), n = b->size(1);
+  auto ac = a;
+  auto bt = TensorImpl::transpose(b->detach(), 0, 1);
+  auto a_ptr = contiguous_s8(ac);
+  auto bt_ptr = contiguous_s8(bt);
+  auto ret = TensorImpl::create(i32, StridedLayout{SizeVec{m, n}});
+  auto c_ptr = reinterpret_cast<std::int32_t *>(ret->data_->get_blob());
+  native::gemm_s8s8s32(a_ptr, bt_ptr, c_ptr, m, n, k);
+  native::gemm_s8_zero_point_fix(c_ptr, a_ptr, bt_ptr, m, n, k,
+                                 a->qparams->zero_points[0],
+                                 b->qparams->zero_points.data(),
+                                 b->qparams->zero_points.size());
+  return ret;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::qmatmul(const std::shared_ptr<TensorImpl> &a,
+                    const std::shared_ptr<TensorImpl> &b) {
+  auto ret = qmatmul_s32(a, b);
+  std::vector<float> scales;
+  for (auto s : b->qparams->scales)
+    scales.push_back(a->qparams->scales[0] * s);
+  ret->qparams = std::make_shared<const QuantParams>(QuantParams{
+      std::move(scales),
+      std::vector<std::int32_t>(b->qparams->scales.size(), 0),
+      b->qparams->axis});
+  return ret;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::qmatmul(const std::shared_ptr<TensorImpl> &a,
+                    const std::shared_ptr<TensorImpl> &b, float out_scale,
+                    std::int32_t out_zero_point) {
+  run_expect(out_scale > 0, "The scale of quantization must be positive.");
+  auto acc = qmatmul_s32(a, b);
+  size_t m = acc->size(0), n = acc->size(1);
+  std::vector<float> multiplier;
+  for (auto s : b->qparams->scales)
+    multiplier.push_back(a->qparams->scales[0] * s / out_scale);
+  auto ret = create(i8, StridedLayout{SizeVec{m, n}});
+  native::requantize_s32_s8(
+      reinterpret_cast<std::int32_t *>(acc->data_->get_blob()),
+      reinterpret_cast<std::int8_t *>(ret->data_->get_blob()), m, n,
+      multiplier.data(), multiplier.size(), out_zero_point);
+  ret->qparams = std::make_shared<const QuantParams>(
+      QuantParams{{out_scale}, {out_zero_point}, -1});
+  return ret;
+}
+
+// The product of the sizes of `t` but the last one.
+size_t rows_of_(const TensorImpl &t) {
+  size_t m = 1;
+  for (size_t d = 0; d + 1 < t.dim(); ++d)
+    m *= t.view->sizes[d];
+  return m;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::linear(const std::shared_ptr<TensorImpl> &input,
+                   const std::shared_ptr<TensorImpl> &weight,
+                   const std::shared_ptr<TensorImpl> &bias, activation act) {
+  expect_not_capturing("linear");
+  expect_unbatched(*weight, "The weight of linear");
+  run_expect(is_float(input->dtype) && weight->dtype == input->dtype &&
+                 (bias == nullptr || bias->dtype == input->dtype),
+             "linear needs float operands of the same type.");
+  run_expect(input->dim() >= 1 && weight->dim() == 2 &&
+                 input->size(-1) == weight->size(1),
+             "Cannot apply a weight of size ", weight->size(),
+             " to an input of size ", input->size());
+  if (bias != nullptr) {
+    expect_unbatched(*bias, "The bias of linear");
+    run_expect(bias->dim() == 1 && bias->size(0) == weight->size(0),
+               "The bias of size ", bias->size(),
+               " does not match the weight of size ", weight->size());
+  }
+  size_t m = rows_of_(*input), n = weight->size(0), k = weight->size(1);
+  auto ct = linear_compute_type(input->dtype);
+  auto x = contiguous_as(*input, ct);
+  auto w = contiguous_as(*weight, ct);
+  auto b = bias == nullptr ? nullptr : contiguous_as(*bias, ct);
+  SizeVec sizes = input->view->sizes;
+  sizes.back() = n;
+  auto ret = create(ct, StridedLayout{sizes});
+  bool grad = input->tracks_grad() || weight->tracks_grad() ||
+              (bias != nullptr && bias->tracks_grad());
+  // Only the grad of gelu needs its inputs, that of relu uses the outputs.
+  auto pre_act = grad && act == activation::gelu
+                     ? create(ct, StridedLayout{SizeVec{m, n}})
+                     : nullptr;
+  visit_linear_type(ct, [&]<typename T>(T) {
+    native::gemm_epilogue(data_of<T>(*x), k, 1, data_of<T>(*w), 1, k,
+                          data_of<T>(*ret), m, n, k,
+                          b == nullptr ? nullptr : data_of<T>(*b), act,
+                          pre_act == nullptr ? nullptr : data_of<T>(*pre_act),
+                          nullptr);
+  });
+  if (ct != input->dtype)
+    ret = ret->type(input->dtype);
+  ret->batched = input->batched;
+  if (!grad)
+    return ret;
+  ret->requires_grad = true;
+  std::vector<std::shared_ptr<TensorImpl>> inputs{input, weight};
+  if (bias != nullptr)
+    inputs.push_back(bias);
+  ret->grad_fn.reset(new LinearBack(ret.get(), inputs, act, pre_act));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl> softmax_(const std::shared_ptr<TensorImpl> &input,
+                                     size_t dim, bool log) {
+  const char *op = log ? "log_softmax" : "softmax";
+  expect_not_capturing(op);
+  run_expect(is_float(input->dtype), op, " needs a float tensor, got ",
+             INNC::to_string(input->dtype), ".");
+  dim += input->batched;
+  run_expect(dim < input->dim(), "Index out of range dimension ", input->dim(),
+             ". Actual input of ", op, ": ", dim);
+  auto [outer, n, inner] = split_sizes_at(input->view->sizes, dim);
+  auto ct = linear_compute_type(input->dtype);
+  auto x = contiguous_as(*input, ct);
+  auto ret = TensorImpl::create(ct, StridedLayout{input->view->sizes});
+  visit_linear_type(ct, [&]<typename T>(T) {
+    native::softmax(data_of<T>(*x), data_of<T>(*ret), outer, n, inner, log);
+  });
+  if (ct != input->dtype)
+    ret = ret->type(input->dtype);
+  ret->batched = input->batched;
+  if (!input->tracks_grad())
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new SoftmaxBack(ret.get(), {input}, dim, log));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::softmax(const std::shared_ptr<TensorImpl> &input, size_t dim) {
+  return softmax_(input, dim, false);
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::log_softmax(const std::shared_ptr<TensorImpl> &input, size_t dim) {
+  return softmax_(input, dim, true);
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::cross_entropy(const std::shared_ptr<TensorImpl> &input,
+                          const std::shared_ptr<TensorImpl> &target) {
+  expect_not_capturing("cross_entropy");
+  run_expect(is_float(input->dtype), "cross_entropy needs float logits, got ",
+             INNC::to_string(input->dtype), ".");
+  run_expect(target->dtype == i64, "Targets must be an i64 tensor, got ",
+             INNC::to_string(target->dtype), ".");
+  run_expect(target->batched == input->batched,
+             "The target of cross_entropy must be batched like the logits.");
+  run_expect(input->dim() > input->batched, "cross_entropy needs logits "
+                                            "with a class dimension.");
+  SizeVec sizes = input->view->sizes;
+  sizes.pop_back();
+  run_expect(target->view->sizes == sizes, "The target of size ",
+             target->size(), " does not match the logits of size ",
+             input->size());
+  size_t m = rows_of_(*input), n = input->size(-1);
+  // Every example of a batched input is averaged on its own.
+  size_t groups = input->batched ? input->view->sizes[0] : 1;
+  size_t group = groups == 0 ? 0 : m / groups;
+  auto ct = linear_compute_type(input->dtype);
+  auto x = contiguous_as(*input, ct);
+  auto t = contiguous_as(*target, i64);
+  auto loss = create(ct, StridedLayout{SizeVec{m}});
+  auto lse = create(ct, StridedLayout{SizeVec{m}});
+  auto ret = create(
+      ct, StridedLayout{input->batched ? SizeVec{groups} : SizeVec{}});
+  visit_linear_type(ct, [&]<typename T>(T) {
+    native::cross_entropy(data_of<T>(*x), data_of<std::int64_t>(*t),
+                          data_of<T>(*loss), data_of<T>(*lse), m, n);
+    auto l = data_of<T>(*loss);
+    for (size_t g = 0; g < ret->numel(); ++g) {
+      double s = 0;
+      for (size_t i = 0; i < group; ++i)
+        s += l[g * group + i];
+      data_of<T>(*ret)[g] = s / group;
     }
+  });
+  if (ct != input->dtype)
+    ret = ret->type(input->dtype);
+  ret->batched = input->batched;
+  if (!input->tracks_grad())
     return ret;
-  } else {
-    std::normal_distribution<double> gen_norm{};
-    auto ret = create(INNC::f32, StridedLayout{sizes});
-    auto dptr = reinterpret_cast<double *>(ret->data_->get_blob());
-    for (size_t i = 0; i < ret->numel(); ++i) {
-      *(dptr + i) = gen_norm(rng);
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new CrossEntropyBack(ret.get(), {input, target}, lse));
+  return ret;
+}
+
+// Checks that `weight` and `bias` are both null, or unbatched tensors of
+// `sizes` and the type of the input.
+void expect_affine_(const std::shared_ptr<TensorImpl> &weight,
+                    const std::shared_ptr<TensorImpl> &bias, types dtype,
+                    const SizeVec &sizes, const char *op) {
+  run_expect((weight == nullptr) == (bias == nullptr), op,
+             " needs both a weight and a bias, or neither.");
+  if (weight == nullptr)
+    return;
+  for (auto t : {weight.get(), bias.get()}) {
+    expect_unbatched(*t, op);
+    run_expect(t->dtype == dtype, op,
+               " needs a weight and a bias of the type of the input.");
+    run_expect(t->view->sizes == sizes, "The weight and bias of ", op,
+               " must be of size ", sizes, ", got ", t->size());
+  }
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::layer_norm(const std::shared_ptr<TensorImpl> &input,
+                       const SizeVec &normalized_shape,
+                       const std::shared_ptr<TensorImpl> &weight,
+                       const std::shared_ptr<TensorImpl> &bias, double eps) {
+  expect_not_capturing("layer_norm");
+  run_expect(is_float(input->dtype), "layer_norm needs a float tensor, got ",
+             INNC::to_string(input->dtype), ".");
+  size_t k = normalized_shape.size(), dim = input->dim();
+  run_expect(k <= dim - input->batched &&
+                 std::equal(normalized_shape.begin(), normalized_shape.end(),
+                            input->view->sizes.end() - k),
+             "Cannot normalize the shape ", normalized_shape,
+             " of an input of size ", input->size());
+  expect_affine_(weight, bias, input->dtype, normalized_shape, "layer_norm");
+  size_t n = 1;
+  for (auto s : normalized_shape)
+    n *= s;
+  size_t m = n == 0 ? 0 : input->numel() / n;
+  auto ct = linear_compute_type(input->dtype);
+  auto x = contiguous_as(*input, ct);
+  auto w = weight == nullptr ? nullptr : contiguous_as(*weight, ct);
+  auto b = bias == nullptr ? nullptr : contiguous_as(*bias, ct);
+  auto ret = create(ct, StridedLayout{input->view->sizes});
+  auto mean = create(ct, StridedLayout{SizeVec{m}});
+  auto rstd = create(ct, StridedLayout{SizeVec{m}});
+  visit_linear_type(ct, [&]<typename T>(T) {
+    native::layer_norm(data_of<T>(*x), w == nullptr ? nullptr : data_of<T>(*w),
+                       b == nullptr ? nullptr : data_of<T>(*b),
+                       data_of<T>(*ret), data_of<T>(*mean), data_of<T>(*rstd),
+                       m, n, eps);
+  });
+  if (ct != input->dtype)
+    ret = ret->type(input->dtype);
+  ret->batched = input->batched;
+  bool grad = input->tracks_grad() ||
+              (weight != nullptr &&
+               (weight->tracks_grad() || bias->tracks_grad()));
+  if (!grad)
+    return ret;
+  ret->requires_grad = true;
+  std::vector<std::shared_ptr<TensorImpl>> inputs{input};
+  if (weight != nullptr)
+    inputs.insert(inputs.end(), {weight, bias});
+  ret->grad_fn.reset(new LayerNormBack(ret.get(), inputs, mean, rstd));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::batch_norm(const std::shared_ptr<TensorImpl> &input,
+                       const std::shared_ptr<TensorImpl> &running_mean,
+                       const std::shared_ptr<TensorImpl> &running_var,
+                       const std::shared_ptr<TensorImpl> &weight,
+                       const std::shared_ptr<TensorImpl> &bias, bool training,
+                       double momentum, double eps) {
+  expect_not_capturing("batch_norm");
+  expect_unbatched(*input, "The input of batch_norm");
+  run_expect(is_float(input->dtype), "batch_norm needs a float tensor, got ",
+             INNC::to_string(input->dtype), ".");
+  run_expect(input->dim() >= 2,
+             "batch_norm needs an input of [N, C, ...], got ", input->size());
+  auto [outer, c, inner] = split_sizes_at(input->view->sizes, 1);
+  run_expect((running_mean == nullptr) == (running_var == nullptr),
+             "batch_norm needs both running statistics, or neither.");
+  run_expect(training || running_mean != nullptr,
+             "batch_norm needs running statistics outside of training.");
+  run_expect(!training || outer * inner > 1,
+             "batch_norm needs more than one value per channel in training, "
+             "got an input of size ",
+             input->size());
+  if (running_mean != nullptr)
+    for (auto t : {running_mean.get(), running_var.get()}) {
+      expect_unbatched(*t, "The running statistics of batch_norm");
+      run_expect(is_float(t->dtype) && t->view->sizes == SizeVec{c},
+                 "The running statistics of batch_norm must be float tensors "
+                 "of size [",
+                 c, "], got ", t->size());
     }
+  expect_affine_(weight, bias, input->dtype, SizeVec{c}, "batch_norm");
+  auto ct = linear_compute_type(input->dtype);
+  auto x = contiguous_as(*input, ct);
+  auto w = weight == nullptr ? nullptr : contiguous_as(*weight, ct);
+  auto b = bias == nullptr ? nullptr : contiguous_as(*bias, ct);
+  auto ret = create(ct, StridedLayout{input->view->sizes});
+  auto mean = training ? create(ct, StridedLayout{SizeVec{c}})
+                       : contiguous_as(*running_mean, ct);
+  auto var = training ? create(ct, StridedLayout{SizeVec{c}})
+                      : contiguous_as(*running_var, ct);
+  visit_linear_type(ct, [&]<typename T>(T) {
+    native::batch_norm(data_of<T>(*x), w == nullptr ? nullptr : data_of<T>(*w),
+                       b == nullptr ? nullptr : data_of<T>(*b),
+                       data_of<T>(*ret), data_of<T>(*mean), data_of<T>(*var),
+                       outer, c, inner, eps, training);
+  });
+  if (training && running_mean != nullptr) {
+    auto rm = contiguous_as(*running_mean, ct);
+    auto rv = contiguous_as(*running_var, ct);
+    visit_linear_type(ct, [&]<typename T>(T) {
+      T mom(momentum), unbias = T(outer * inner) / T(outer * inner - 1);
+      for (size_t ch = 0; ch < c; ++ch) {
+        data_of<T>(*rm)[ch] =
+            (1 - mom) * data_of<T>(*rm)[ch] + mom * data_of<T>(*mean)[ch];
+        data_of<T>(*rv)[ch] = (1 - mom) * data_of<T>(*rv)[ch] +
+                              mom * data_of<T>(*var)[ch] * unbias;
+      }
+    });
+    running_mean->copy_(*rm);
+    running_var->copy_(*rv);
+  }
+  if (ct != input->dtype)
+    ret = ret->type(input->dtype);
+  bool grad = input->tracks_grad() ||
+              (weight != nullptr &&
+               (weight->tracks_grad() || bias->tracks_grad()));
+  if (!grad)
     return ret;
+  ret->requires_grad = true;
+  // Outside of training, `mean` and `var` may share the storage of the
+  // running statistics, which later training steps update in place.
+  if (!training) {
+    mean = mean->clone();
+    var = var->clone();
   }
+  std::vector<std::shared_ptr<TensorImpl>> inputs{input};
+  if (weight != nullptr)
+    inputs.insert(inputs.end(), {weight, bias});
+  ret->grad_fn.reset(
+      new BatchNormBack(ret.get(), inputs, mean, var, eps, training));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::dropout(const std::shared_ptr<TensorImpl> &input, double p,
+                    bool training, Generator &gen) {
+  expect_not_capturing("dropout");
+  run_expect(is_float(input->dtype), "dropout needs a float tensor, got ",
+             INNC::to_string(input->dtype), ".");
+  run_expect(p >= 0 && p <= 1, "The probability of dropout must be in [0, 1], "
+                               "got ",
+             p, ".");
+  if (!training || p == 0)
+    return input;
+  auto ct = linear_compute_type(input->dtype);
+  auto x = contiguous_as(*input, ct);
+  auto ret = create(ct, StridedLayout{input->view->sizes});
+  std::uint64_t seed = gen.seed(), offset = 0;
+  visit_linear_type(ct, [&]<typename T>(T) {
+    size_t n = ret->numel();
+    offset = gen.reserve(native::philox_counters(n, sizeof(T)));
+    native::dropout(data_of<T>(*x), data_of<T>(*ret), n, p, seed, offset);
+  });
+  if (ct != input->dtype)
+    ret = ret->type(input->dtype);
+  ret->batched = input->batched;
+  if (!input->tracks_grad())
+    return ret;
+  ret->requires_grad = true;
+  ret->grad_fn.reset(new DropoutBack(ret.get(), {input}, p, seed, offset));
+  return ret;
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::rand(const SizeVec &sizes,
+                                             types dtype, Generator &gen) {
+  expect_not_capturing("rand");
+  run_expect(INNC::is_float(dtype), "Tensors with integer type ",
+             INNC::to_string(dtype),
+             " cannot be generated from a uniform distribution");
+  auto ct = linear_compute_type(dtype);
+  auto ret = create(ct, StridedLayout{sizes});
+  visit_linear_type(ct, [&]<typename T>(T) {
+    // Reduced floats only draw the bits they keep, as rounding more of them
+    // could give 1.
+    int digits = dtype == f16    ? 11
+                 : dtype == bf16 ? 8
+                                 : std::numeric_limits<T>::digits;
+    size_t n = ret->numel();
+    native::uniform(data_of<T>(*ret), n, 0, 1, gen.seed(),
+                    gen.reserve(native::philox_counters(n, sizeof(T))),
+                    digits);
+  });
+  return ct == dtype ? ret : ret->type(dtype);
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::randint(std::int64_t low,
+                                                std::int64_t high,
+                                                const SizeVec &sizes,
+                                                types dtype, Generator &gen) {
+  expect_not_capturing("randint");
+  run_expect(low < high, "randint needs low < high, got [", low, ", ", high,
+             ").");
+  auto ret = create(i64, StridedLayout{sizes});
+  size_t n = ret->numel();
+  native::randint(data_of<std::int64_t>(*ret), n, low, high, gen.seed(),
+                  gen.reserve(native::philox_counters(n, 8)));
+  return dtype == i64 ? ret : ret->type(dtype);
+}
+
+std::shared_ptr<TensorImpl> TensorImpl::randn(const SizeVec &sizes,
+                                              types dtype, Generator &gen) {
+  expect_not_capturing("randn");
+  run_expect(INNC::is_float(dtype), "Tensors with integer type ",
+             INNC::to_string(dtype),
+             " cannot be generated from a normal distribution");
+  auto ct = linear_compute_type(dtype);
+  auto ret = create(ct, StridedLayout{sizes});
+  visit_linear_type(ct, [&]<typename T>(T) {
+    size_t n = ret->numel();
+    native::normal(data_of<T>(*ret), n, gen.seed(),
+                   gen.reserve(native::philox_counters(n, sizeof(T))));
+  });
+  return ct == dtype ? ret : ret->type(dtype);
+}
+
+std::shared_ptr<TensorImpl>
+TensorImpl::bernoulli(const std::shared_ptr<TensorImpl> &p, Generator &gen) {
+  expect_not_capturing("bernoulli");
+  run_expect(is_float(p->dtype), "bernoulli needs float probabilities, got ",
+             INNC::to_string(p->dtype), ".");
+  auto ct = linear_compute_type(p->dtype);
+  auto probs = contiguous_as(*p, ct);
+  auto ret = create(ct, StridedLayout{p->view->sizes});
+  visit_linear_type(ct, [&]<typename T>(T) {
+    size_t n = ret->numel();
+    native::bernoulli(data_of<T>(*probs), data_of<T>(*ret), n, gen.seed(),
+                      gen.reserve(native::philox_counters(n, sizeof(T))));
+  });
+  if (ct != p->dtype)
+    ret = ret->type(p->dtype);
+  ret->batched = p->batched;
+  return ret;
 }
 
 std::shared_ptr<TensorImpl> TensorImpl::randn_like(const TensorImpl &t) {
@@ -806,6 +2083,8 @@ std::shared_ptr<TensorImpl> TensorImpl::randn_like(const TensorImpl &t) {
 std::shared_ptr<TensorImpl>
 TensorImpl::cat(const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_ts,
                 const size_t dim) {
+  for (auto &t : input_ts)
+    expect_unbatched(*t, "cat");
   run_expect(dim >= 0 && dim < input_ts[0]->dim(),
              "you give out a illegal dim");
   for (size_t i = 1; i < input_ts.size(); i++) {
@@ -840,7 +2119,7 @@ TensorImpl::cat(const std::vector<std::shared_ptr<INNC::TensorImpl>> &input_ts,
 
   bool requires_grad = false;
   for (const auto &t : input_ts)
-    if (t->requires_grad) {
+    if (t->tracks_grad()) {
       requires_grad = true;
       break;
     }
@@ -28,6 +28,8 @@ std::string innc_type_to_string(NumericType auto num, types t) {
 
 std::string innc_type_to_string(void *ptr, types t) {
   switch (t) {
+  case b8:
+    return std::to_string(*static_cast<bool *>(ptr));
   case i8:
     return std::to_string(*static_cast<std::int8_t *>(ptr));
   case i16:
@@ -36,6 +38,10 @@ std::string innc_type_to_string(void *ptr, types t) {
     return std::to_string(*static_cast<std::int32_t *>(ptr));
   case i64:
     return std::to_string(*static_cast<std::int64_t *>(ptr));
+  case f16:
+    return std::to_string(float(*static_cast<half *>(ptr)));
+  case bf16:
+    return std::to_string(float(*static_cast<bfloat16 *>(ptr)));
   case f32:
     return std::to_string(*static_cast<float *>(ptr));
   case f64:
@@ -78,13 +84,9 @@ std::ostream &operator<<(std::ostream &o, const SignedVec &sv) noexcept {
 
 SizeVec::SizeVec() = default;
 SizeVec::SizeVec(const std::initializer_list<size_t> &init_list)
-    : std::vector<size_t>{init_list} {}
-SizeVec::SizeVec(is_same_wo_cvref<std::vector<int>> auto &&vec)
-    : std::vector<size_t>(std::forward<decltype(vec)>(vec)) {}
+    : SmallVec(init_list) {}
 
 SignedVec::SignedVec() = default;
 SignedVec::SignedVec(const std::initializer_list<long long> &init_list)
-    : std::vector<long long>{init_list} {}
-SignedVec::SignedVec(is_same_wo_cvref<std::vector<int>> auto &&vec)
-    : std::vector<size_t>(std::forward<decltype(vec)>(vec)) {}
+    : SmallVec(init_list) {}
 } // namespace INNC
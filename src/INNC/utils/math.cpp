@@ -0,0 +1,12 @@
+#include "INNC/utils/math.hpp"
+#include <atomic>
+
+namespace INNC {
+static std::atomic<bool> fast{false};
+
+bool fast_math() noexcept { return fast.load(std::memory_order_relaxed); }
+
+void use_fast_math(bool b) noexcept {
+  fast.store(b, std::memory_order_relaxed);
+}
+} // namespace INNC
@@ -0,0 +1,117 @@
+#include "INNC/utils/parallel.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+namespace INNC {
+static std::atomic<size_t> num_threads{0};
+static std::atomic<bool> deterministic{false};
+
+size_t get_num_threads() noexcept {
+  size_t n = num_threads.load(std::memory_order_relaxed);
+  if (n != 0)
+    return n;
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void set_num_threads(size_t n) noexcept {
+  num_threads.store(n, std::memory_order_relaxed);
+}
+
+NumThreadsGuard::NumThreadsGuard(size_t n) noexcept
+    : prev(num_threads.exchange(n, std::memory_order_relaxed)) {}
+
+NumThreadsGuard::~NumThreadsGuard() {
+  num_threads.store(prev, std::memory_order_relaxed);
+}
+
+bool deterministic_algorithms() noexcept {
+  return deterministic.load(std::memory_order_relaxed);
+}
+
+void use_deterministic_algorithms(bool b) noexcept {
+  deterministic.store(b, std::memory_order_relaxed);
+}
+
+// Workers sleeping between jobs instead of being spawned for each of them.
+// The pool grows to the most chunks a job has asked for. Threads claim the
+// chunks of a job one at a time, the submitting thread included.
+class ThreadPool {
+  std::mutex busy, m;
+  std::condition_variable work, done;
+  std::vector<std::thread> workers;
+  void (*run)(void *, size_t) = nullptr;
+  void *ctx = nullptr;
+  size_t chunks = 0, next = 0, pending = 0, job = 0;
+  bool stop = false;
+
+  // Whether the thread runs chunks of the pool, so that a nested call must
+  // not wait for the pool.
+  static thread_local bool in_pool;
+
+  // Runs the unclaimed chunks of the current job. `lock` holds `m`.
+  void claim(std::unique_lock<std::mutex> &lock) {
+    while (next < chunks) {
+      size_t c = next++;
+      lock.unlock();
+      run(ctx, c);
+      lock.lock();
+      if (--pending == 0)
+        done.notify_all();
+    }
+  }
+
+  void loop() {
+    in_pool = true;
+    size_t seen = 0;
+    std::unique_lock lock(m);
+    while (true) {
+      work.wait(lock, [&] { return stop || job != seen; });
+      if (stop)
+        return;
+      seen = job;
+      claim(lock);
+    }
+  }
+
+public:
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(m);
+      stop = true;
+    }
+    work.notify_all();
+    for (auto &w : workers)
+      w.join();
+  }
+
+  void parallel_run(size_t n, void (*f)(void *, size_t), void *c) {
+    std::unique_lock owner(busy, std::defer_lock);
+    if (in_pool || !owner.try_lock()) {
+      for (size_t i = 0; i < n; ++i)
+        f(c, i);
+      return;
+    }
+    std::unique_lock lock(m);
+    while (workers.size() + 1 < n)
+      workers.emplace_back([this] { loop(); });
+    run = f;
+    ctx = c;
+    chunks = pending = n;
+    next = 0;
+    ++job;
+    work.notify_all();
+    in_pool = true;
+    claim(lock);
+    in_pool = false;
+    done.wait(lock, [&] { return pending == 0; });
+  }
+};
+
+thread_local bool ThreadPool::in_pool = false;
+
+void parallel_run(size_t chunks, void (*run)(void *, size_t), void *ctx) {
+  static ThreadPool pool;
+  pool.parallel_run(chunks, run, ctx);
+}
+} // namespace INNC
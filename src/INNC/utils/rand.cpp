@@ -1,5 +1,254 @@
 #include "INNC/utils/rand.hpp"
+#include "INNC/utils/lanes.hpp"
+#include "INNC/utils/math.hpp"
+#include "INNC/utils/parallel.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <random>
 
 namespace INNC {
-std::mt19937 rng{std::random_device{}()};
+Generator &default_generator() noexcept {
+  static Generator gen{(std::uint64_t(std::random_device{}()) << 32) |
+                       std::random_device{}()};
+  return gen;
 }
+
+void manual_seed(std::uint64_t seed) noexcept {
+  default_generator().manual_seed(seed);
+}
+
+namespace native {
+
+// Elements generated by one thread at least.
+constexpr size_t rand_grain_ = 1 << 14;
+constexpr size_t lanes_ = reduce_lanes;
+
+// The words of the `lanes_` counters of a block, w[k][l] being the k-th of
+// the l-th counter.
+using Words_ = std::uint32_t[4][lanes_];
+
+std::uint64_t philox_counters(size_t n, size_t draw_size) noexcept {
+  size_t per_block = lanes_ * 16 / draw_size;
+  return (n + per_block - 1) / per_block * lanes_;
+}
+
+// Fills y[0, n) by blocks of elements made of the words of `lanes_`
+// consecutive counters. `f(w, out, base, count)` turns the words into the
+// `count` elements from `base` on, computing all of `out` if it likes.
+template <typename T, typename F>
+void philox_fill_(T *y, size_t n, std::uint64_t seed, std::uint64_t offset,
+                  F f) {
+  constexpr size_t per_block = lanes_ * 16 / sizeof(T);
+  size_t blocks = (n + per_block - 1) / per_block;
+  parallel_for(blocks, rand_grain_ / per_block + 1,
+               [&](size_t begin, size_t end, size_t) {
+                 Words_ w;
+                 T out[per_block];
+                 for (size_t u = begin; u < end; ++u) {
+                   std::uint64_t ctr = offset + u * lanes_;
+                   for_lanes(lanes_, [&](size_t l) {
+                     auto r = philox(seed, ctr + l);
+                     w[0][l] = r[0];
+                     w[1][l] = r[1];
+                     w[2][l] = r[2];
+                     w[3][l] = r[3];
+                   });
+                   size_t base = u * per_block,
+                          count = std::min(per_block, n - base);
+                   f(w, out, base, count);
+                   std::copy(out, out + count, y + base);
+                 }
+               });
+}
+
+// The 64 bits of the words k and k + 1 of the l-th counter.
+inline std::uint64_t bits64_(const Words_ &w, size_t k, size_t l) {
+  return (std::uint64_t(w[k][l]) << 32) | w[k + 1][l];
+}
+
+// Numbers of [0, 1) made of the top `digits` bits, by default all the bits
+// of the mantissa: out[j] from word j / lanes_ (floats) or from words
+// 2 * (j / lanes_) and the next (doubles) of the (j % lanes_)-th counter.
+void units_(const Words_ &w, float *out, int digits = 24) {
+  float unit = std::ldexp(1.f, -digits);
+  for (size_t k = 0; k < 4; ++k)
+    for_lanes(lanes_, [&](size_t l) {
+      out[k * lanes_ + l] = float(w[k][l] >> (32 - digits)) * unit;
+    });
+}
+
+void units_(const Words_ &w, double *out, int digits = 53) {
+  double unit = std::ldexp(1., -digits);
+  for (size_t h = 0; h < 2; ++h)
+    for_lanes(lanes_, [&](size_t l) {
+      out[h * lanes_ + l] =
+          double(bits64_(w, 2 * h, l) >> (64 - digits)) * unit;
+    });
+}
+
+template <typename T>
+void uniform_(T *y, size_t n, double low, double high, std::uint64_t seed,
+              std::uint64_t offset, int digits) {
+  T lo(low), span(high - low);
+  philox_fill_(y, n, seed, offset,
+               [&](const Words_ &w, T *out, size_t, size_t) {
+                 units_(w, out, digits);
+                 for (size_t j = 0; j < lanes_ * 16 / sizeof(T); j += lanes_)
+                   for_lanes(lanes_, [&](size_t l) {
+                     out[j + l] = lo + span * out[j + l];
+                   });
+               });
+}
+
+void uniform(float *y, size_t n, double low, double high, std::uint64_t seed,
+             std::uint64_t offset, int digits) {
+  uniform_(y, n, low, high, seed, offset, digits);
+}
+
+void uniform(double *y, size_t n, double low, double high, std::uint64_t seed,
+             std::uint64_t offset, int digits) {
+  uniform_(y, n, low, high, seed, offset, digits);
+}
+
+// sin(v * pi / 2) and cos(v * pi / 2) for v in [0, 1), from the Taylor
+// polynomials of y = (v - 1/2) * pi / 2 in [-pi/4, pi/4) and the sum of
+// angles with pi / 4. Branch-free, unlike std::sin and std::cos.
+inline void quarter_sincos_(float v, float &s, float &c) noexcept {
+  float y = (v - .5f) * 1.57079633f, y2 = y * y;
+  float ps = 1.f / 362880;
+  ps = ps * y2 - 1.f / 5040;
+  ps = ps * y2 + 1.f / 120;
+  ps = ps * y2 - 1.f / 6;
+  ps = ps * y2 + 1;
+  float pc = -1.f / 3628800;
+  pc = pc * y2 + 1.f / 40320;
+  pc = pc * y2 - 1.f / 720;
+  pc = pc * y2 + 1.f / 24;
+  pc = pc * y2 - .5f;
+  pc = pc * y2 + 1;
+  float sy = y * ps;
+  s = (pc + sy) * .707106781f;
+  c = (pc - sy) * .707106781f;
+}
+
+// sqrt(t) for t >= 0 from three Newton steps of 1 / sqrt(t), within 2 ulp.
+// std::sqrt branches to set errno for negatives, which keeps loops over it
+// from vectorizing. 0 gives about 1e-18.
+inline float sqrt_(float t) noexcept {
+  t += 1e-36f;
+  float r = std::bit_cast<float>(0x5f375a86 -
+                                 (std::bit_cast<std::int32_t>(t) >> 1));
+  r *= 1.5f - .5f * t * r * r;
+  r *= 1.5f - .5f * t * r * r;
+  r *= 1.5f - .5f * t * r * r;
+  return t * r;
+}
+
+inline float flip_sign_(float v, std::uint32_t bit) noexcept {
+  return std::bit_cast<float>(std::bit_cast<std::uint32_t>(v) ^ (bit << 31));
+}
+
+// Words 2h and 2h + 1 give the radius and the angle of two numbers. The angle
+// is uniform in a quarter turn, and two bits of its word pick the quadrant by
+// the signs of its cosine and sine, which keeps it uniform in a full turn.
+void normal(float *y, size_t n, std::uint64_t seed, std::uint64_t offset) {
+  philox_fill_(y, n, seed, offset,
+               [&](const Words_ &w, float *out, size_t, size_t) {
+                 for (size_t h = 0; h < 2; ++h)
+                   for_lanes(lanes_, [&](size_t l) {
+                     std::uint32_t wr = w[2 * h][l], wa = w[2 * h + 1][l];
+                     // In (0, 1], as log(0) is -inf.
+                     float u = float((wr >> 8) + 1) * 0x1p-24f;
+                     float r = sqrt_(-2 * math::fast_log_normal(u)), s, c;
+                     quarter_sincos_(float(wa >> 8) * 0x1p-24f, s, c);
+                     out[2 * h * lanes_ + l] = flip_sign_(r * c, wa & 1);
+                     out[(2 * h + 1) * lanes_ + l] =
+                         flip_sign_(r * s, (wa >> 1) & 1);
+                   });
+               });
+}
+
+// Doubles use the library, the words 0 and 1 giving the radius and 2 and 3
+// the angle of two numbers.
+void normal(double *y, size_t n, std::uint64_t seed, std::uint64_t offset) {
+  philox_fill_(y, n, seed, offset,
+               [&](const Words_ &w, double *out, size_t, size_t count) {
+                 for (size_t l = 0; l < std::min(lanes_, count); ++l) {
+                   double u = double((bits64_(w, 0, l) >> 11) + 1) * 0x1p-53,
+                          a = double(bits64_(w, 2, l) >> 11) * 0x1p-53;
+                   double r = std::sqrt(-2 * std::log(u));
+                   out[l] = r * std::cos(2 * M_PI * a);
+                   out[lanes_ + l] = r * std::sin(2 * M_PI * a);
+                 }
+               });
+}
+
+// Every 64-bit word x is mapped to low + floor(x * range / 2^64), whose bias
+// is below range / 2^64.
+void randint(std::int64_t *y, size_t n, std::int64_t low, std::int64_t high,
+             std::uint64_t seed, std::uint64_t offset) {
+  std::uint64_t range = std::uint64_t(high) - std::uint64_t(low);
+  philox_fill_(y, n, seed, offset,
+               [&](const Words_ &w, std::int64_t *out, size_t, size_t) {
+                 for (size_t h = 0; h < 2; ++h)
+                   for (size_t l = 0; l < lanes_; ++l) {
+                     auto x = (unsigned __int128)bits64_(w, 2 * h, l) * range;
+                     out[h * lanes_ + l] =
+                         std::int64_t(std::uint64_t(low) +
+                                      std::uint64_t(x >> 64));
+                   }
+               });
+}
+
+template <typename T>
+void bernoulli_(const T *p, T *y, size_t n, std::uint64_t seed,
+                std::uint64_t offset) {
+  philox_fill_(y, n, seed, offset,
+               [&](const Words_ &w, T *out, size_t base, size_t count) {
+                 units_(w, out);
+                 for (size_t j = 0; j < count; j += lanes_)
+                   for_lanes(std::min(lanes_, count - j), [&](size_t l) {
+                     out[j + l] = T(out[j + l] < p[base + j + l]);
+                   });
+               });
+}
+
+void bernoulli(const float *p, float *y, size_t n, std::uint64_t seed,
+               std::uint64_t offset) {
+  bernoulli_(p, y, n, seed, offset);
+}
+
+void bernoulli(const double *p, double *y, size_t n, std::uint64_t seed,
+               std::uint64_t offset) {
+  bernoulli_(p, y, n, seed, offset);
+}
+
+template <typename T>
+void dropout_(const T *x, T *y, size_t n, double p, std::uint64_t seed,
+              std::uint64_t offset) {
+  // p = 1 drops everything, rather than scaling by inf.
+  T drop(p), scale = p < 1 ? T(1 / (1 - p)) : T(0);
+  philox_fill_(y, n, seed, offset,
+               [&](const Words_ &w, T *out, size_t base, size_t count) {
+                 units_(w, out);
+                 for (size_t j = 0; j < count; j += lanes_)
+                   for_lanes(std::min(lanes_, count - j), [&](size_t l) {
+                     out[j + l] =
+                         x[base + j + l] * (T(out[j + l] >= drop) * scale);
+                   });
+               });
+}
+
+void dropout(const float *x, float *y, size_t n, double p, std::uint64_t seed,
+             std::uint64_t offset) {
+  dropout_(x, y, n, p, seed, offset);
+}
+
+void dropout(const double *x, double *y, size_t n, double p,
+             std::uint64_t seed, std::uint64_t offset) {
+  dropout_(x, y, n, p, seed, offset);
+}
+
+} // namespace native
+} // namespace INNC
@@ -1,5 +1,7 @@
 #include "INNC/INNC.hpp"
 #include "INNC/utils/utils.hpp"
+#include <atomic>
+#include <cmath>
 #include <cstdint>
 #include <gtest/gtest.h>
 #include <string>
@@ -10,8 +12,9 @@ std::int16_t data_i16_1[6] = {0, -2, 4, 6, 8, -10};
 std::string output_i8_1 = "[[1, -3, -5], [7, -9, 11]]";
 std::int16_t data_i16_2[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
 
-INNC::types all_type[6] = {INNC::i8,  INNC::i16, INNC::i32,
-                           INNC::i64, INNC::f32, INNC::f64};
+INNC::types all_type[9] = {INNC::b8,  INNC::i8,   INNC::i16,
+                           INNC::i32, INNC::i64,  INNC::f16,
+                           INNC::bf16, INNC::f32, INNC::f64};
 
 constexpr double epsilon = 1e-6;
 
@@ -97,6 +100,29 @@ TEST(basic, smartInit) {
                std::invalid_argument);
 }
 
+TEST(basic, sizevec) {
+  INNC::SizeVec a{1, 2, 3};
+  ASSERT_EQ(a.capacity(), INNC::inline_dims_);
+  for (size_t i = 4; i <= 12; ++i)
+    a.push_back(i);
+  ASSERT_EQ(a.size(), 12);
+  ASSERT_GE(a.capacity(), 12);
+  auto b = a;
+  ASSERT_EQ(a, b);
+  a.erase(a.begin() + 1, a.end());
+  a.insert(a.begin(), 0);
+  ASSERT_EQ(a, INNC::SizeVec({0, 1}));
+  auto c = std::move(b);
+  ASSERT_EQ(c.size(), 12);
+  ASSERT_EQ(c.back(), 12);
+  ASSERT_TRUE(b.empty());
+  INNC::SignedVec d{-1, 2};
+  d.resize(9, -3);
+  ASSERT_EQ(d.to_string(), "[-1, 2, -3, -3, -3, -3, -3, -3, -3]");
+  auto t = INNC::zeros({1, 1, 1, 1, 1, 1, 1, 1, 1, 2}, INNC::f32);
+  ASSERT_EQ(t.sum().to_string(), "0.000000");
+}
+
 TEST(basic, type) {
   auto a = INNC::from_blob(data_i8_1, {2, 3}, INNC::i8);
   auto b = a.type(INNC::i64);
@@ -108,6 +134,103 @@ TEST(basic, type) {
   ASSERT_EQ(a.to_string(), "[-3]");
 }
 
+TEST(basic, half) {
+  ASSERT_EQ(INNC::size_of(INNC::f16), 2);
+  ASSERT_EQ(INNC::size_of(INNC::bf16), 2);
+  ASSERT_EQ(INNC::half(1.f / 3).bits(), 0x3555);
+  ASSERT_EQ(INNC::bfloat16(1.f / 3).bits(), 0x3eab);
+  ASSERT_EQ(INNC::half(65520.f).bits(), 0x7c00);
+  ASSERT_EQ(float(INNC::half::from_raw(0x0001)), 5.9604644775390625e-8f);
+  auto a = INNC::from_blob(data_i16_1, {2, 3}, INNC::i16).type(INNC::f16);
+  ASSERT_EQ(a.type(), INNC::f16);
+  ASSERT_EQ(a.to_string(), a.type(INNC::f32).to_string());
+  auto b = a.type(INNC::bf16);
+  ASSERT_EQ((a + b).type(), INNC::f32);
+  ASSERT_EQ((b * a).type(), INNC::f32);
+  ASSERT_EQ((a * b).to_string(), (a * a).type(INNC::f32).to_string());
+  ASSERT_EQ((b - a).to_string(), INNC::zeros({2, 3}, INNC::f32).to_string());
+  auto ga = a.clone(), gb = b.clone();
+  ga.requires_grad(true);
+  gb.requires_grad(true);
+  (ga * gb).sum().backward();
+  ASSERT_EQ(ga.grad().to_string(), b.type(INNC::f16).to_string());
+  ASSERT_EQ(gb.grad().to_string(), a.type(INNC::bf16).to_string());
+  ASSERT_EQ((a * 2).type(), INNC::f16);
+  ASSERT_EQ((a * a).type(INNC::i16).to_string(),
+            "[[0, 4, 16], [36, 64, 100]]");
+  ASSERT_EQ((b / 4).to_string(), (a.type(INNC::f32) / 4).to_string());
+  a.requires_grad(true);
+  (a * a).sum().backward();
+  ASSERT_STRICT_APPROX(a.grad(), (a + a).detach());
+  ASSERT_EQ(INNC::Tensor::randn({2, 2}, INNC::bf16).type(), INNC::bf16);
+}
+
+TEST(basic, quantize) {
+  float data[2][3] = {{0.5f, -1.f, 2.f}, {-0.25f, 1.5f, -2.f}};
+  auto a = INNC::from_blob(data, {2, 3}, INNC::f32);
+  auto q = a.quantize(0.25f, 2);
+  ASSERT_TRUE(q.is_quantized());
+  ASSERT_EQ(q.type(), INNC::i8);
+  ASSERT_EQ(q.to_string(), "[[4, -2, 10], [1, 8, -6]]");
+  ASSERT_STRICT_APPROX(q.dequantize(), a);
+  q = a.quantize_per_channel({0.5f, 1.f, 0.5f}, {0, 1, -1}, 1);
+  ASSERT_EQ(q.to_string(), "[[1, 0, 3], [0, 3, -5]]");
+  ASSERT_THROW(a.quantize_per_channel({1.f}, {0}, 1), std::runtime_error);
+  ASSERT_THROW(q.quantize(1.f, 0), std::runtime_error);
+
+  float lhs[3][20], rhs[20][4], expected[3][4] = {};
+  for (int p = 0; p < 20; ++p) {
+    lhs[0][p] = p + 1;
+    lhs[1][p] = -(p + 1);
+    lhs[2][p] = p % 2;
+    for (int j = 0; j < 4; ++j)
+      rhs[p][j] = (j + 1) * (p % 3 - 1);
+  }
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 4; ++j)
+      for (int p = 0; p < 20; ++p)
+        expected[i][j] += lhs[i][p] * rhs[p][j];
+  auto qa = INNC::from_blob(lhs, {3, 20}, INNC::f32).quantize(0.5f, 3);
+  auto qb = INNC::from_blob(rhs, {20, 4}, INNC::f32)
+                .quantize_per_channel({1.f, 2.f, 3.f, 4.f}, {0, 1, 0, -1}, 1);
+  auto rst = INNC::from_blob(expected, {3, 4}, INNC::f32);
+  auto acc = INNC::qmatmul(qa, qb);
+  ASSERT_EQ(acc.type(), INNC::i32);
+  ASSERT_STRICT_APPROX(acc.dequantize(), rst);
+  auto out = INNC::qmatmul(qa, qb, 7.f, -4);
+  ASSERT_EQ(out.type(), INNC::i8);
+  ASSERT_EQ(out.to_string(), "[[-5, -6, -7, -8], [-3, -2, -1, 0], "
+                             "[-4, -4, -4, -4]]");
+  ASSERT_STRICT_APPROX(out.dequantize(), rst);
+  // `acc` is quantized per column like `qb`, but holds int32.
+  auto qc = INNC::ones({2, 3}, INNC::f32).quantize(.5f, 0);
+  ASSERT_THROW(INNC::qmatmul(qc, acc), std::runtime_error);
+}
+
+TEST(basic, mask) {
+  auto a = INNC::Tensor::randn({5, 40}, INNC::f32);
+  auto b = INNC::Tensor::randn({5, 40}, INNC::f32);
+  auto m = a.compare_mask(b, INNC::cmp::lt);
+  ASSERT_EQ(m.numel(), 200);
+  ASSERT_EQ(m.words.size(), 4);
+  ASSERT_TRUE((INNC::Tensor::from_mask(m) == (a < b)).all());
+  ASSERT_EQ(m.count() + a.compare_mask(b, INNC::cmp::ge).count(), 200);
+  ASSERT_TRUE(a.compare_mask(a, INNC::cmp::eq).all());
+  ASSERT_FALSE(a.compare_mask(a, INNC::cmp::ne).any());
+  auto c = INNC::from_blob(data_i8_1, {2, 3}, INNC::i8);
+  auto gt = c.compare_mask(INNC::ones({1, 3}, INNC::i32), INNC::cmp::gt);
+  ASSERT_EQ(gt.count(), 2);
+  ASSERT_TRUE(gt.test(3) && gt.test(5));
+  ASSERT_TRUE(c.all());
+  ASSERT_FALSE(INNC::zeros({2, 3}, INNC::f64).any());
+  auto x = INNC::ones({2, 3}, INNC::f32);
+  x.requires_grad(true);
+  auto y = x.masked_fill(gt, 5);
+  ASSERT_STRICT_APPROX(y.sum(), INNC::Tensor(14.));
+  y.sum().backward();
+  ASSERT_STRICT_APPROX(x.grad(), (c <= 1).type(INNC::f32));
+}
+
 TEST(basic, compare) {
   auto a = INNC::from_blob(data_i8_1, {2, 3}, INNC::i8).type(INNC::i64);
   auto b = a < 1;
@@ -309,6 +432,96 @@ TEST(index, slice) {
   ASSERT_THROW(a["99"], std::runtime_error);
 }
 
+TEST(index, typed) {
+  using INNC::indexing::Ellipsis;
+  using INNC::indexing::NewAxis;
+  using INNC::indexing::none;
+  using INNC::indexing::Slice;
+  auto a = INNC::from_blob(data_i16_2, {4, 3}, INNC::i16);
+  ASSERT_EQ(a.index({1, 1}).to_string(), a["1, 1"].to_string());
+  ASSERT_EQ(a.index({Slice{}, -1}).to_string(), "[2, 5, 8, 11]");
+  ASSERT_EQ(a.index({Slice{-4, -1, 2}, Slice{-1, 0, -2}}).to_string(),
+            a["-4:-1:2,-1:0:-2"].to_string());
+  ASSERT_EQ(a.index({Slice{99, none, 2}, Slice{none, -99, -2}}).size(),
+            INNC::SizeVec({0, 2}));
+  static constexpr INNC::TensorIndex rev[] = {Ellipsis{},
+                                              Slice{none, none, -1}};
+  ASSERT_EQ(a.index(rev).to_string(), a[":, ::-1"].to_string());
+  ASSERT_EQ(a.index({Ellipsis{}, 0}).to_string(), "[0, 3, 6, 9]");
+  ASSERT_EQ(a.index({NewAxis{}, 2, Ellipsis{}, NewAxis{}}).size(),
+            INNC::SizeVec({1, 3, 1}));
+  ASSERT_EQ(a.index({2, NewAxis{}}).to_string(), "[[6, 7, 8]]");
+  ASSERT_THROW(a.index({Ellipsis{}, Ellipsis{}}), std::runtime_error);
+  ASSERT_THROW(a.index({0, 0, 0}), std::runtime_error);
+  ASSERT_THROW(a.index({Slice{0, 1, 0}}), std::runtime_error);
+}
+
+TEST(index, gather) {
+  // [[0, 1, 2],
+  //  [3, 4, 5],
+  //  [6, 7, 8],
+  //  [9,10,11]]
+  auto a = INNC::from_blob(data_i16_2, {4, 3}, INNC::i16);
+  std::int64_t idx_d[6] = {3, 0, 1, 2, 2, 0};
+  auto idx = INNC::from_blob(idx_d, {2, 3}, INNC::i64);
+  auto g = a.gather(0, idx);
+  ASSERT_EQ(g.to_string(), "[[9, 1, 5], [6, 7, 2]]");
+  auto z = INNC::zeros({4, 3}, INNC::i16);
+  ASSERT_EQ(z.scatter(0, idx, g).to_string(),
+            "[[0, 1, 2], [0, 0, 5], [6, 7, 0], [9, 0, 0]]");
+  ASSERT_EQ(z.scatter_add(0, idx, INNC::ones({2, 3}, INNC::i16)).to_string(),
+            "[[0, 1, 1], [0, 0, 1], [1, 1, 0], [1, 0, 0]]");
+  std::int64_t sel_d[2] = {2, 0};
+  auto sel = INNC::from_blob(sel_d, {2}, INNC::i64);
+  ASSERT_EQ(a.index_select(0, sel).to_string(), "[[6, 7, 8], [0, 1, 2]]");
+  ASSERT_EQ(a.index_select(1, sel).to_string(),
+            "[[2, 0], [5, 3], [8, 6], [11, 9]]");
+  ASSERT_EQ(z.index_add(1, sel, a.index_select(1, sel)).to_string(),
+            "[[0, 0, 2], [3, 0, 5], [6, 0, 8], [9, 0, 11]]");
+  auto m = a.compare_mask(INNC::full({}, std::int64_t(5), INNC::i16),
+                          INNC::cmp::gt);
+  ASSERT_EQ(a.masked_select(m).to_string(), "[6, 7, 8, 9, 10, 11]");
+  auto at = a.transpose(0, 1);
+  m = at.compare_mask(INNC::full({}, std::int64_t(5), INNC::i16),
+                      INNC::cmp::gt);
+  ASSERT_EQ(at.masked_select(m).to_string(), "[6, 9, 7, 10, 8, 11]");
+  ASSERT_THROW(a.gather(0, idx.type(INNC::i32)), std::runtime_error);
+  idx_d[0] = 4;
+  ASSERT_THROW(a.gather(0, INNC::from_blob(idx_d, {2, 3}, INNC::i64)),
+               std::runtime_error);
+}
+
+TEST(index, parallel) {
+  const size_t n = 1 << 18;
+  std::vector<double> src_d(n);
+  std::vector<std::int64_t> idx_d(n);
+  double expected[5] = {};
+  for (size_t i = 0; i < n; ++i) {
+    src_d[i] = i % 7;
+    idx_d[i] = i % 5;
+    expected[i % 5] += i % 7;
+  }
+  auto src = INNC::from_blob(src_d.data(), {n}, INNC::f64);
+  auto idx = INNC::from_blob(idx_d.data(), {n}, INNC::i64);
+  auto rst = INNC::from_blob(expected, {5}, INNC::f64);
+  INNC::NumThreadsGuard threads(4);
+  for (bool deterministic : {false, true}) {
+    INNC::use_deterministic_algorithms(deterministic);
+    auto out = INNC::zeros({5}, INNC::f64).index_add(0, idx, src);
+    ASSERT_EQ(out.to_string(), rst.to_string());
+    out = INNC::zeros({5}, INNC::f64).scatter_add(0, idx, src);
+    ASSERT_EQ(out.to_string(), rst.to_string());
+  }
+  auto m = src.compare_mask(INNC::full({}, std::int64_t(3), INNC::f64),
+                            INNC::cmp::lt);
+  auto picked = src.masked_select(m);
+  ASSERT_EQ(picked.size(), INNC::SizeVec{m.count()});
+  ASSERT_TRUE((picked < 3).all());
+  ASSERT_EQ(src.index_select(0, idx).to_string(),
+            src.gather(0, idx).to_string());
+  INNC::use_deterministic_algorithms(false);
+}
+
 TEST(index, transpose) {
   auto a = INNC::from_blob(data_i16_2, {4, 3}, INNC::i16);
   auto b = INNC::transpose(a, 0, 1);
@@ -581,6 +794,162 @@ TEST(autograd, transpose) {
   ASSERT_EQ(a.grad().to_string(), INNC::ones_like(a).to_string());
 }
 
+TEST(autograd, view) {
+  // [[0, 1, 2],
+  //  [3, 4, 5],
+  //  [6, 7, 8],
+  //  [9,10,11]]
+  auto a = INNC::from_blob(data_i16_2, {4, 3}, INNC::i16).type(INNC::f32);
+  ASSERT_EQ(a.permute({1, 0}).to_string(), a.transpose(0, 1).to_string());
+  ASSERT_EQ(a.unsqueeze(1).size(), INNC::SizeVec({4, 1, 3}));
+  ASSERT_EQ(a.unsqueeze(2).unsqueeze(0).squeeze().to_string(), a.to_string());
+  ASSERT_EQ(a.squeeze(0).size(), a.size());
+  ASSERT_EQ(a.narrow(1, 1, 2).to_string(), a[":, 1:3"].to_string());
+  ASSERT_EQ(a.select(0, -1).to_string(), a["-1"].to_string());
+  ASSERT_EQ(a.flip({0, 1}).to_string(), a["::-1, ::-1"].to_string());
+  ASSERT_EQ(a.flip({1}).reshape({-1}).to_string(),
+            a[":, ::-1"].contiguous().reshape({-1}).to_string());
+  auto w = a.unfold(0, 2, 1);
+  ASSERT_EQ(w.size(), INNC::SizeVec({3, 3, 2}));
+  ASSERT_EQ(w.select(0, 1).to_string(), a["1:3"].transpose(0, 1).to_string());
+  ASSERT_EQ(a.unfold(1, 2, 2).size(), INNC::SizeVec({4, 1, 2}));
+  ASSERT_EQ(a.as_strided({2, 2}, {1, 3}, 1).to_string(),
+            a["0:2, 1:3"].transpose(0, 1).to_string());
+  ASSERT_THROW(a.as_strided({2, 2}, {6, 1}, 8), std::runtime_error);
+  ASSERT_THROW(a.permute({0, 0}), std::runtime_error);
+  a.requires_grad(true);
+  a.flip({1}).narrow(0, 0, 2).unfold(1, 2, 1).sum().backward();
+  char rst[4][3] = {{1, 2, 1}, {1, 2, 1}, {0, 0, 0}, {0, 0, 0}};
+  ASSERT_EQ(
+      a.grad().to_string(),
+      INNC::from_blob(&rst, {4, 3}, INNC::i8).type(INNC::f32).to_string());
+}
+
+TEST(autograd, expand) {
+  auto a = INNC::from_blob(data_i8_1, {3, 1}, INNC::i8).type(INNC::f32);
+  auto b = a.expand({2, -1, 4});
+  ASSERT_EQ(b.size(), INNC::SizeVec({2, 3, 4}));
+  ASSERT_FALSE(b.is_contiguous());
+  ASSERT_STRICT_APPROX(b.contiguous(), INNC::ones({2, 3, 4}, INNC::f32) * a);
+  ASSERT_STRICT_APPROX(a.broadcast_to({3, 2}), a.expand({-1, 2}));
+  ASSERT_THROW(a.expand({2, 2}), std::runtime_error);
+  ASSERT_THROW(INNC::ones({1, 3}, INNC::f64).expand({-2, 3}),
+               std::runtime_error);
+  a.requires_grad(true);
+  auto w = INNC::from_blob(data_i8_1, {2, 1, 1}, INNC::i8).type(INNC::f32);
+  (a.expand({2, 3, 4}) * w).sum().backward();
+  ASSERT_STRICT_APPROX(a.grad(), INNC::full({3, 1}, -8., INNC::f32));
+  auto c = INNC::ones({2, 3}, INNC::f64);
+  c.requires_grad(true);
+  (c.expand_as(INNC::zeros({5, 2, 3}, INNC::f64)) * 2).sum().backward();
+  ASSERT_STRICT_APPROX(c.grad(), INNC::full({2, 3}, 10., INNC::f64));
+  // Views of an expanded tensor are viewed on its dense grad.
+  float w_d[4][3] = {{1, 1, 1}, {10, 10, 10}, {100, 100, 100},
+                     {1000, 1000, 1000}};
+  auto w4 = INNC::from_blob(&w_d, {4, 3}, INNC::f32);
+  auto d = INNC::ones({1, 3}, INNC::f32), r = INNC::ones({1, 3}, INNC::f32);
+  d.requires_grad(true);
+  r.requires_grad(true);
+  (d.transpose(0, 1).expand({3, 4}).transpose(0, 1) * w4).sum().backward();
+  (r.transpose(0, 1).expand({3, 4}).clone().transpose(0, 1) * w4)
+      .sum()
+      .backward();
+  ASSERT_STRICT_APPROX(d.grad(), INNC::full({1, 3}, 1111., INNC::f32));
+  ASSERT_STRICT_APPROX(d.grad(), r.grad());
+  auto x = INNC::ones({3}, INNC::f32);
+  x.requires_grad(true);
+  auto e = x.expand({2, 3});
+  e.retain_grad(true);
+  float wt_d[3][2] = {{0, 1}, {2, 3}, {4, 5}}, x_d[3] = {1, 5, 9};
+  auto wt = INNC::from_blob(&wt_d, {3, 2}, INNC::f32);
+  (e.transpose(0, 1) * wt).sum().backward();
+  ASSERT_STRICT_APPROX(e.grad(), wt.transpose(0, 1).contiguous());
+  ASSERT_STRICT_APPROX(x.grad(), INNC::from_blob(x_d, {3}, INNC::f32));
+}
+
+// Each view of an expanded, non-contiguous tensor against the same view of a
+// materialized copy.
+TEST(autograd, expanded_view) {
+  std::vector<std::function<INNC::Tensor(INNC::Tensor &)>> views{
+      [](INNC::Tensor &t) { return t.permute({2, 0, 1}); },
+      [](INNC::Tensor &t) { return t.narrow(1, 1, 1).squeeze(); },
+      [](INNC::Tensor &t) { return t.narrow(1, 0, 1).squeeze(1); },
+      [](INNC::Tensor &t) { return t.unsqueeze(1); },
+      [](INNC::Tensor &t) { return t.narrow(2, 1, 2); },
+      [](INNC::Tensor &t) { return t.select(1, -1); },
+      [](INNC::Tensor &t) { return t.flip({0, 2}); },
+      [](INNC::Tensor &t) { return t.unfold(2, 2, 1); }};
+  auto init = [](INNC::Tensor &a, INNC::Tensor &r) {
+    a = INNC::from_blob(data_i16_2, {4, 3}, INNC::i16).type(INNC::f64);
+    r = a.clone();
+    a.requires_grad(true);
+    r.requires_grad(true);
+  };
+  INNC::Tensor a, r;
+  for (auto &view : views) {
+    init(a, r);
+    auto e = a.transpose(0, 1).unsqueeze(1).expand({3, 2, 4});
+    auto c = r.transpose(0, 1).unsqueeze(1).expand({3, 2, 4}).clone();
+    e.retain_grad(true);
+    c.retain_grad(true);
+    auto v = view(e);
+    auto w = INNC::randn(v.size(), INNC::f64);
+    (v * w).sum().backward();
+    (view(c) * w).sum().backward();
+    ASSERT_STRICT_APPROX(e.grad(), c.grad());
+    ASSERT_STRICT_APPROX(a.grad(), r.grad());
+  }
+  // as_strided reads the storage, which the expanded tensor shares with `a`.
+  init(a, r);
+  auto e = a.transpose(0, 1).unsqueeze(1).expand({3, 2, 4});
+  auto w = INNC::randn({2, 2}, INNC::f64);
+  (e.as_strided({2, 2}, {1, 3}, 1) * w).sum().backward();
+  (r.as_strided({2, 2}, {1, 3}, 1) * w).sum().backward();
+  ASSERT_STRICT_APPROX(a.grad(), r.grad());
+}
+
+TEST(autograd, gather) {
+  auto a = INNC::from_blob(data_i16_2, {4, 3}, INNC::i16).type(INNC::f64);
+  a.requires_grad(true);
+  std::int64_t idx_d[6] = {3, 0, 1, 2, 2, 0};
+  auto idx = INNC::from_blob(idx_d, {2, 3}, INNC::i64);
+  a.gather(0, idx).sum().backward();
+  char rst0[4][3] = {{0, 1, 1}, {0, 0, 1}, {1, 1, 0}, {1, 0, 0}};
+  auto counts = INNC::from_blob(&rst0, {4, 3}, INNC::i8).type(INNC::f64);
+  ASSERT_EQ(a.grad().to_string(), counts.to_string());
+  a.zero_grad();
+  std::int64_t sel_d[3] = {2, 2, 0};
+  a.index_select(0, INNC::from_blob(sel_d, {3}, INNC::i64)).sum().backward();
+  char rst1[4][3] = {{1, 1, 1}, {0, 0, 0}, {2, 2, 2}, {0, 0, 0}};
+  ASSERT_EQ(
+      a.grad().to_string(),
+      INNC::from_blob(&rst1, {4, 3}, INNC::i8).type(INNC::f64).to_string());
+  a.zero_grad();
+  auto m = a.compare_mask(INNC::full({}, std::int64_t(5), INNC::f64),
+                          INNC::cmp::gt);
+  a.masked_select(m).sum().backward();
+  ASSERT_EQ(a.grad().to_string(),
+            INNC::Tensor::from_mask(m).type(INNC::f64).to_string());
+  auto s = INNC::ones({2, 3}, INNC::f64);
+  s.requires_grad(true);
+  auto x = INNC::ones({4, 3}, INNC::f64);
+  x.requires_grad(true);
+  auto w = a.detach();
+  (x.scatter(0, idx, s) * w).sum().backward();
+  ASSERT_EQ(s.grad().to_string(), w.gather(0, idx).to_string());
+  ASSERT_EQ(x.grad().to_string(), (w - w * counts).to_string());
+  s.zero_grad();
+  x.zero_grad();
+  (x.scatter_add(0, idx, s) * w).sum().backward();
+  ASSERT_EQ(s.grad().to_string(), w.gather(0, idx).to_string());
+  ASSERT_EQ(x.grad().to_string(), w.to_string());
+  s.zero_grad();
+  std::int64_t add_d[2] = {3, 3};
+  auto add_idx = INNC::from_blob(add_d, {2}, INNC::i64);
+  (x.index_add(0, add_idx, s) * w).sum().backward();
+  ASSERT_EQ(s.grad().to_string(), w.index_select(0, add_idx).to_string());
+}
+
 TEST(autograd, clone) {
   auto a = INNC::from_blob(data_i16_1, {2, 3}, INNC::i16).type(INNC::f64);
   a.requires_grad(true);
@@ -590,12 +959,330 @@ TEST(autograd, clone) {
   ASSERT_EQ(b.grad().to_string(), "[]");
   a.zero_grad();
   b.requires_grad();
-  b.sum().backward();
+  b.sum().backward(true);
   (a + b).sum().backward();
   auto rst = INNC::ones_like(a);
-  rst = rst + rst;
+  rst = rst + rst + rst;
   ASSERT_EQ(a.grad().to_string(), rst.to_string());
-  ASSERT_EQ(b.grad().to_string(), INNC::ones_like(b).to_string());
+  ASSERT_EQ(b.grad().to_string(), "[]");
+}
+
+TEST(autograd, schedule) {
+  auto a = INNC::from_blob(data_i16_1, {2, 3}, INNC::i16).type(INNC::f64);
+  a.requires_grad(true);
+  auto c = (a * a).sum();
+  c.backward(true);
+  c.backward();
+  ASSERT_THROW(c.backward(), std::runtime_error);
+  ASSERT_STRICT_APPROX(a.grad(), a * 4);
+  a.zero_grad();
+  auto x = a + a;
+  for (int i = 0; i < 1999; ++i)
+    x = x + a;
+  x = x.sum();
+  x.backward(true);
+  ASSERT_STRICT_APPROX(a.grad(), INNC::full({2, 3}, 2001., INNC::f64));
+  x.backward();
+  ASSERT_STRICT_APPROX(a.grad(), INNC::full({2, 3}, 4002., INNC::f64));
+}
+
+TEST(autograd, teardown) {
+  auto a = INNC::ones({1}, INNC::f32);
+  a.requires_grad(true);
+  {
+    auto x = a + a;
+    for (int i = 0; i < 100000; ++i)
+      x = x + a;
+  }
+  auto x = a * a;
+  for (int i = 0; i < 100000; ++i)
+    x = x * a;
+  x.sum().backward(true);
+  x = INNC::Tensor();
+  ASSERT_STRICT_APPROX(a.grad(), INNC::full({1}, 100002., INNC::f32));
+}
+
+TEST(autograd, broadcast_grad) {
+  constexpr size_t n = 4096, c = 16;
+  std::vector<double> w_d(n * c), col(n, 0), row(c, 0), blk(4 * c, 0);
+  for (size_t i = 0; i < n; ++i)
+    for (size_t j = 0; j < c; ++j) {
+      double v = double((i * 5 + j) % 7) - 3;
+      w_d[i * c + j] = v;
+      col[i] += v;
+      row[j] += v;
+      blk[i / (n / 4) * c + j] += v;
+    }
+  auto w = INNC::from_blob(w_d.data(), {n, c}, INNC::f64);
+  INNC::NumThreadsGuard threads(4);
+  auto b = INNC::zeros({c}, INNC::f64);
+  b.requires_grad(true);
+  ((INNC::zeros({n, c}, INNC::f64) + b) * w).sum().backward();
+  ASSERT_STRICT_APPROX(b.grad(), INNC::from_blob(row.data(), {c}, INNC::f64));
+  b = INNC::zeros({n, 1}, INNC::f64);
+  b.requires_grad(true);
+  ((b + INNC::zeros({n, c}, INNC::f64)) * w).sum().backward();
+  ASSERT_STRICT_APPROX(b.grad(),
+                       INNC::from_blob(col.data(), {n, 1}, INNC::f64));
+  b = INNC::zeros({4, 1, c}, INNC::f64);
+  b.requires_grad(true);
+  ((INNC::zeros({4, n / 4, c}, INNC::f64) + b) * w.reshape({4, -1, c}))
+      .sum()
+      .backward();
+  ASSERT_STRICT_APPROX(b.grad(),
+                       INNC::from_blob(blk.data(), {4, 1, c}, INNC::f64));
+  // All the elements of the view are the element of `x`.
+  INNC::NumThreadsGuard eight(8);
+  for (int i = 0; i < 2; ++i) {
+    auto x = INNC::zeros({1}, INNC::f64);
+    x.requires_grad(true);
+    (x.as_strided({200000, 2}, {0, 0}) + INNC::zeros({200000, 2}, INNC::f64))
+        .sum()
+        .backward();
+    ASSERT_STRICT_APPROX(x.grad(), INNC::full({1}, 400000., INNC::f64));
+  }
+}
+
+TEST(autograd, reduction_grad) {
+  auto a = INNC::from_blob(data_i16_1, {2, 3}, INNC::i16).type(INNC::f64);
+  a.requires_grad(true);
+  auto three = INNC::full({}, 3., INNC::f64);
+  (a.mean() * three).backward();
+  ASSERT_STRICT_APPROX(a.grad(), INNC::full({2, 3}, .5, INNC::f64));
+  a.zero_grad();
+  (a.transpose(0, 1).sum() * three).backward();
+  ASSERT_STRICT_APPROX(a.grad(), INNC::full({2, 3}, 3., INNC::f64));
+  auto b = INNC::ones({3}, INNC::f64);
+  b.requires_grad(true);
+  a.zero_grad();
+  (a - b).sum().backward();
+  ASSERT_STRICT_APPROX(a.grad(), INNC::ones({2, 3}, INNC::f64));
+  ASSERT_STRICT_APPROX(b.grad(), INNC::full({3}, -2., INNC::f64));
+  INNC::NumThreadsGuard eight(8);
+  for (int i = 0; i < 2; ++i) {
+    auto x = INNC::zeros({1}, INNC::f64);
+    x.requires_grad(true);
+    x.as_strided({200000, 2}, {0, 0}).sum().backward();
+    ASSERT_STRICT_APPROX(x.grad(), INNC::full({1}, 400000., INNC::f64));
+  }
+}
+
+TEST(autograd, retain_graph) {
+  auto a = INNC::from_blob(data_i16_1, {2, 3}, INNC::i16).type(INNC::f64);
+  a.requires_grad(true);
+  auto y = a * a;
+  y.sum().backward(true);
+  y.sum().backward();
+  ASSERT_STRICT_APPROX(a.grad(), a * 4);
+  // `y` has been released from the graph.
+  ASSERT_THROW(y.sum().backward(), std::runtime_error);
+  ASSERT_STRICT_APPROX(a.grad(), a * 4);
+  a.zero_grad();
+  auto h = a * 2;
+  h.sum().backward();
+  ASSERT_THROW((h * 3).sum().backward(), std::runtime_error);
+}
+
+TEST(autograd, no_grad) {
+  auto a = INNC::from_blob(data_i16_1, {2, 3}, INNC::i16).type(INNC::f64);
+  a.requires_grad(true);
+  {
+    INNC::NoGrad guard;
+    ASSERT_FALSE(INNC::is_grad_enabled());
+    auto b = a * a + a;
+    ASSERT_FALSE(b.requires_grad());
+    ASSERT_FALSE(a.transpose(0, 1).requires_grad());
+    a += INNC::ones_like(a);
+    {
+      INNC::AutoGradMode enable_grad(true);
+      ASSERT_TRUE((a * a).requires_grad());
+    }
+  }
+  ASSERT_TRUE(INNC::is_grad_enabled());
+  ASSERT_THROW(a += a, std::runtime_error);
+  auto c = (a * a).sum();
+  {
+    INNC::InferenceMode guard;
+    INNC::AutoGradMode enable_grad(true);
+    ASSERT_TRUE(INNC::is_inference_mode());
+    ASSERT_FALSE((a * a).requires_grad());
+    ASSERT_THROW(c.backward(), std::runtime_error);
+  }
+  ASSERT_FALSE(INNC::is_inference_mode());
+  c.backward();
+  ASSERT_STRICT_APPROX(a.grad(), a * 2);
+}
+
+TEST(autograd, per_sample_grad) {
+  auto x = INNC::from_blob(data_i16_2, {4, 3}, INNC::i16).type(INNC::f64);
+  auto w = INNC::from_blob(data_i16_1, {2, 3}, INNC::i16).type(INNC::f64);
+  // `in[0]` is [2, 3] and `in[1]` is [3] for each example.
+  auto fn = [](const std::vector<INNC::Tensor> &in) {
+    auto h = (in[0] * in[1]).transpose(0, 1).mean();
+    return h * h + (in[1] * in[0]).reshape({-1}).sum();
+  };
+  std::vector<INNC::Tensor> params(1), inputs(1);
+  params[0] = w;
+  inputs[0] = x;
+  auto grads = INNC::per_sample_grad(fn, params, inputs);
+  ASSERT_EQ(grads.size(), 1);
+  ASSERT_EQ(grads[0].size(), (INNC::SizeVec{4, 2, 3}));
+  auto losses = INNC::vmap(
+      [&](const std::vector<INNC::Tensor> &in) {
+        std::vector<INNC::Tensor> args(2);
+        args[0] = w;
+        args[1] = in[0];
+        return fn(args);
+      },
+      inputs);
+  ASSERT_EQ(losses.size(), (INNC::SizeVec{4}));
+  for (long long i = 0; i < 4; ++i) {
+    std::vector<INNC::Tensor> args(2);
+    args[0] = w.clone();
+    args[0].requires_grad(true);
+    args[1] = x.select(0, i);
+    auto loss = fn(args);
+    loss.backward();
+    ASSERT_STRICT_APPROX(grads[0].select(0, i), args[0].grad());
+    ASSERT_STRICT_APPROX(losses.select(0, i), loss);
+  }
+  ASSERT_FALSE(w.requires_grad());
+  // Views of a param inside `fn` are taken of its per-example grad.
+  double t_d[2][3][2] = {{{1, 1}, {2, 2}, {3, 3}}, {{4, 4}, {5, 5}, {6, 6}}};
+  double n_d[2][3][2] = {{{0, 1}, {0, 2}, {0, 3}}, {{0, 4}, {0, 5}, {0, 6}}};
+  std::vector<INNC::Tensor> ps(1), xs(1);
+  ps[0] = INNC::ones({3, 2}, INNC::f64);
+  xs[0] = INNC::from_blob(&t_d, {2, 3, 2}, INNC::f64).select(2, 0);
+  auto transposed = INNC::per_sample_grad(
+      [](const std::vector<INNC::Tensor> &in) {
+        return (INNC::Tensor::transpose(in[0], 0, 1) * in[1]).sum();
+      },
+      ps, xs);
+  ASSERT_STRICT_APPROX(transposed[0],
+                       INNC::from_blob(&t_d, {2, 3, 2}, INNC::f64));
+  auto narrowed = INNC::per_sample_grad(
+      [](const std::vector<INNC::Tensor> &in) {
+        INNC::Tensor p;
+        p = in[0];
+        return (p.narrow(1, 1, 1).select(1, 0) * in[1]).sum();
+      },
+      ps, xs);
+  ASSERT_STRICT_APPROX(narrowed[0],
+                       INNC::from_blob(&n_d, {2, 3, 2}, INNC::f64));
+  // Inside `fn`, a batched tensor looks like one example.
+  INNC::SizeVec example;
+  auto soft = INNC::vmap(
+      [&](const std::vector<INNC::Tensor> &in) {
+        example = in[0].size();
+        return in[0].softmax(in[0].dim() - 1);
+      },
+      inputs);
+  ASSERT_EQ(example, INNC::SizeVec{3});
+  ASSERT_STRICT_APPROX(soft, x.softmax(1));
+  ASSERT_THROW(INNC::vmap(
+                   [](const std::vector<INNC::Tensor> &in) {
+                     return in[0].max();
+                   },
+                   inputs),
+               std::runtime_error);
+}
+
+TEST(autograd, graph) {
+  auto x = INNC::from_blob(data_i16_1, {2, 3}, INNC::i16).type(INNC::f32);
+  auto w = INNC::full({2, 3}, 2., INNC::f32);
+  w.requires_grad(true);
+  INNC::Graph g;
+  g.capture_begin();
+  auto loss = (x * w * w).sum();
+  loss.backward();
+  ASSERT_THROW(INNC::Tensor::randn({2, 3}, INNC::f32), std::runtime_error);
+  g.capture_end();
+  ASSERT_GT(g.size(), 0);
+  auto y = INNC::from_blob(data_i16_2, {2, 3}, INNC::i16).type(INNC::f32);
+  x.copy_(y);
+  g.replay();
+  g.replay();
+  ASSERT_STRICT_APPROX(loss, (y * 4).sum());
+  ASSERT_STRICT_APPROX(w.grad(), y * 4);
+  {
+    INNC::GraphCapture capture(g);
+    w.zero_grad();
+    (x * w).sum().backward();
+  }
+  x.copy_(INNC::ones({2, 3}, INNC::f32));
+  g.replay();
+  ASSERT_STRICT_APPROX(w.grad(), INNC::ones({2, 3}, INNC::f32));
+}
+
+TEST(autograd, memory_plan) {
+  auto step = [](const INNC::Tensor &x, const INNC::Tensor &w) {
+    auto y = x * w;
+    for (int i = 0; i < 8; ++i)
+      y = y * w + x;
+    auto loss = y.sum();
+    loss.backward();
+    return loss.detach();
+  };
+  auto x = INNC::from_blob(data_i16_2, {3, 4}, INNC::i16).type(INNC::f32);
+  auto w = INNC::full({3, 4}, 0.5, INNC::f32);
+  w.requires_grad(true);
+  INNC::Graph g;
+  g.capture_begin();
+  auto loss = step(x, w);
+  g.capture_end();
+  auto plan = g.plan_memory();
+  ASSERT_GT(plan.storages, 0);
+  ASSERT_LT(plan.arena_bytes, plan.bytes);
+
+  auto y = INNC::ones({3, 4}, INNC::f32) - x;
+  x.copy_(y);
+  g.replay();
+  auto w2 = INNC::full({3, 4}, 0.5, INNC::f32);
+  w2.requires_grad(true);
+  auto loss2 = step(y, w2);
+  ASSERT_STRICT_APPROX(loss, loss2);
+  ASSERT_STRICT_APPROX(w.grad(), w2.grad());
+}
+
+TEST(autograd, checkpoint) {
+  auto a = INNC::from_blob(data_i16_1, {2, 3}, INNC::i16).type(INNC::f64);
+  a.requires_grad(true);
+  auto w = INNC::full({2, 3}, 3., INNC::f64);
+  w.requires_grad(true);
+  int calls = 0;
+  auto fn = [&w, &calls](const std::vector<INNC::Tensor> &in) {
+    ++calls;
+    auto y = in[0] * w;
+    return y * y + in[0];
+  };
+  std::vector<INNC::Tensor> in(1);
+  in[0] = a;
+  auto c = INNC::checkpoint(fn, in).sum();
+  ASSERT_EQ(calls, 1);
+  c.backward();
+  ASSERT_EQ(calls, 2);
+  ASSERT_STRICT_APPROX(a.grad(), a * 18 + 1);
+  ASSERT_STRICT_APPROX(w.grad(), a * a * 6);
+  ASSERT_STRICT_APPROX(c, ((a * w) * (a * w) + a).sum());
+  // Dropout draws the same mask when it runs again.
+  auto drop = [](const std::vector<INNC::Tensor> &in) {
+    return INNC::dropout(in[0], .5) * in[0];
+  };
+  auto x = INNC::rand({4, 64}, INNC::f64), r = x.clone();
+  x.requires_grad(true);
+  r.requires_grad(true);
+  auto &gen = INNC::default_generator();
+  auto offset = gen.offset();
+  in[0] = x;
+  auto d = INNC::checkpoint(drop, in);
+  INNC::rand({16}, INNC::f64);
+  d.sum().backward();
+  gen.set_offset(offset);
+  in[0] = r;
+  auto e = drop(in);
+  e.sum().backward();
+  ASSERT_STRICT_APPROX(d, e);
+  ASSERT_STRICT_APPROX(x.grad(), r.grad());
 }
 
 TEST(autograd, detach) {
@@ -710,10 +1397,615 @@ TEST(autograd, min) {
   ASSERT_STRICT_APPROX(a.grad(), rst.type(a.type()));
 }
 
+// Runs `steps` steps of the optimizer built by `make` on the loss sum(p)
+// and checks every element against `ref(e, t, p, g)`, which
+// updates the e-th element `p` at step `t` from its grad `g`.
+template <typename Opt, typename Ref>
+void check_optimizer(const INNC::SizeVec &sizes, size_t params, int steps,
+                     auto make, Ref ref) {
+  std::vector<INNC::Tensor> ps(params);
+  std::vector<std::vector<double>> expected(params);
+  size_t n = 1;
+  for (auto s : sizes)
+    n *= s;
+  for (size_t i = 0; i < params; ++i) {
+    for (size_t j = 0; j < n; ++j)
+      expected[i].push_back(double((i * 7 + j * 3) % 11) / 4 - 1.2);
+    ps[i] = INNC::from_blob(expected[i].data(), sizes, INNC::f64);
+    ps[i].requires_grad(true);
+  }
+  Opt opt = make(ps);
+  for (int t = 1; t <= steps; ++t) {
+    opt.zero_grad();
+    for (auto &p : ps)
+      p.sum().backward();
+    opt.step();
+    for (size_t i = 0; i < params; ++i)
+      for (size_t j = 0; j < n; ++j)
+        ref(i * n + j, t, expected[i][j], 1.);
+  }
+  for (size_t i = 0; i < params; ++i) {
+    ASSERT_STRICT_APPROX(ps[i], INNC::from_blob(expected[i].data(), sizes,
+                                                INNC::f64));
+  }
+}
+
+TEST(optim, step) {
+  // 20 parameters of 4096 elements are split among threads mid-parameter.
+  INNC::NumThreadsGuard threads(4);
+  for (size_t params : {3, 20}) {
+    std::vector<double> buf(params * 4096, 0), m(params * 4096, 0),
+        v(params * 4096, 0);
+    check_optimizer<INNC::optim::SGD>(
+        {64, 64}, params, 3,
+        [](const auto &ps) { return INNC::optim::SGD(ps, .1, .9, .01, true); },
+        [&](size_t e, int, double &p, double g) {
+          g += .01 * p;
+          buf[e] = .9 * buf[e] + g;
+          p -= .1 * (g + .9 * buf[e]);
+        });
+    for (bool decoupled : {false, true}) {
+      std::fill(m.begin(), m.end(), 0);
+      std::fill(v.begin(), v.end(), 0);
+      auto ref = [&](size_t e, int t, double &p, double g) {
+        if (decoupled)
+          p *= 1 - .01 * .1;
+        else
+          g += .1 * p;
+        m[e] = .9 * m[e] + .1 * g;
+        v[e] = .999 * v[e] + .001 * g * g;
+        p -= .01 * (m[e] / (1 - std::pow(.9, t))) /
+             (std::sqrt(v[e] / (1 - std::pow(.999, t))) + 1e-8);
+      };
+      if (decoupled)
+        check_optimizer<INNC::optim::AdamW>(
+            {64, 64}, params, 3,
+            [](const auto &ps) {
+              return INNC::optim::AdamW(ps, .01, .9, .999, 1e-8, .1);
+            },
+            ref);
+      else
+        check_optimizer<INNC::optim::Adam>(
+            {64, 64}, params, 3,
+            [](const auto &ps) {
+              return INNC::optim::Adam(ps, .01, .9, .999, 1e-8, .1);
+            },
+            ref);
+    }
+  }
+}
+
+TEST(math, unary) {
+  struct Case {
+    INNC::Tensor (INNC::Tensor::*op)() const;
+    double (*f)(double);
+    double (*df)(double);
+    bool positive;
+  };
+  const Case cases[] = {
+      {&INNC::Tensor::exp, [](double x) { return std::exp(x); },
+       [](double x) { return std::exp(x); }, false},
+      {&INNC::Tensor::log, [](double x) { return std::log(x); },
+       [](double x) { return 1 / x; }, true},
+      {&INNC::Tensor::sqrt, [](double x) { return std::sqrt(x); },
+       [](double x) { return .5 / std::sqrt(x); }, true},
+      {&INNC::Tensor::tanh, [](double x) { return std::tanh(x); },
+       [](double x) { return 1 - std::tanh(x) * std::tanh(x); }, false},
+      {&INNC::Tensor::sigmoid, [](double x) { return 1 / (1 + std::exp(-x)); },
+       [](double x) {
+         double s = 1 / (1 + std::exp(-x));
+         return s * (1 - s);
+       },
+       false},
+      {&INNC::Tensor::gelu,
+       [](double x) { return x * .5 * std::erfc(-x / std::sqrt(2.)); },
+       [](double x) {
+         return .5 * std::erfc(-x / std::sqrt(2.)) +
+                x * std::exp(-x * x / 2) / std::sqrt(2 * M_PI);
+       },
+       false},
+      {&INNC::Tensor::relu, [](double x) { return std::max(x, 0.); },
+       [](double x) { return double(x > 0); }, false},
+  };
+  // 1000 elements cover several blocks and a partial one.
+  const size_t rows = 20, cols = 50;
+  INNC::Tensor one(1.), tol(1e-6);
+  for (const auto &c : cases) {
+    std::vector<double> x(rows * cols), y, dy;
+    for (size_t i = 0; i < x.size(); ++i) {
+      x[i] = double(i) / x.size() * 6 - 2.9995;
+      if (c.positive)
+        x[i] = std::abs(x[i]) + .01;
+      y.push_back(c.f(x[i]));
+      dy.push_back(c.df(x[i]));
+    }
+    auto t = INNC::from_blob(x.data(), {rows, cols}, INNC::f64);
+    auto ref = INNC::from_blob(y.data(), {rows, cols}, INNC::f64);
+    t.requires_grad(true);
+    auto out = (t.*c.op)();
+    ASSERT_STRICT_APPROX(out, ref);
+    out.sum().backward();
+    ASSERT_STRICT_APPROX(t.grad(),
+                         INNC::from_blob(dy.data(), {rows, cols}, INNC::f64));
+    auto strided = (t.detach().transpose(0, 1).*c.op)().transpose(0, 1);
+    ASSERT_STRICT_APPROX(strided, ref);
+
+    for (bool fast : {false, true}) {
+      INNC::use_fast_math(fast);
+      auto tf = t.detach().type(INNC::f32);
+      tf.requires_grad(true);
+      auto out_f = (tf.*c.op)();
+      out_f.sum().backward();
+      INNC::use_fast_math(false);
+      auto err = (out_f.type(INNC::f64) - ref).abs();
+      ASSERT_TRUE((err <= (ref.abs() + one) * tol).all());
+      auto grad = INNC::from_blob(dy.data(), {rows, cols}, INNC::f64);
+      err = (tf.grad().type(INNC::f64) - grad).abs();
+      ASSERT_TRUE((err <= (grad.abs() + one) * tol).all());
+    }
+  }
+  // The grad of an overlapping view, exp'(0) being 1.
+  INNC::NumThreadsGuard eight(8);
+  for (int i = 0; i < 2; ++i) {
+    auto x = INNC::zeros({1}, INNC::f64);
+    x.requires_grad(true);
+    x.as_strided({200000, 2}, {0, 0}).exp().sum().backward();
+    ASSERT_STRICT_APPROX(x.grad(), INNC::full({1}, 400000., INNC::f64));
+  }
+  ASSERT_THROW(INNC::ones({2}, INNC::i32).exp(), std::runtime_error);
+}
+
+TEST(math, softmax) {
+  // 70 classes fill one block of the kernels and part of another. Softmax
+  // runs along the last dimension and along a middle one, where 3 runs lie
+  // side by side.
+  const size_t outer = 2, n = 70, inner = 3;
+  std::vector<double> x(outer * n * inner), g(x.size());
+  for (size_t i = 0; i < x.size(); ++i) {
+    x[i] = double(i * 7 % 23) / 4 - 3;
+    g[i] = double(i * 5 % 11) / 5 - 1;
+  }
+  for (size_t in : {size_t(1), inner}) {
+    INNC::SizeVec sizes{outer * inner / in, n, in};
+    std::vector<double> y(x.size()), ly(x.size()), dx(x.size()),
+        ldx(x.size());
+    for (size_t o = 0; o < sizes[0]; ++o)
+      for (size_t c = 0; c < in; ++c) {
+        auto at = [&](size_t j) { return (o * n + j) * in + c; };
+        double mx = -INFINITY, s = 0, gy = 0, gs = 0;
+        for (size_t j = 0; j < n; ++j)
+          mx = std::max(mx, x[at(j)]);
+        for (size_t j = 0; j < n; ++j)
+          s += std::exp(x[at(j)] - mx);
+        for (size_t j = 0; j < n; ++j) {
+          y[at(j)] = std::exp(x[at(j)] - mx) / s;
+          ly[at(j)] = x[at(j)] - mx - std::log(s);
+          gy += g[at(j)] * y[at(j)];
+          gs += g[at(j)];
+        }
+        for (size_t j = 0; j < n; ++j) {
+          dx[at(j)] = y[at(j)] * (g[at(j)] - gy);
+          ldx[at(j)] = g[at(j)] - y[at(j)] * gs;
+        }
+      }
+    auto tg = INNC::from_blob(g.data(), sizes, INNC::f64);
+    for (bool log : {false, true}) {
+      auto t = INNC::from_blob(x.data(), sizes, INNC::f64);
+      t.requires_grad(true);
+      auto out = log ? t.log_softmax(1) : t.softmax(1);
+      ASSERT_STRICT_APPROX(
+          out, INNC::from_blob((log ? ly : y).data(), sizes, INNC::f64));
+      (out * tg).sum().backward();
+      ASSERT_STRICT_APPROX(
+          t.grad(), INNC::from_blob((log ? ldx : dx).data(), sizes, INNC::f64));
+      // Shifting the logits far beyond the range of exp changes nothing.
+      auto shifted = (t.detach() + INNC::Tensor(1e4)).type(INNC::f32);
+      auto out_f = log ? shifted.log_softmax(1) : shifted.softmax(1);
+      auto err = (out_f.type(INNC::f64) - out.detach()).abs();
+      ASSERT_TRUE((err <= INNC::Tensor(1e-5)).all());
+    }
+  }
+
+  // Cross entropy of 4 rows against their targets.
+  const size_t m = 4;
+  std::vector<std::int64_t> target{3, 0, 69, 41};
+  std::vector<double> loss(m), dl(m * n);
+  double mean = 0;
+  for (size_t i = 0; i < m; ++i) {
+    double mx = -INFINITY, s = 0;
+    for (size_t j = 0; j < n; ++j)
+      mx = std::max(mx, x[i * n + j]);
+    for (size_t j = 0; j < n; ++j)
+      s += std::exp(x[i * n + j] - mx);
+    loss[i] = mx + std::log(s) - x[i * n + target[i]];
+    mean += loss[i] / m;
+    for (size_t j = 0; j < n; ++j)
+      dl[i * n + j] =
+          (std::exp(x[i * n + j] - mx) / s - (j == size_t(target[i]))) / m;
+  }
+  auto tt = INNC::from_blob(target.data(), {m}, INNC::i64);
+  for (bool fast : {false, true}) {
+    INNC::use_fast_math(fast);
+    auto t = INNC::from_blob(x.data(), {m, n}, INNC::f64);
+    t.requires_grad(true);
+    auto l = INNC::cross_entropy(t, tt);
+    ASSERT_EQ(l.dim(), 0);
+    ASSERT_STRICT_APPROX(l, INNC::Tensor(mean));
+    l.backward();
+    ASSERT_STRICT_APPROX(t.grad(),
+                         INNC::from_blob(dl.data(), {m, n}, INNC::f64));
+    auto tf = t.detach().type(INNC::f32);
+    tf.requires_grad(true);
+    auto lf = INNC::cross_entropy(tf, tt);
+    lf.backward();
+    ASSERT_TRUE(((lf.type(INNC::f64) - INNC::Tensor(mean)).abs() <=
+                 INNC::Tensor(1e-5))
+                    .all());
+    ASSERT_TRUE(
+        ((tf.grad().type(INNC::f64) - t.grad()).abs() <= INNC::Tensor(1e-6))
+            .all());
+  }
+  INNC::use_fast_math(false);
+  // Under vmap, every example gets its own loss.
+  std::vector<INNC::Tensor> inputs(2);
+  inputs[0] = INNC::from_blob(x.data(), {m, n}, INNC::f64);
+  inputs[1] = tt;
+  auto per_row = INNC::vmap(
+      [](const std::vector<INNC::Tensor> &v) {
+        return INNC::cross_entropy(v[0], v[1]);
+      },
+      inputs);
+  ASSERT_STRICT_APPROX(per_row, INNC::from_blob(loss.data(), {m}, INNC::f64));
+
+  std::int64_t bad = n;
+  ASSERT_THROW(INNC::cross_entropy(INNC::ones({1, n}, INNC::f32),
+                                   INNC::from_blob(&bad, {1}, INNC::i64)),
+               std::runtime_error);
+  ASSERT_THROW(INNC::cross_entropy(INNC::ones({2, n}, INNC::f32),
+                                   INNC::zeros({2}, INNC::i32)),
+               std::runtime_error);
+  ASSERT_THROW(INNC::ones({2}, INNC::i32).softmax(0), std::runtime_error);
+}
+
+TEST(nn, linear) {
+  // 6 rows, not a multiple of the rows computed together, and 300 outputs,
+  // more than one block of columns.
+  const size_t m = 6, k = 5, n = 300;
+  std::vector<double> x(m * k), w(n * k), b(n), g(m * n);
+  for (size_t i = 0; i < x.size(); ++i)
+    x[i] = double(i * 5 % 13) / 6 - 1;
+  for (size_t i = 0; i < w.size(); ++i)
+    w[i] = double(i * 7 % 11) / 5 - 1;
+  for (size_t i = 0; i < b.size(); ++i)
+    b[i] = double(i % 7) / 3 - 1;
+  for (size_t i = 0; i < g.size(); ++i)
+    g[i] = double(i * 3 % 17) / 8 - 1;
+  for (auto act : {INNC::activation::none, INNC::activation::relu,
+                   INNC::activation::gelu}) {
+    std::vector<double> y(m * n), dx(m * k, 0), dw(n * k, 0), db(n, 0);
+    for (size_t i = 0; i < m; ++i)
+      for (size_t j = 0; j < n; ++j) {
+        double z = b[j], d = 1;
+        for (size_t p = 0; p < k; ++p)
+          z += x[i * k + p] * w[j * k + p];
+        y[i * n + j] = z;
+        if (act == INNC::activation::relu) {
+          y[i * n + j] = std::max(z, 0.);
+          d = z > 0;
+        } else if (act == INNC::activation::gelu) {
+          double cdf = .5 * (1 + std::erf(z / std::sqrt(2.)));
+          y[i * n + j] = z * cdf;
+          d = cdf + z * std::exp(-z * z / 2) / std::sqrt(2 * M_PI);
+        }
+        double dz = g[i * n + j] * d;
+        db[j] += dz;
+        for (size_t p = 0; p < k; ++p) {
+          dx[i * k + p] += dz * w[j * k + p];
+          dw[j * k + p] += dz * x[i * k + p];
+        }
+      }
+    auto tx = INNC::from_blob(x.data(), {2, 3, k}, INNC::f64);
+    auto tw = INNC::from_blob(w.data(), {n, k}, INNC::f64);
+    auto tb = INNC::from_blob(b.data(), {n}, INNC::f64);
+    tx.requires_grad(true);
+    tw.requires_grad(true);
+    tb.requires_grad(true);
+    auto ty = INNC::linear(tx, tw, tb, act);
+    ASSERT_STRICT_APPROX(ty, INNC::from_blob(y.data(), {2, 3, n}, INNC::f64));
+    (ty * INNC::from_blob(g.data(), {2, 3, n}, INNC::f64)).sum().backward();
+    ASSERT_STRICT_APPROX(tx.grad(),
+                         INNC::from_blob(dx.data(), {2, 3, k}, INNC::f64));
+    ASSERT_STRICT_APPROX(tw.grad(),
+                         INNC::from_blob(dw.data(), {n, k}, INNC::f64));
+    ASSERT_STRICT_APPROX(tb.grad(), INNC::from_blob(db.data(), {n}, INNC::f64));
+  }
+
+  INNC::nn::Linear lin(5, 3, false, INNC::activation::relu);
+  ASSERT_EQ(lin.parameters().size(), 1);
+  auto y = lin(INNC::ones({4, 5}, INNC::f32));
+  ASSERT_EQ(y.size(), INNC::SizeVec({4, 3}));
+  ASSERT_EQ(y.type(), INNC::f32);
+  ASSERT_TRUE((y >= INNC::zeros({4, 3}, INNC::f32)).all());
+  ASSERT_THROW(lin(INNC::ones({4, 4}, INNC::f32)), std::runtime_error);
+  ASSERT_THROW(lin(INNC::ones({4, 5}, INNC::f64)), std::runtime_error);
+}
+
+TEST(nn, norm) {
+  // 70 elements fill one block of lanes and part of another.
+  const size_t n = 70, m = 3;
+  std::vector<double> x(m * n), g(x.size()), w(n), b(n);
+  for (size_t i = 0; i < x.size(); ++i) {
+    x[i] = double(i * 7 % 23) / 4 - 3 + double(i % 3);
+    g[i] = double(i * 5 % 11) / 5 - 1;
+  }
+  for (size_t j = 0; j < n; ++j) {
+    w[j] = double(j % 7) / 3 - 1;
+    b[j] = double(j % 5) / 4;
+  }
+  const double eps = 1e-5;
+  // Normalizes the groups of elements at(k, 0..len) with the affine transform
+  // of coef(k), then checks y and the grads.
+  auto normalize = [&](size_t groups, size_t len, auto at, auto coef,
+                       std::vector<double> &y, std::vector<double> &dx,
+                       std::vector<double> &dw, std::vector<double> &db,
+                       std::vector<double> &means, std::vector<double> &vars) {
+    for (size_t k = 0; k < groups; ++k) {
+      double mu = 0, var = 0, gm = 0, gxm = 0;
+      for (size_t j = 0; j < len; ++j)
+        mu += x[at(k, j)] / len;
+      for (size_t j = 0; j < len; ++j)
+        var += (x[at(k, j)] - mu) * (x[at(k, j)] - mu) / len;
+      double r = 1 / std::sqrt(var + eps);
+      means.push_back(mu);
+      vars.push_back(var);
+      for (size_t j = 0; j < len; ++j) {
+        size_t i = at(k, j), c = coef(k, j);
+        double xh = (x[i] - mu) * r;
+        y[i] = xh * w[c] + b[c];
+        dw[c] += g[i] * xh;
+        db[c] += g[i];
+        gm += g[i] * w[c] / len;
+        gxm += g[i] * w[c] * xh / len;
+      }
+      for (size_t j = 0; j < len; ++j) {
+        size_t i = at(k, j), c = coef(k, j);
+        dx[i] = r * (g[i] * w[c] - gm - (x[i] - mu) * r * gxm);
+      }
+    }
+  };
+
+  {
+    std::vector<double> y(x.size()), dx(x.size()), dw(n), db(n), means,
+        vars;
+    normalize(
+        m, n, [&](size_t k, size_t j) { return k * n + j; },
+        [](size_t, size_t j) { return j; }, y, dx, dw, db, means, vars);
+    auto tx = INNC::from_blob(x.data(), {m, n}, INNC::f64);
+    auto tw = INNC::from_blob(w.data(), {n}, INNC::f64);
+    auto tb = INNC::from_blob(b.data(), {n}, INNC::f64);
+    tx.requires_grad(true);
+    tw.requires_grad(true);
+    tb.requires_grad(true);
+    auto ty = INNC::layer_norm(tx, {n}, tw, tb, eps);
+    ASSERT_STRICT_APPROX(ty, INNC::from_blob(y.data(), {m, n}, INNC::f64));
+    (ty * INNC::from_blob(g.data(), {m, n}, INNC::f64)).sum().backward();
+    ASSERT_STRICT_APPROX(tx.grad(),
+                         INNC::from_blob(dx.data(), {m, n}, INNC::f64));
+    ASSERT_STRICT_APPROX(tw.grad(), INNC::from_blob(dw.data(), {n}, INNC::f64));
+    ASSERT_STRICT_APPROX(tb.grad(), INNC::from_blob(db.data(), {n}, INNC::f64));
+    // f32 goes through the same kernels.
+    auto yf = INNC::layer_norm(tx.detach().type(INNC::f32), {n},
+                               tw.detach().type(INNC::f32),
+                               tb.detach().type(INNC::f32), eps);
+    ASSERT_TRUE(
+        ((yf.type(INNC::f64) - ty.detach()).abs() <= INNC::Tensor(1e-5)).all());
+    // Without weight and bias, and over two dimensions.
+    auto plain =
+        INNC::layer_norm(tx.detach().reshape({m, 2, n / 2}), {2, n / 2},
+                         INNC::Tensor(), INNC::Tensor(), eps);
+    ASSERT_STRICT_APPROX(plain.reshape({m, n}) * tw.detach() + tb.detach(),
+                         ty.detach());
+  }
+
+  // Batch norm over 70 channels side by side, then 3 channels of 35 elements.
+  for (auto [outer, c, inner] :
+       {std::tuple<size_t, size_t, size_t>{m, n, 1}, {2, 3, 35}}) {
+    INNC::SizeVec sizes{outer, c, inner};
+    std::vector<double> y(x.size()), dx(x.size()), dw(c), db(c), means, vars;
+    normalize(
+        c, outer * inner,
+        [&](size_t k, size_t j) {
+          return (j / inner * c + k) * inner + j % inner;
+        },
+        [](size_t k, size_t) { return k; }, y, dx, dw, db, means, vars);
+    auto tx = INNC::from_blob(x.data(), sizes, INNC::f64);
+    auto tw = INNC::from_blob(w.data(), {c}, INNC::f64);
+    auto tb = INNC::from_blob(b.data(), {c}, INNC::f64);
+    tx.requires_grad(true);
+    tw.requires_grad(true);
+    tb.requires_grad(true);
+    auto rm = INNC::zeros({c}, INNC::f64), rv = INNC::ones({c}, INNC::f64);
+    auto ty = INNC::batch_norm(tx, rm, rv, tw, tb, true, .1, eps);
+    ASSERT_STRICT_APPROX(ty, INNC::from_blob(y.data(), sizes, INNC::f64));
+    (ty * INNC::from_blob(g.data(), sizes, INNC::f64)).sum().backward();
+    ASSERT_STRICT_APPROX(tx.grad(),
+                         INNC::from_blob(dx.data(), sizes, INNC::f64));
+    ASSERT_STRICT_APPROX(tw.grad(), INNC::from_blob(dw.data(), {c}, INNC::f64));
+    ASSERT_STRICT_APPROX(tb.grad(), INNC::from_blob(db.data(), {c}, INNC::f64));
+    // The running statistics move a tenth of the way, to the unbiased var.
+    double count = outer * inner;
+    for (size_t k = 0; k < c; ++k) {
+      means[k] *= .1;
+      vars[k] = .9 + .1 * vars[k] * count / (count - 1);
+    }
+    ASSERT_STRICT_APPROX(rm, INNC::from_blob(means.data(), {c}, INNC::f64));
+    ASSERT_STRICT_APPROX(rv, INNC::from_blob(vars.data(), {c}, INNC::f64));
+    // Outside of training they are used as they are, and constant.
+    auto te = tx.detach();
+    te.requires_grad(true);
+    auto ye = INNC::batch_norm(te, rm, rv, tw.detach(), tb.detach(), false);
+    INNC::SignedVec shape{1, static_cast<long long>(c), 1};
+    auto scale = tw.detach().reshape(shape) /
+                 (rv.reshape(shape) + INNC::Tensor(eps)).sqrt();
+    ASSERT_STRICT_APPROX(ye, (te.detach() - rm.reshape(shape)) * scale +
+                                 tb.detach().reshape(shape));
+    // A training step before the backward pass leaves the saved ones alone.
+    INNC::batch_norm(tx.detach(), rm, rv, INNC::Tensor(), INNC::Tensor(), true,
+                     .5, eps);
+    (ye * INNC::from_blob(g.data(), sizes, INNC::f64)).sum().backward();
+    ASSERT_STRICT_APPROX(te.grad(),
+                         INNC::from_blob(g.data(), sizes, INNC::f64) * scale);
+  }
+
+  INNC::nn::LayerNorm ln({4}, 1e-5, false);
+  ASSERT_EQ(ln.parameters().size(), 0);
+  ASSERT_THROW(ln(INNC::ones({4, 3}, INNC::f32)), std::runtime_error);
+  INNC::nn::BatchNorm bn(3);
+  ASSERT_EQ(bn.parameters().size(), 2);
+  auto in = INNC::Tensor::randn({8, 3, 5}, INNC::f32);
+  bn(in);
+  ASSERT_FALSE((bn.running_mean == INNC::zeros({3}, INNC::f32)).all());
+  bn.train(false);
+  auto out = bn(in);
+  ASSERT_EQ(out.size(), INNC::SizeVec({8, 3, 5}));
+  bn.train(true);
+  ASSERT_THROW(bn(INNC::ones({1, 3}, INNC::f32)), std::runtime_error);
+  ASSERT_THROW(bn(INNC::ones({8, 4}, INNC::f32)), std::runtime_error);
+  ASSERT_THROW(INNC::batch_norm(in, INNC::Tensor(), INNC::Tensor(),
+                                INNC::Tensor(), INNC::Tensor(), false),
+               std::runtime_error);
+  ASSERT_THROW(INNC::layer_norm(in, {5}, bn.weight, INNC::Tensor()),
+               std::runtime_error);
+}
+
+TEST(nn, dropout) {
+  INNC::Generator gen(3);
+  for (auto dtype : {INNC::f32, INNC::f64}) {
+    auto x = INNC::randn({1000, 100}, dtype, gen) + INNC::full({}, 5., dtype);
+    x.requires_grad(true);
+    auto g = INNC::randn({1000, 100}, dtype, gen);
+    auto offset = gen.offset();
+    auto y = INNC::dropout(x, .3, true, gen);
+    // Kept elements are scaled, about 70% of them.
+    auto mask = (y != INNC::Tensor(0.)).type(dtype);
+    ASSERT_TRUE(((mask.mean() - INNC::Tensor(.7)).abs() <= INNC::Tensor(.01))
+                    .all());
+    ASSERT_STRICT_APPROX(y.detach(),
+                         x.detach() * mask * INNC::full({}, 1 / .7, dtype));
+    // The backward pass draws the same mask again.
+    (y * g).sum().backward();
+    ASSERT_STRICT_APPROX(x.grad(), g * mask * INNC::full({}, 1 / .7, dtype));
+    gen.set_offset(offset);
+    ASSERT_TRUE((INNC::dropout(x.detach(), .3, true, gen) == y.detach()).all());
+    ASSERT_TRUE((INNC::dropout(x, .3, false) == x).all());
+    ASSERT_TRUE((INNC::dropout(x, 0) == x).all());
+    ASSERT_TRUE((INNC::dropout(x, 1) == INNC::Tensor(0.)).all());
+  }
+
+  INNC::nn::Dropout drop(.5);
+  auto in = INNC::ones({4, 8}, INNC::bf16);
+  auto out = drop(in);
+  ASSERT_EQ(out.type(), INNC::bf16);
+  // Every element is 0 or 2.
+  ASSERT_TRUE((out * (out - INNC::Tensor(2.)) == INNC::Tensor(0.)).all());
+  drop.train(false);
+  ASSERT_TRUE((drop(in) == in).all());
+  ASSERT_THROW(INNC::dropout(in, 1.5), std::runtime_error);
+  ASSERT_THROW(INNC::dropout(INNC::ones({2}, INNC::i32), .5),
+               std::runtime_error);
+}
+
 TEST(utils, utils) {
   ASSERT_THROW(INNC::sformat("%ls", "123"), std::runtime_error);
 }
 
+TEST(utils, parallel_for) {
+  INNC::NumThreadsGuard four(4);
+  using Ranges = std::vector<std::pair<size_t, size_t>>;
+  Ranges ranges(4);
+  std::atomic<size_t> nested{0};
+  for (int rep = 0; rep < 2; ++rep) {
+    INNC::parallel_for(10, 1, [&](size_t begin, size_t end, size_t chunk) {
+      ranges[chunk] = {begin, end};
+      INNC::parallel_for(8, 1, [&](size_t b, size_t e, size_t) {
+        nested += e - b;
+      });
+    });
+    ASSERT_EQ(ranges, (Ranges{{0, 3}, {3, 6}, {6, 9}, {9, 10}}));
+  }
+  ASSERT_EQ(nested, 64);
+  ASSERT_THROW(INNC::parallel_for(8, 1,
+                                  [](size_t, size_t, size_t chunk) {
+                                    if (chunk == 2)
+                                      throw std::runtime_error("chunk");
+                                  }),
+               std::runtime_error);
+}
+
 TEST(utils, randn) {
   ASSERT_THROW(INNC::Tensor::randn({3, 5}, INNC::i8), std::runtime_error);
 }
+
+TEST(utils, rand) {
+  // Known answers of Philox4x32-10 from Random123.
+  using Words = std::array<std::uint32_t, 4>;
+  ASSERT_EQ(INNC::philox(0, 0, 0),
+            (Words{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}));
+  ASSERT_EQ(INNC::philox(0x299f31d0a4093822, 0x85a308d3243f6a88,
+                         0x0370734413198a2e),
+            (Words{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}));
+
+  // A seed gives the same numbers whatever the threads, and the stream goes
+  // on from there.
+  auto within = [](INNC::Tensor &&v, double expect, double tol) {
+    return ((v.type(INNC::f64) - INNC::Tensor(expect)).abs() <=
+            INNC::Tensor(tol))
+        .all();
+  };
+  INNC::Generator gen(7);
+  for (auto dtype : {INNC::f32, INNC::f64, INNC::bf16}) {
+    INNC::NumThreadsGuard one(1);
+    gen.manual_seed(7);
+    auto a = INNC::randn({1000, 100}, dtype, gen);
+    auto next = INNC::rand({10}, dtype, gen);
+    gen.manual_seed(7);
+    INNC::NumThreadsGuard four(4);
+    auto b = INNC::randn({1000, 100}, dtype, gen);
+    ASSERT_TRUE((a == b).all());
+    ASSERT_TRUE((INNC::rand({10}, dtype, gen) == next).all());
+    ASSERT_EQ(a.type(), dtype);
+  }
+
+  // Moments within 5 standard errors.
+  const size_t n = 1 << 18;
+  for (auto dtype : {INNC::f32, INNC::f64}) {
+    auto x = INNC::randn({n}, dtype, gen).type(INNC::f64);
+    ASSERT_TRUE(within(x.mean(), 0, .01));
+    ASSERT_TRUE(within((x * x).mean(), 1, .015));
+    ASSERT_TRUE(within((x.abs() > INNC::Tensor(2.)).type(INNC::f64).mean(),
+                       .0455, .002));
+    ASSERT_TRUE(within((x > INNC::Tensor(0.)).type(INNC::f64).mean(), .5,
+                       .005));
+    auto u = INNC::rand({n}, dtype, gen).type(INNC::f64);
+    ASSERT_TRUE(within(u.mean(), .5, .003));
+    ASSERT_TRUE(within((u < INNC::Tensor(.1)).type(INNC::f64).mean(), .1,
+                       .003));
+  }
+  for (auto dtype : {INNC::f32, INNC::f64, INNC::bf16, INNC::f16}) {
+    auto u = INNC::rand({n}, dtype, gen);
+    ASSERT_TRUE((u >= INNC::Tensor(0.)).all() && (u < INNC::Tensor(1.)).all());
+  }
+  auto r = INNC::randint(-3, 4, {70000}, INNC::i64, gen);
+  for (int k = -3; k < 4; ++k)
+    ASSERT_TRUE(within((r == INNC::Tensor(double(k))).type(INNC::f64).mean(),
+                       1. / 7, .007));
+  ASSERT_TRUE(within(r.min(), -3, 0) && within(r.max(), 3, 0));
+  auto p = INNC::full({n}, .3, INNC::f32);
+  ASSERT_TRUE(within(INNC::bernoulli(p, gen).mean(), .3, .005));
+  ASSERT_TRUE(within(INNC::bernoulli(INNC::ones({1000}, INNC::f64)), 1, 0));
+  ASSERT_TRUE(within(INNC::bernoulli(INNC::zeros({1000}, INNC::f64)), 0, 0));
+
+  ASSERT_THROW(INNC::randint(3, 3, {2}), std::runtime_error);
+  ASSERT_THROW(INNC::rand({2}, INNC::i32), std::runtime_error);
+  ASSERT_THROW(INNC::bernoulli(INNC::ones({2}, INNC::i32)), std::runtime_error);
+}